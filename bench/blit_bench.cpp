@@ -0,0 +1,158 @@
+/**
+ Benchmark of drawing sprites into an atlas by the image_blit kernels.
+ 1000 random rgba8 sprites of 16..160 pixels are placed by shelves with 2 pixels of padding
+ into a 4096x4096 rgba8 atlas, every other sprite is rotated. Each run draws all sprites and mirrors
+ their paddings. The per-pixel loop drawing the same sprites is timed as the baseline.
+ 
+ Build: c++ -std=c++11 -O2 -Isrc -I<libatlas2d>/include bench/blit_bench.cpp src/image_blit.cpp -latlas2d -o blit_bench
+ Add -DIMAGE_BLIT_NO_AVX2 or -DIMAGE_BLIT_NO_SIMD to measure SSE2 or scalar kernels.
+ Usage: blit_bench [runs]
+ */
+#include "image_blit.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    const int kAtlasSide = 4096;
+    const int kSpritesCount = 1000;
+    const int kMinSide = 16;
+    const int kMaxSide = 160;
+    const int kPadding = 2;
+    
+    // Sprite with its place in the atlas
+    struct Sprite {
+        image_props image;
+        bool rotated = false;
+        offset at;
+    };
+    
+    // Generates random sprites and places them by shelves. Sprites which don't fit are dropped
+    vector<Sprite> makeSprites() {
+        mt19937 rng(12345);
+        uniform_int_distribution<int> side(kMinSide, kMaxSide);
+        uniform_int_distribution<int> channel(0, 255);
+        
+        vector<Sprite> sprites;
+        int x = 0, y = 0, shelfHeight = 0;
+        for(int i = 0; i < kSpritesCount; ++i) {
+            Sprite sprite;
+            sprite.image.size = size(side(rng), side(rng));
+            sprite.image.fmt = pixel_format::rgba8;
+            sprite.rotated = (i % 2) != 0;
+            
+            const size_t bytes = (size_t)sprite.image.size.width * sprite.image.size.height * 4;
+            sprite.image.pixels = raw_data_ptr(new unsigned char[bytes], default_delete<unsigned char[]>());
+            for(size_t b = 0; b < bytes; ++b)
+                sprite.image.pixels.get()[b] = (unsigned char)channel(rng);
+            
+            const int width = (sprite.rotated ? sprite.image.size.height : sprite.image.size.width) + kPadding * 2;
+            const int height = (sprite.rotated ? sprite.image.size.width : sprite.image.size.height) + kPadding * 2;
+            if(x + width > kAtlasSide) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            if(y + height > kAtlasSide)
+                break;
+            
+            sprite.at = offset(x + kPadding, y + kPadding);
+            x += width;
+            shelfHeight = (std::max)(shelfHeight, height);
+            sprites.push_back(sprite);
+        }
+        return sprites;
+    }
+    
+    // Draws the sprites by the kernels
+    void drawByKernels(vector<Sprite> const& sprites, pixel_buffer const& atlas) {
+        for(auto const& sprite : sprites) {
+            blit_image(sprite.image, sprite.rotated, atlas, sprite.at);
+            
+            const int width = sprite.rotated ? sprite.image.size.height : sprite.image.size.width;
+            const int height = sprite.rotated ? sprite.image.size.width : sprite.image.size.height;
+            mirror_padding(atlas, rect(sprite.at.x, sprite.at.y, width, height), kPadding);
+        }
+    }
+    
+    // Draws the sprites pixel by pixel
+    void drawByPixels(vector<Sprite> const& sprites, pixel_buffer const& atlas) {
+        for(auto const& sprite : sprites) {
+            auto const& image = sprite.image;
+            for(int y = 0; y < image.size.height; ++y) {
+                for(int x = 0; x < image.size.width; ++x) {
+                    const int dstX = sprite.rotated ? image.size.height - 1 - y : x;
+                    const int dstY = sprite.rotated ? x : y;
+                    unsigned char const* src = image.pixels.get() + (y * image.size.width + x) * 4;
+                    unsigned char* dst = atlas.data + (sprite.at.y + dstY) * atlas.stride + (sprite.at.x + dstX) * 4;
+                    if(atlas.premultiplied) {
+                        dst[0] = (unsigned char)((src[0] * src[3] + 127) / 255);
+                        dst[1] = (unsigned char)((src[1] * src[3] + 127) / 255);
+                        dst[2] = (unsigned char)((src[2] * src[3] + 127) / 255);
+                        dst[3] = src[3];
+                    } else {
+                        memcpy(dst, src, 4);
+                    }
+                }
+            }
+            
+            const int width = sprite.rotated ? image.size.height : image.size.width;
+            const int height = sprite.rotated ? image.size.width : image.size.height;
+            mirror_padding(atlas, rect(sprite.at.x, sprite.at.y, width, height), kPadding);
+        }
+    }
+    
+    // Prints the best and the median time of the runs
+    void measure(char const* title, int runs, function<void()> const& run) {
+        vector<double> times;
+        for(int i = 0; i < runs; ++i) {
+            auto startTime = chrono::steady_clock::now();
+            run();
+            const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+            times.push_back(elapsed.count());
+        }
+        
+        sort(times.begin(), times.end());
+        printf("%-24s best %8.2f ms, median %8.2f ms\n", title, times.front(), times[times.size() / 2]);
+    }
+
+} // anonymous
+
+int main(int argc, const char * argv[]) {
+    const int runs = argc > 1 ? (std::max)(1, atoi(argv[1])) : 10;
+    
+    auto sprites = makeSprites();
+    vector<unsigned char> pixels((size_t)kAtlasSide * kAtlasSide * 4, 0);
+    
+    pixel_buffer atlas;
+    atlas.data = pixels.data();
+    atlas.stride = (size_t)kAtlasSide * 4;
+    atlas.dims = size(kAtlasSide, kAtlasSide);
+    atlas.fmt = pixel_format::rgba8;
+    
+    printf("%zu sprites into %dx%d rgba8 atlas, %s kernels, %d runs\n",
+           sprites.size(), kAtlasSide, kAtlasSide, blit_kernels_name(), runs);
+    
+    for(bool premultiplied : {false, true}) {
+        atlas.premultiplied = premultiplied;
+        measure(premultiplied ? "kernels, premultiplied" : "kernels", runs, [&]() {
+            drawByKernels(sprites, atlas);
+        });
+        measure(premultiplied ? "per pixel, premultiplied" : "per pixel", runs, [&]() {
+            drawByPixels(sprites, atlas);
+        });
+    }
+    
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ Benchmark of the atlas mapper's own cost: time and peak memory of mapping synthetic sprites.
+ Random 8..64 px sprites without pixels and with paths like "sprites/group_12/sprite_3456.png"
+ are mapped into 4096x4096 bestfit atlases. Bins are filled by a trivial shelf packer,
+ so the time is spent by the mapper rather than by the packer. The peak RSS is the one of the process,
+ so each number of sprites has to be measured by a separate run.
+ 
+ The benchmark uses only the mapper interface of the first versions, so it builds against older trees
+ to compare the mapper before and after changes. Drop from the build sources the files those trees don't have.
+ 
+ Build: c++ -std=c++11 -O2 -Isrc -I<elpp> -I<libatlas2d>/include bench/mapping_bench.cpp src/atlas_mapper_node.cpp
+        src/chain_node.cpp src/bin_packer.cpp src/thread_pool.cpp -latlas2d -lpthread -o mapping_bench
+ Usage: mapping_bench [sprites=10000]
+ */
+#include "atlas_mapper_node.hpp"
+#include "bin_packer.hpp"
+#include "chain_node.hpp"
+#include "helpers.hpp"
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <easylogging++.h>
+
+INITIALIZE_EASYLOGGINGPP
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    const int kAtlasSide = 4096;
+    
+    // Fills the bin by rows of items
+    class ShelfPacker: public bin_packer {
+    public:
+        ShelfPacker(int width, int height): _width(width), _height(height) { ;; }
+        
+        float occupancy() const override {
+            return (float)_usedSquare / ((float)_width * _height);
+        }
+        
+        std::array<int, 2> bin_dims() const override {
+            std::array<int, 2> dims = {_width, _height};
+            return dims;
+        }
+        
+        bool insert_square(int width, int height, atlas_item& item) override {
+            if(_x + width > _width) {
+                _x = 0;
+                _y += _shelfHeight;
+                _shelfHeight = 0;
+            }
+            if(_y + height > _height || width > _width)
+                return false;
+            
+            item.box = rect(_x, _y, width, height);
+            item.rotated = false;
+            _x += width;
+            _shelfHeight = (std::max)(_shelfHeight, height);
+            _usedSquare += (long long)width * height;
+            return true;
+        }
+        
+        void clean_bin() override {
+            _x = _y = _shelfHeight = 0;
+            _usedSquare = 0;
+        }
+    
+    private:
+        int _width, _height;
+        int _x = 0, _y = 0, _shelfHeight = 0;
+        long long _usedSquare = 0;
+    };
+    
+    // Counts mapped atlases and items
+    class CountingNode: public chain_node {
+    public:
+        size_t atlases = 0, items = 0;
+        
+        bool begin_atlas(atlas_props const&) override { ++atlases; return true; }
+        bool add_atlas_item(atlas_item const&) override { ++items; return true; }
+        bool end_atlas(bool) override { return true; }
+    };
+    
+    // Returns the peak resident set size of the process in MB
+    double peakRssMb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+    }
+
+} // anonymous
+
+int main(int argc, const char * argv[]) {
+    el::Configurations conf;
+    conf.setToDefault();
+    conf.set(el::Level::Info, el::ConfigurationType::Enabled, "false");
+    el::Loggers::setDefaultConfigurations(conf, true);
+    
+    const int spritesCount = argc > 1 ? atoi(argv[1]) : 10000;
+    
+    mt19937 rng(42);
+    uniform_int_distribution<int> side(8, 64);
+    vector<atlas_item> sprites(spritesCount);
+    for(int i = 0; i < spritesCount; ++i) {
+        auto& sprite = sprites[i];
+        sprite.size = size(side(rng), side(rng));
+        sprite.fmt = pixel_format::rgba8;
+        sprite.image_path = "sprites/group_" + to_string(i % 100) + "/sprite_" + to_string(i) + ".png";
+    }
+    const double spritesRss = peakRssMb();
+    
+    auto mapper = make_shared<atlas_mapper_node>(atlas_mapper_node::init_props()
+                                                 .set_algo(atlas_mapper_props::best_size)
+                                                 .set_bin_factory([](int width, int height) {
+                                                     auto packer = make_shared<ShelfPacker>(width, height);
+                                                     return bin_packer_ptr(packer);
+                                                 }));
+    auto counter = make_shared<CountingNode>();
+    mapper->set_child(counter);
+    
+    atlas_props atlas;
+    atlas.size = size(kAtlasSide, kAtlasSide);
+    atlas.fmt = pixel_format::rgba8;
+    
+    auto startTime = chrono::steady_clock::now();
+    bool isOk = mapper->begin_atlas(atlas);
+    for(auto const& sprite : sprites)
+        isOk = isOk && mapper->add_atlas_item(sprite);
+    isOk = isOk && mapper->end_atlas(true);
+    const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+    
+    if(!isOk || counter->items != sprites.size()) {
+        printf("Mapping failed, %zu of %zu sprites were mapped\n", counter->items, sprites.size());
+        return 1;
+    }
+    
+    printf("%d sprites into %zu atlases: %.1f ms, peak RSS %.1f MB (%.1f MB with sprites only)\n",
+           spritesCount, counter->atlases, elapsed.count(), peakRssMb(), spritesRss);
+    return 0;
+}
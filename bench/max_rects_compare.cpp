@@ -0,0 +1,137 @@
+/**
+ Compares the native MaxRects packer with rbp::MaxRectsBinPack wrapped by max_rects_bin.
+ Random items are packed by both packers with each of the five heuristics,
+ one by one and (with --global) by the batch insert in the global order.
+ Placements of both packers have to be identical, the time of both is printed.
+ 
+ Build: c++ -std=c++11 -O2 -Isrc -I<rbp>/include bench/max_rects_compare.cpp src/max_rects_packer.cpp
+        src/rbp_wrappers.cpp src/bin_packer.cpp -lrbp -o max_rects_compare
+ Usage: max_rects_compare [items=1000] [bin side=512] [--global]
+ */
+#include "max_rects_packer.hpp"
+#include "rbp_wrappers.hpp"
+#include "helpers.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <tuple>
+#include <vector>
+
+using namespace ::std;
+
+namespace {
+    
+    const char* kHeuristicNames[] = {"best short side", "best long side", "best area", "bottom left", "contact point"};
+    
+    // Placement of an item
+    using Placement = tuple<bool, int, int, int, int>;
+    
+    // Packs the items one by one and returns their placements and the time in ms
+    double insertOneByOne(bin_packer& packer, vector<pair<int, int>> const& sizes, vector<Placement>& placements) {
+        auto startTime = chrono::steady_clock::now();
+        vector<atlas_item> items(sizes.size());
+        for(size_t i = 0; i < sizes.size(); ++i)
+            packer.insert_square(sizes[i].first, sizes[i].second, items[i]);
+        const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+        
+        placements.clear();
+        for(auto const& item : items) {
+            const bool placed = item.box.width != 0;
+            placements.push_back(placed ? Placement(true, item.box.x, item.box.y, item.box.width, item.box.height)
+                                 : Placement(false, 0, 0, 0, 0));
+        }
+        return elapsed.count();
+    }
+    
+    /**
+     Packs the items by the batch insert and returns their placements and the time in ms.
+     The rbp wrapper matches placed rects to items by size, so items of the same size may swap their places.
+     Placements are sorted to compare them regardless of the order.
+     */
+    double insertBatch(bin_packer& packer, vector<pair<int, int>> const& sizes, vector<Placement>& placements) {
+        vector<bin_packer::batch_item> items(sizes.size());
+        for(size_t i = 0; i < sizes.size(); ++i) {
+            items[i].width = sizes[i].first;
+            items[i].height = sizes[i].second;
+        }
+        
+        auto startTime = chrono::steady_clock::now();
+        packer.insert_batch(items);
+        const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+        
+        placements.clear();
+        for(auto const& item : items) {
+            const int width = item.rotated ? item.height : item.width;
+            const int height = item.rotated ? item.width : item.height;
+            placements.push_back(item.placed ? Placement(true, item.x, item.y, width, height)
+                                 : Placement(false, 0, 0, 0, 0));
+        }
+        sort(placements.begin(), placements.end());
+        return elapsed.count();
+    }
+
+} // anonymous
+
+int main(int argc, const char * argv[]) {
+    int itemsCount = 1000, binSide = 512;
+    bool globalOrder = false;
+    int position = 0;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "--global") == 0)
+            globalOrder = true;
+        else if(position++ == 0)
+            itemsCount = atoi(argv[i]);
+        else
+            binSide = atoi(argv[i]);
+    }
+    
+    printf("%d items of 4..43 px into %dx%d bin, %s\n", itemsCount, binSide, binSide,
+           globalOrder ? "batch insert in the global order" : "one by one");
+    
+    size_t totalMismatches = 0;
+    for(int heuristic = 0; heuristic < 5; ++heuristic) {
+        mt19937 rng(7 + heuristic);
+        uniform_int_distribution<int> side(4, 43);
+        vector<pair<int, int>> sizes(itemsCount);
+        for(auto& itemSize : sizes)
+            itemSize = make_pair(side(rng), side(rng));
+        
+        // Both packers enumerate heuristics in the same order
+        native_max_rects_bin::packer native;
+        native.prefs()
+        .set_bin_width(binSide)
+        .set_bin_height(binSide)
+        .set_insert_heuristic((native_max_rects_bin::insert_heuristic_type)heuristic)
+        .enable_global_order(globalOrder);
+        native.clean_bin();
+        
+        max_rects_bin::packer rbpPacker;
+        rbpPacker.prefs()
+        .set_bin_width(binSide)
+        .set_bin_height(binSide)
+        .set_insert_heuristic((max_rects_bin::prefs::rbp_insert_heuristic)heuristic)
+        .enable_global_order(globalOrder);
+        rbpPacker.clean_bin();
+        
+        vector<Placement> nativePlacements, rbpPlacements;
+        auto insert = globalOrder ? &insertBatch : &insertOneByOne;
+        const double nativeTime = insert(native, sizes, nativePlacements);
+        const double rbpTime = insert(rbpPacker, sizes, rbpPlacements);
+        
+        size_t placed = 0, mismatches = 0;
+        for(size_t i = 0; i < nativePlacements.size(); ++i) {
+            placed += get<0>(nativePlacements[i]) ? 1 : 0;
+            mismatches += nativePlacements[i] != rbpPlacements[i] ? 1 : 0;
+        }
+        totalMismatches += mismatches;
+        
+        printf("%-16s placed %5zu, mismatches %zu, occupancy %.4f / %.4f, native %9.2f ms, rbp %9.2f ms\n",
+               kHeuristicNames[heuristic], placed, mismatches, native.occupancy(), rbpPacker.occupancy(),
+               nativeTime, rbpTime);
+    }
+    
+    return totalMismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+/**
+ Benchmark of probing PNG dimensions by read_image without pixels, which reads only the IHDR chunk.
+ Every PNG of the directory is probed by read_image and by libpng reading the chunks up to the image data,
+ as read_image did before the IHDR probe. Both have to give the same sizes, the time of both is printed.
+ Generated files check the fallback to libpng first: interlaced, palette, gray and 16-bit images
+ and malformed files the probe rejects.
+ 
+ Build: c++ -std=c++11 -O2 -Isrc -I<elpp> -I<libatlas2d>/include bench/png_probe_bench.cpp src/image_io.cpp
+        src/image_blit.cpp src/etc2_encoder.cpp src/mapped_file.cpp src/thread_pool.cpp
+        -lboost_filesystem -lboost_system -lpng -lz -lpthread -o png_probe_bench
+ Add -DIMAGE_IO_NO_PNG_PROBE to time read_image without the IHDR probe.
+ Usage: png_probe_bench <sprites dir> [runs=5]
+ */
+#include "image_io.hpp"
+#include "mapped_file.hpp"
+#include "helpers.hpp"
+#include <boost/filesystem.hpp>
+#include <png.h>
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <easylogging++.h>
+
+INITIALIZE_EASYLOGGINGPP
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace fs = boost::filesystem;
+
+namespace {
+    
+    /// Generated file with the expected result of probing
+    struct GeneratedPng {
+        string name;
+        bool probed = true;         ///< read_image has to succeed
+        bool libpngProbed = true;   ///< libpng has to succeed
+        int width = 0, height = 0;
+    };
+    
+    /// Memory mapped PNG file libpng reads from
+    struct MappedSource {
+        mapped_file file;
+        size_t pos = 0;
+    };
+    
+    void readMapped(png_structp pngStruct, png_bytep out, png_size_t length) {
+        auto* source = static_cast<MappedSource*>(png_get_io_ptr(pngStruct));
+        if(source->file.size() - source->pos < length)
+            png_error(pngStruct, "Unexpected end of file");
+        
+        memcpy(out, source->file.data() + source->pos, length);
+        source->pos += length;
+    }
+    
+    void silentError(png_structp pngStruct, png_const_charp) {
+        longjmp(png_jmpbuf(pngStruct), 1);
+    }
+    
+    void silentWarning(png_structp, png_const_charp) { ;; }
+    
+    // Reads dimensions by libpng as read_image did before the IHDR probe
+    bool probeByLibpng(string const& filename, size& dims) {
+        MappedSource source;
+        if(!source.file.open(filename))
+            return false;
+        
+        png_structp pngStruct = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, &silentError, &silentWarning);
+        png_infop pngInfo = png_create_info_struct(pngStruct);
+        if(setjmp(png_jmpbuf(pngStruct))) {
+            png_destroy_read_struct(&pngStruct, &pngInfo, nullptr);
+            return false;
+        }
+        
+        png_set_read_fn(pngStruct, &source, &readMapped);
+        png_read_info(pngStruct, pngInfo);
+        dims = size(png_get_image_width(pngStruct, pngInfo), png_get_image_height(pngStruct, pngInfo));
+        png_destroy_read_struct(&pngStruct, &pngInfo, nullptr);
+        return true;
+    }
+    
+    // Writes a PNG of random pixels
+    bool writePng(string const& filename, int width, int height, int colorType, int bitDepth, int interlace) {
+        FILE* fp = fopen(filename.c_str(), "wb");
+        if(!fp)
+            return false;
+        
+        png_structp pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        png_infop pngInfo = png_create_info_struct(pngStruct);
+        png_init_io(pngStruct, fp);
+        png_set_IHDR(pngStruct, pngInfo, width, height, bitDepth, colorType, interlace,
+                     PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        
+        vector<png_color> palette(256);
+        if(colorType == PNG_COLOR_TYPE_PALETTE) {
+            for(int i = 0; i < 256; ++i)
+                palette[i].red = palette[i].green = palette[i].blue = (png_byte)i;
+            png_set_PLTE(pngStruct, pngInfo, palette.data(), 1 << bitDepth);
+        }
+        png_write_info(pngStruct, pngInfo);
+        
+        const size_t rowBytes = png_get_rowbytes(pngStruct, pngInfo);
+        vector<png_byte> pixels(rowBytes * height);
+        for(size_t i = 0; i < pixels.size(); ++i)
+            pixels[i] = (png_byte)(i * 131 + 7);
+        // palette indices stay in the range of the palette
+        if(colorType == PNG_COLOR_TYPE_PALETTE && bitDepth == 8)
+            fill(pixels.begin(), pixels.end(), 1);
+        
+        vector<png_bytep> rows(height);
+        for(int y = 0; y < height; ++y)
+            rows[y] = pixels.data() + y * rowBytes;
+        png_write_image(pngStruct, rows.data());
+        png_write_end(pngStruct, pngInfo);
+        png_destroy_write_struct(&pngStruct, &pngInfo);
+        fclose(fp);
+        return true;
+    }
+    
+    // Rewrites the file with the content changed by the handler
+    void patchFile(string const& filename, function<void(vector<char>&)> const& patch) {
+        ifstream in(filename, ios::binary);
+        vector<char> content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        in.close();
+        patch(content);
+        ofstream(filename, ios::binary | ios::trunc).write(content.data(), content.size());
+    }
+    
+    // Generates images read_image has to probe as libpng does
+    vector<GeneratedPng> generatePngs(fs::path const& dir) {
+        vector<GeneratedPng> pngs;
+        auto add = [&](string name, int width, int height, int colorType, int bitDepth, int interlace) {
+            GeneratedPng png;
+            png.name = (dir / name).string();
+            png.width = width;
+            png.height = height;
+            writePng(png.name, width, height, colorType, bitDepth, interlace);
+            pngs.push_back(png);
+            return png.name;
+        };
+        auto fail = [&](bool probed, bool libpngProbed) {
+            pngs.back().probed = probed;
+            pngs.back().libpngProbed = libpngProbed;
+        };
+        
+        add("rgba.png", 37, 23, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE);
+        add("interlaced.png", 61, 17, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_ADAM7);
+        add("rgb16.png", 5, 300, PNG_COLOR_TYPE_RGB, 16, PNG_INTERLACE_NONE);
+        add("gray1.png", 129, 3, PNG_COLOR_TYPE_GRAY, 1, PNG_INTERLACE_ADAM7);
+        add("palette.png", 64, 64, PNG_COLOR_TYPE_PALETTE, 8, PNG_INTERLACE_NONE);
+        
+        // IHDR with a wrong CRC
+        patchFile(add("bad_crc.png", 16, 16, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            content[29] ^= 1;
+        });
+        fail(false, false);
+        
+        // Wrong signature
+        patchFile(add("bad_signature.png", 16, 16, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            content[1] = 'Q';
+        });
+        fail(false, false);
+        
+        // Ends inside IHDR
+        patchFile(add("short.png", 16, 16, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            content.resize(20);
+        });
+        fail(false, false);
+        
+        // Zero width with a valid CRC, the probe falls back to libpng rejecting it as well
+        patchFile(add("zero_width.png", 16, 16, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            auto* chunk = reinterpret_cast<unsigned char*>(content.data() + 8);
+            memset(chunk + 8, 0, 4);
+            const uLong crc = crc32(0L, chunk + 4, 4 + 13);
+            for(int i = 0; i < 4; ++i)
+                chunk[8 + 13 + i] = (unsigned char)(crc >> (24 - 8 * i));
+        });
+        fail(false, false);
+        
+        // Ends inside the image data, both read only the header chunks
+        patchFile(add("truncated_data.png", 300, 300, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            content.resize(content.size() / 2);
+        });
+        
+        // Ends right after IHDR. The probe reads nothing else, while libpng fails on the missing chunks
+        patchFile(add("header_only.png", 16, 16, PNG_COLOR_TYPE_RGBA, 8, PNG_INTERLACE_NONE), [](vector<char>& content) {
+            content.resize(33);
+        });
+#ifdef IMAGE_IO_NO_PNG_PROBE
+        fail(false, false);
+#else
+        fail(true, false);
+#endif
+        
+        return pngs;
+    }
+    
+    // Returns the best time of the runs in ms
+    double measure(int runs, function<void()> const& run) {
+        double best = 0;
+        for(int i = 0; i < runs; ++i) {
+            auto startTime = chrono::steady_clock::now();
+            run();
+            const chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - startTime;
+            best = i == 0 ? elapsed.count() : (std::min)(best, elapsed.count());
+        }
+        return best;
+    }
+
+} // anonymous
+
+int main(int argc, const char * argv[]) {
+    if(argc < 2) {
+        printf("Usage: png_probe_bench <sprites dir> [runs=5]\n");
+        return 1;
+    }
+    const int runs = argc > 2 ? (std::max)(1, atoi(argv[2])) : 5;
+    
+    el::Configurations conf;
+    conf.setToDefault();
+    conf.set(el::Level::Info, el::ConfigurationType::Enabled, "false");
+    conf.set(el::Level::Warning, el::ConfigurationType::Enabled, "false");
+    el::Loggers::setDefaultConfigurations(conf, true);
+    
+    int failures = 0;
+    
+    // The fallback to libpng
+    const fs::path generatedDir = fs::temp_directory_path() / fs::unique_path("png_probe_%%%%%%%%");
+    fs::create_directories(generatedDir);
+    for(auto const& png : generatePngs(generatedDir)) {
+        image_props props;
+        size libpngDims;
+        const bool probed = read_image(png.name, props, false);
+        const bool libpngProbed = probeByLibpng(png.name, libpngDims);
+        
+        bool isOk = probed == png.probed && libpngProbed == png.libpngProbed;
+        if(probed)
+            isOk = isOk && props.size.width == png.width && props.size.height == png.height;
+        if(libpngProbed)
+            isOk = isOk && libpngDims.width == png.width && libpngDims.height == png.height;
+        
+        failures += isOk ? 0 : 1;
+        printf("%-8s %-20s read_image %s, libpng %s\n", isOk ? "ok" : "FAILED", fs::path(png.name).filename().string().c_str(),
+               probed ? (to_string(props.size.width) + "x" + to_string(props.size.height)).c_str() : "failed",
+               libpngProbed ? (to_string(libpngDims.width) + "x" + to_string(libpngDims.height)).c_str() : "failed");
+    }
+    fs::remove_all(generatedDir);
+    
+    // Sprites of the directory
+    vector<string> files;
+    for(fs::recursive_directory_iterator it(argv[1]), end; it != end; ++it) {
+        if(fs::is_regular_file(it->path()) && it->path().extension() == ".png")
+            files.push_back(it->path().string());
+    }
+    sort(files.begin(), files.end());
+    
+    size_t mismatches = 0;
+    for(auto const& file : files) {
+        image_props props;
+        size libpngDims;
+        const bool probed = read_image(file, props, false);
+        const bool libpngProbed = probeByLibpng(file, libpngDims);
+        if(probed != libpngProbed || (probed && (props.size.width != libpngDims.width ||
+                                                 props.size.height != libpngDims.height))) {
+            ++mismatches;
+            printf("Mismatch %s\n", file.c_str());
+        }
+    }
+    failures += mismatches ? 1 : 0;
+    
+    size_t probedCount = 0;
+    const double probeTime = measure(runs, [&]() {
+        for(auto const& file : files) {
+            image_props props;
+            probedCount += read_image(file, props, false) ? 1 : 0;
+        }
+    });
+    const double libpngTime = measure(runs, [&]() {
+        for(auto const& file : files) {
+            size dims;
+            probedCount += probeByLibpng(file, dims) ? 1 : 0;
+        }
+    });
+
+#ifdef IMAGE_IO_NO_PNG_PROBE
+    const char* probeName = "read_image without the IHDR probe";
+#else
+    const char* probeName = "read_image";
+#endif
+    printf("%zu files, %zu mismatches, best of %d runs: %s %.2f ms, libpng %.2f ms\n",
+           files.size(), mismatches, runs, probeName, probeTime, libpngTime);
+    
+    return failures == 0 ? 0 : 1;
+}
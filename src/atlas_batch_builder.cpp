@@ -0,0 +1,76 @@
+#include "atlas_batch_builder.hpp"
+#include "binary_atlas_parser.hpp"
+#include "thread_pool.hpp"
+#include <thread>
+#include <algorithm>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "batch_builder"
+
+using namespace ::std;
+
+namespace {
+    
+    // Builds a single atlas of the batch
+    bool buildAtlas(string const& atlasFile, sprites_index_cache_ptr sprites, atlas_batch_props const& props) {
+        json_parser_props parserProps;
+        if(!props.prepare_atlas(atlasFile, parserProps) || !parserProps.atlas_builder) {
+            CLOG(ERROR, MODULE_LOGGER) << "Can't create the builder for " << atlasFile;
+            return false;
+        }
+        
+        // Binary mappings keep image paths, so they don't need the sprites map
+        if(is_binary_atlas_file(atlasFile))
+            return parse_binary_atlas(atlasFile, parserProps.set_thread_pool(props.pool));
+        
+        return parse_json_atlas(atlasFile, parserProps
+                                .set_thread_pool(props.pool)
+                                .set_sprites_indices(sprites));
+    }
+    
+} // anonymous
+
+std::vector<atlas_batch_result> build_atlas_batch(std::vector<std::string> const& atlasFiles,
+                                                  atlas_batch_props const& props)
+{
+    vector<atlas_batch_result> results(atlasFiles.size());
+    if(atlasFiles.empty())
+        return results;
+    
+    // Each worker builds one atlas at a time, so the number of workers
+    // limits the number of atlas images held in memory.
+    // Atlas workers wait for images read on the props.pool,
+    // so they must not share it, otherwise they could wait for themselves
+    unsigned inFlight = props.max_in_flight ? props.max_in_flight : (std::max)(thread::hardware_concurrency(), 1u);
+    inFlight = (std::min)(inFlight, (unsigned)atlasFiles.size());
+    thread_pool pool(inFlight);
+    
+    // Sprites maps are loaded by the first atlas referring them
+    auto sprites = props.sprites_indices ? props.sprites_indices : make_shared<sprites_index_cache>();
+    
+    vector<future<bool>> pending;
+    pending.reserve(atlasFiles.size());
+    for(auto const& atlasFile : atlasFiles) {
+        pending.push_back(pool.submit([&atlasFile, sprites, &props]() {
+            return buildAtlas(atlasFile, sprites, props);
+        }));
+    }
+    
+    for(size_t i = 0; i < atlasFiles.size(); ++i) {
+        auto& result = results[i];
+        result.atlas_file = atlasFiles[i];
+        
+        try {
+            result.success = pending[i].get();
+        } catch(std::exception const& e) {
+            CLOG(ERROR, MODULE_LOGGER) << e.what();
+            result.success = false;
+        }
+        
+        if(!result.success) {
+            CLOG(ERROR, MODULE_LOGGER) << "An error during building the atlas " << result.atlas_file;
+        }
+    }
+    
+    return results;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "forwards.hpp"
+#include "json_atlas_parser.hpp"
+#include <vector>
+
+/// Batch building properties
+struct atlas_batch_props {
+    using props = atlas_batch_props;
+    using atlas_preparer = std::function<bool(std::string const&, json_parser_props&)>;
+    
+    atlas_preparer prepare_atlas;       ///< Sets up the builder and the image reader of a specific atlas json
+    thread_pool_ptr pool;               ///< Worker threads to read images on. Shared by all atlases of the batch
+    unsigned max_in_flight = 0;         ///< Max number of atlases built simultaneously (0 - number of hardware threads)
+    sprites_index_cache_ptr sprites_indices; ///< Sprites maps shared by atlases of the batch
+    
+    /// Sets the function which sets up the builder and the image reader of a specific atlas json
+    props& set_atlas_preparer(atlas_preparer arg) {prepare_atlas=std::move(arg); return *this;}
+    /// Sets worker threads to read images on
+    props& set_thread_pool(thread_pool_ptr arg) {pool=std::move(arg); return *this;}
+    /// Sets max number of atlases built simultaneously
+    props& set_max_in_flight(unsigned arg) {max_in_flight=arg; return *this;}
+    /// Sets the cache of sprites maps. The batch creates its own one by default
+    props& set_sprites_indices(sprites_index_cache_ptr arg) {sprites_indices=std::move(arg); return *this;}
+};
+
+/// Result of building a single atlas of the batch
+struct atlas_batch_result {
+    std::string atlas_file;     ///< Atlas json
+    bool success = false;       ///< Whether the atlas was built
+};
+
+/**
+ @brief Builds a bunch of atlases concurrently.
+ Json atlases take sprites maps recorded in their sprites_file fields from the shared cache,
+ so each sprites map is loaded only once. Binary atlases (see is_binary_atlas_file) don't use sprites maps.
+ Each atlas is drawn by its own builder. The number of atlases in flight
+ is limited by the max_in_flight property as each of them holds the whole image in memory.
+ @return Results in the order of the atlas_files.
+ */
+std::vector<atlas_batch_result> build_atlas_batch(std::vector<std::string> const& atlas_files,
+                                                  atlas_batch_props const& props);
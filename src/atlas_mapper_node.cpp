@@ -1,9 +1,15 @@
 #include "atlas_mapper_node.hpp"
 #include "helpers.hpp"
 #include "bin_packer.hpp"
-#include <list>
+#include "thread_pool.hpp"
+#include <vector>
+#include <future>
+#include <chrono>
+#include <algorithm>
 #include <tuple>
 #include <cmath>
+#include <cstdlib>
+#include <cstdint>
 #include <cassert>
 #include <easylogging++.h>
 
@@ -14,84 +20,157 @@ using namespace ::std;
 
 namespace {
     
-    struct WeightedItem;
-    using ItemSet = list<WeightedItem>;
-    using ItemIndex = ItemSet::iterator;
-    using IndexList = list<ItemIndex>;
-
-    // Item with extra information about its dimensions
-    struct WeightedItem: atlas_item {
-        int square = 0;     ///< Square of the item
-        int sqpow2Exp = 0;  ///< The best squared pow2 bin to place into
-    };
+    using ItemHandle = uint32_t;
+    using HandleList = vector<ItemHandle>;
     
-    // Sorting items by suare
-    bool sortBySquare(WeightedItem const& a, WeightedItem const& b) {
-        return a.square > b.square;
+    // Rounds the length up to a multiple of the alignment
+    inline int alignUp(int length, int alignment) {
+        return (length + alignment - 1) / alignment * alignment;
     }
     
+    /**
+     Items collected by the mapper stored as the structure of arrays.
+     Each item is addressed by its handle, which is an index in the arrays.
+     Packing touches only sizes and weights, the rest is needed only to pass items down the chain.
+     */
+    struct ItemStore {
+        vector<size> sizes;                 ///< Original sizes of items
+        vector<int> squares;                ///< Squares of items including paddings
+        vector<int> sqpow2Exps;             ///< The best squared pow2 bins to place items into
+        vector<pixel_format> formats;       ///< Pixel formats of items
+        vector<raw_data_ptr> pixels;        ///< Pixels of items
+        string pathChars;                   ///< Image paths of items stored one after another
+        vector<size_t> pathEnds;            ///< Ends of the image paths in pathChars
+        vector<size> sourceSizes;           ///< Sizes of items before trimming
+        vector<offset> trimOffsets;         ///< Offsets of trimmed items in their source images
+        vector<vector<atlas_alias>> aliases; ///< Sprites sharing images of items
+        
+        // Returns the number of items
+        size_t count() const {
+            return sizes.size();
+        }
+        
+        // Stores the item
+        ItemHandle add(atlas_item const& item, size const& extraSize, int sqpow2Exp) {
+            auto handle = (ItemHandle)count();
+            sizes.push_back(item.size);
+            squares.push_back(extraSize.width * extraSize.height);
+            sqpow2Exps.push_back(sqpow2Exp);
+            formats.push_back(item.fmt);
+            pixels.push_back(item.pixels);
+            pathChars += item.image_path;
+            pathEnds.push_back(pathChars.size());
+            sourceSizes.push_back(item.source_size);
+            trimOffsets.push_back(item.trim_offset);
+            aliases.push_back(item.aliases);
+            return handle;
+        }
+        
+        // Returns the image path of the item
+        string path(ItemHandle handle) const {
+            const size_t begin = handle ? pathEnds[handle - 1] : 0;
+            return pathChars.substr(begin, pathEnds[handle] - begin);
+        }
+        
+        // Releases the item data which isn't needed after the item was passed to the chain.
+        // Paths take a few bytes each in the shared buffer, so they live till the store is cleared
+        void release(ItemHandle handle) {
+            pixels[handle].reset();
+            vector<atlas_alias>().swap(aliases[handle]);
+        }
+        
+        void clear() {
+            *this = ItemStore();
+        }
+    };
+    
+    // Sorting items by square
+    struct SortBySquare {
+        ItemStore const& store;
+        
+        bool operator()(ItemHandle a, ItemHandle b) const {
+            return store.squares[a] > store.squares[b];
+        }
+    };
+    
     // Sorting items by sqpow2Exp
-    bool sortBySqpow2(WeightedItem const& a, WeightedItem const& b) {
-        return make_tuple(a.sqpow2Exp, a.square) > make_tuple(b.sqpow2Exp, b.square);
-    }
+    struct SortBySqpow2 {
+        ItemStore const& store;
+        
+        bool operator()(ItemHandle a, ItemHandle b) const {
+            return make_tuple(store.sqpow2Exps[a], store.squares[a]) > make_tuple(store.sqpow2Exps[b], store.squares[b]);
+        }
+    };
 
     // Atlas with extra information about its items and square
     struct AtlasTemplate: atlas_props {
-        ItemSet items;          ///< The collection of weighted items
+        HandleList items;       ///< Items waiting to be placed
         int itemsSquare = 0;    ///< Calculated square of the atlas
     };
+    
+    // Position of an item in a bin
+    struct Placement {
+        rect box;               ///< Rect to place the image into
+        bool rotated = false;   ///< Is the image rotated
+    };
 
     // The bin class to place items into
     struct ActiveBin {
         int itemExtraPixels = 0;    ///< Extra paddings for each item
+        int blockAlign = 1;         ///< Size of blocks the cells of items are aligned to
+        atlas_mapper_props::bin_factory createBin; ///< Factory of the bin packer
         bin_packer_ptr packer;      ///< Actual bin packer
-        IndexList itemIndexes;      ///< Indexes of atlas items which where placed into the bin
+        HandleList items;           ///< Handles of atlas items which where placed into the bin
+        vector<Placement> placements; ///< Placements of the items in the bin
         int itemsSquare = 0;        ///< Calculated square of the bin
         int minEdgeLen = 0;         ///< The minimum size of bin's edge
         
-        // Rebuilds the bin
-        bool rebuildBin() {
-            packer->clean_bin();
-            
-            for(auto const& index : itemIndexes) {
-                auto& item = *index;
-                bool success = packer->insert_square(item.size.width + itemExtraPixels,
-                                                  item.size.height + itemExtraPixels,
-                                                  item);
-                if(!success)
-                    return false;
-                
-                // restore original size of the item
-                item.box.width -= itemExtraPixels;
-                item.box.height -= itemExtraPixels;
-
-            }
-            
-            return true;
+        // Returns the length of the item's cell including the padding
+        int cellLength(int itemLength) const {
+            return alignUp(itemLength + itemExtraPixels, blockAlign);
         }
         
-        // Inserts an item taking into account the extra padding
-        bool tryInsertItem(ItemIndex index) {
-            auto& item = *index;
+        /**
+         Inserts the items by a single batch taking into account the extra padding.
+         The packer may choose the order of inserting, items which don't fit are left out of the bin.
+         Returns the number of placed items.
+         */
+        size_t insertItems(ItemStore const& store, HandleList::const_iterator first, HandleList::const_iterator last) {
+            vector<bin_packer::batch_item> batch(distance(first, last));
+            for(size_t i = 0; i < batch.size(); ++i) {
+                auto const& itemSize = store.sizes[first[i]];
+                batch[i].width = cellLength(itemSize.width);
+                batch[i].height = cellLength(itemSize.height);
+            }
             
-            bool success = packer->insert_square(item.size.width + itemExtraPixels,
-                                              item.size.height + itemExtraPixels,
-                                              item);
-            if(success) {
+            const size_t placedCount = packer->insert_batch(batch);
+            for(size_t i = 0; i < batch.size(); ++i) {
+                auto const& placed = batch[i];
+                if(!placed.placed)
+                    continue;
+                
+                auto handle = first[i];
+                const int placedWidth = placed.rotated ? placed.height : placed.width;
+                const int placedHeight = placed.rotated ? placed.width : placed.height;
+                
                 // increace cummulative square of the bin
-                itemsSquare += item.square;
+                itemsSquare += store.squares[handle];
                 // calculate the minimal edge of the bin
-                minEdgeLen = (std::max)(minEdgeLen, (std::max)(item.box.width, item.box.height));
-
+                minEdgeLen = (std::max)(minEdgeLen, (std::max)(placedWidth, placedHeight));
+                
                 // restore original item size
-                item.box.width -= itemExtraPixels;
-                item.box.height -= itemExtraPixels;
+                auto const& itemSize = store.sizes[handle];
+                Placement placement;
+                placement.box = rect(placed.x, placed.y,
+                                     placed.rotated ? itemSize.height : itemSize.width,
+                                     placed.rotated ? itemSize.width : itemSize.height);
+                placement.rotated = placed.rotated;
                 
-                itemIndexes.push_back(move(index));
-                return success;
+                items.push_back(handle);
+                placements.push_back(placement);
             }
             
-            return success;
+            return placedCount;
         }
         
         // Returns bin size
@@ -118,10 +197,24 @@ namespace {
 
         return minExp >= (std::max)(widthExp, heightExp) ? (int)minExp : (int)maxExp;
     }
+    
+    // Returns the biggest power of two not greater than the value
+    int floorPow2(int value) {
+        int result = 1;
+        while(result <= value / 2)
+            result *= 2;
+        return result;
+    }
+    
+    // Returns bin's area
+    long long areaOf(size const& sz) {
+        return (long long)sz.width * sz.height;
+    }
 }
 
 struct atlas_mapper_node::Pimpl: atlas_mapper_props {
     atlas_builder* mainChain = nullptr;
+    ItemStore store;            ///< Collected items
     AtlasTemplate atlasTmpl;    ///< Atlas template
     ActiveBin activeBin;        ///< Active bin for packing
     
@@ -130,10 +223,16 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
         return atlasTmpl.padding * 2;
     }
     
-    // Returns the size of the item taking into account paddings between items
+    // Returns the size blocks of the atlas are aligned to
+    int blockAlign() const {
+        return (std::max)(1, block_align);
+    }
+    
+    // Returns the size of the item taking into account paddings between items and the block alignment
     size getItemExtraSize(atlas_item const& item) {
         auto extraLen = itemExtraPixels();
-        return size(item.size.width + extraLen, item.size.height + extraLen);
+        return size(alignUp(item.size.width + extraLen, blockAlign()),
+                    alignUp(item.size.height + extraLen, blockAlign()));
     }
     
     // Calculates the best power of two size of a bin
@@ -151,7 +250,7 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
 
         if(!atlasTmpl.items.empty()) {
             // take into account item's exp
-            double itemMinExp = (double)atlasTmpl.items.front().sqpow2Exp;
+            double itemMinExp = (double)store.sqpow2Exps[atlasTmpl.items.front()];
             fixedExp = (std::max)(fixedExp, itemMinExp);
         }
 
@@ -162,54 +261,290 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
     }
     
 
-    // Tries to compact the active bin
-    void compactBin(ActiveBin& bin) {
+    // Runs the task for each index on worker threads. The tasks must not wait for other tasks of the pool
+    void runTasks(size_t count, function<void(size_t)> const& task) {
+        if(!pool || count < 2) {
+            for(size_t i = 0; i < count; ++i)
+                task(i);
+            return;
+        }
+        
+        vector<future<void>> results;
+        results.reserve(count);
+        for(size_t i = 0; i < count; ++i) {
+            results.push_back(pool->submit([&task, i]() {
+                task(i);
+            }));
+        }
+        for(auto& result : results) {
+            result.get();
+        }
+    }
+    
+    // Packs items of the bin into bins of candidate sizes. Bins which don't fit all items are left without packer
+    vector<ActiveBin> packCandidates(ActiveBin const& bin, vector<size> const& candidates) {
+        vector<ActiveBin> bins(candidates.size());
+        runTasks(candidates.size(), [this, &bin, &candidates, &bins](size_t i) {
+            // each candidate has its own packer
+            auto& tempBin = bins[i];
+            tempBin.itemExtraPixels = bin.itemExtraPixels;
+            tempBin.blockAlign = bin.blockAlign;
+            tempBin.createBin = bin.createBin;
+            tempBin.packer = bin.createBin(candidates[i].width, candidates[i].height);
+            tempBin.items.reserve(bin.items.size());
+            tempBin.placements.reserve(bin.items.size());
+            
+            // try to repack all items in the bin
+            if(tempBin.insertItems(store, bin.items.begin(), bin.items.end()) != bin.items.size())
+                tempBin = ActiveBin();
+        });
+        
+        return bins;
+    }
+    
+    /**
+     Searches for the smallest edge in the (lo, hi) range the bin items fit into.
+     The bin has to fit the hi edge already. Each step tries the next levels of the bisection tree at once
+     on worker threads and follows the path the bisection takes through them, so the edges and the result
+     are the ones of the plain bisection whatever the number of workers is.
+     */
+    void searchEdge(ActiveBin& bin, int lo, int hi, function<size(int)> const& binSizeOf) {
+        // 2^levels - 1 midpoints are tried per step
+        const size_t workers = pool ? pool->size() : 1;
+        size_t levels = 1;
+        while(((size_t)2 << levels) - 1 <= workers)
+            ++levels;
+        const size_t nodesCount = ((size_t)1 << levels) - 1;
+        
+        while(hi - lo > 1) {
+            // midpoints of the tree nodes, the node i is followed by 2i+1 if its edge fits and by 2i+2 if not
+            vector<pair<int, int>> ranges(nodesCount, make_pair(0, 0));
+            vector<int> nodeCandidates(nodesCount, -1);
+            vector<int> edges;
+            vector<size> candidates;
+            ranges[0] = make_pair(lo, hi);
+            for(size_t node = 0; node < nodesCount; ++node) {
+                const int nodeLo = ranges[node].first;
+                const int nodeHi = ranges[node].second;
+                if(nodeHi - nodeLo <= 1)
+                    continue;
+                
+                const int edge = nodeLo + (nodeHi - nodeLo) / 2;
+                nodeCandidates[node] = (int)candidates.size();
+                edges.push_back(edge);
+                candidates.push_back(binSizeOf(edge));
+                if(node * 2 + 2 < nodesCount) {
+                    ranges[node * 2 + 1] = make_pair(nodeLo, edge);
+                    ranges[node * 2 + 2] = make_pair(edge, nodeHi);
+                }
+            }
+            
+            auto bins = packCandidates(bin, candidates);
+            
+            // a fitting edge becomes the upper bound and a failed one becomes the lower bound
+            size_t node = 0;
+            while(node < nodesCount && nodeCandidates[node] >= 0) {
+                const int candidate = nodeCandidates[node];
+                if(bins[candidate].packer) {
+                    hi = edges[candidate];
+                    bin = move(bins[candidate]);
+                    node = node * 2 + 1;
+                } else {
+                    lo = edges[candidate];
+                    node = node * 2 + 2;
+                }
+            }
+        }
+    }
+
+    // Returns true if the sizing algorithm shrinks filled bins
+    bool isCompacting() const {
+        return sizing_algo == atlas_sizing::best_size ||
+        sizing_algo == atlas_sizing::best_rect_size ||
+        sizing_algo == atlas_sizing::rect_pow2_size;
+    }
+    
+    // Checks whether the size fits the max aspect ratio
+    bool isAspectAllowed(size const& sz) const {
+        return max_aspect <= 0 ||
+        (std::max)(sz.width, sz.height) <= (std::min)(sz.width, sz.height) * (double)max_aspect;
+    }
+    
+    // Returns the shortest edge the max aspect ratio allows next to the edge
+    int minEdgeByAspect(int edge) const {
+        return max_aspect > 0 ? (int)ceil(edge / (double)max_aspect) : 1;
+    }
+    
+    // Returns the longest edge the max aspect ratio allows next to the edge
+    int maxEdgeByAspect(int edge, int limit) const {
+        return max_aspect > 0 ? (int)(std::min)((double)limit, floor(edge * (double)max_aspect)) : limit;
+    }
+    
+    // Shrinks the bin to the smallest square one
+    void compactToSquare(ActiveBin& bin) {
         // calculates bin's minimal, maximal and best edges
         const int minEdgeLen = bin.minEdgeLen;
-        int maxEdgeLen = (std::max)(bin.binSize().width, bin.binSize().height);
+        const int maxEdgeLen = (std::max)(bin.binSize().width, bin.binSize().height);
         int bestEdgeLen = (int)floor(sqrt(bin.itemsSquare));
         bestEdgeLen = bestEdgeLen > minEdgeLen ? bestEdgeLen : minEdgeLen;
         
-        // we will try to find the suitable edge by modifying the floatingEdge
-        int floatingEdge = bestEdgeLen;
+        // find the smallest square bin
+        searchEdge(bin, bestEdgeLen - 1, maxEdgeLen, [](int edge) {
+            return size(edge, edge);
+        });
+    }
+    
+    // Shrinks height and then width of the bin within the max aspect ratio
+    void shrinkEdges(ActiveBin& bin) {
+        if(bin.itemsSquare <= 0)
+            return;
         
-        bool lastRepackSuccess = true;
-        while((maxEdgeLen - floatingEdge)/2 > 0) {
-            // create the better-sized bin
-            auto tempBin = ActiveBin();
-            tempBin.itemExtraPixels = bin.itemExtraPixels;
-            tempBin.packer = this->create_bin(floatingEdge, floatingEdge);
+        const int width = bin.binSize().width;
+        const int minHeight = (std::max)((bin.itemsSquare - 1) / width, minEdgeByAspect(width) - 1);
+        searchEdge(bin, minHeight, bin.binSize().height, [width](int edge) {
+            return size(width, edge);
+        });
+        
+        const int height = bin.binSize().height;
+        const int minWidth = (std::max)((bin.itemsSquare - 1) / height, minEdgeByAspect(height) - 1);
+        searchEdge(bin, minWidth, bin.binSize().width, [height](int edge) {
+            return size(edge, height);
+        });
+    }
+    
+    /**
+     Searches width and height of the bin independently for the smallest area.
+     The smallest square bin bounds the area, then the smallest height is searched for several widths
+     over the allowed range. Only heights giving a smaller area than the best one are tried.
+     */
+    void compactToRect(ActiveBin& bin) {
+        compactToSquare(bin);
+        if(bin.itemsSquare <= 0)
+            return;
+        
+        const size maxSize = maxBinSize();
+        const int minWidth = (std::max)({1, minEdgeByAspect(maxSize.height), bin.itemsSquare / maxSize.height});
+        const int widthSteps = 8;
+        
+        // try the tallest allowed bins of each width at once
+        long long bestArea = areaOf(bin.binSize());
+        vector<size> candidates;
+        for(int step = 0; step <= widthSteps; ++step) {
+            int width = minWidth + (int)((long long)(maxSize.width - minWidth) * step / widthSteps);
+            if(!candidates.empty() && candidates.back().width == width)
+                continue;
             
-            // try to repack all items in the bin
-            for(auto index : bin.itemIndexes) {
-                lastRepackSuccess = tempBin.tryInsertItem(index);
-                if(!lastRepackSuccess)
-                    break;
-            }
+            int height = maxEdgeByAspect(width, maxSize.height);
+            height = (int)(std::min)((long long)height, (bestArea - 1) / width);
+            if(height > 0 && isAspectAllowed(size(width, height)))
+                candidates.push_back(size(width, height));
+        }
+        
+        auto bins = packCandidates(bin, candidates);
+        for(size_t i = 0; i < bins.size(); ++i) {
+            auto& candidate = bins[i];
+            if(!candidate.packer)
+                continue;
             
-            if(!lastRepackSuccess) {
-                // in case of fail try to modify the edge until it meets the requirements
-                floatingEdge += (maxEdgeLen - floatingEdge) / 2;
+            // the area can't get better than the best one
+            const int width = candidates[i].width;
+            const int minHeight = (std::max)((candidate.itemsSquare - 1) / width, minEdgeByAspect(width) - 1);
+            if((long long)width * (minHeight + 1) >= bestArea)
                 continue;
+            
+            searchEdge(candidate, minHeight, candidates[i].height, [width](int edge) {
+                return size(width, edge);
+            });
+            
+            if(areaOf(candidate.binSize()) < bestArea) {
+                bestArea = areaOf(candidate.binSize());
+                bin = move(candidate);
             }
-
-            // replace the bin with the better one
-            // and try to find the better edge on next step
-            bin = move(tempBin);
-            maxEdgeLen = floatingEdge;
-            floatingEdge = bestEdgeLen;
         }
         
-        // We need to update all items of the bin,
-        // as a previous repack operation ruined its coordinates
-        if(!lastRepackSuccess && !bin.rebuildBin()) {
-            CLOG(ERROR, MODULE_LOGGER) << "Error compacting the bin";
+        // the best height may leave spare width
+        const int height = bin.binSize().height;
+        const int minBinWidth = (std::max)((bin.itemsSquare - 1) / height, minEdgeByAspect(height) - 1);
+        searchEdge(bin, minBinWidth, bin.binSize().width, [height](int edge) {
+            return size(edge, height);
+        });
+    }
+    
+    /**
+     Shrinks the bin to the power of two rect of the smallest area.
+     Candidate sizes are tried in the order of their area, the squarer ones go first.
+     */
+    void compactToPow2Rect(ActiveBin& bin) {
+        const size binSize = bin.binSize();
+        vector<size> sizes;
+        for(int width = 1; width <= binSize.width; width *= 2) {
+            for(int height = 1; height <= binSize.height; height *= 2) {
+                size sz(width, height);
+                if(areaOf(sz) < areaOf(binSize) && areaOf(sz) >= bin.itemsSquare && isAspectAllowed(sz))
+                    sizes.push_back(sz);
+            }
+        }
+        
+        sort(sizes.begin(), sizes.end(), [](size const& a, size const& b) {
+            return make_tuple(areaOf(a), abs(a.width - a.height), a.width) <
+            make_tuple(areaOf(b), abs(b.width - b.height), b.width);
+        });
+        
+        // several sizes are tried at once, the first fitting one has the smallest area
+        const size_t probes = pool ? (std::max)(pool->size(), 1u) : 1;
+        for(size_t first = 0; first < sizes.size(); first += probes) {
+            vector<size> candidates(sizes.begin() + first, sizes.begin() + (std::min)(first + probes, sizes.size()));
+            auto bins = packCandidates(bin, candidates);
+            for(auto& candidate : bins) {
+                if(candidate.packer) {
+                    bin = move(candidate);
+                    return;
+                }
+            }
+        }
+    }
+    
+    // Tries to compact the bin according to the sizing algorithm
+    void compactBin(ActiveBin& bin) {
+        switch (sizing_algo) {
+            case atlas_sizing::best_size:
+                compactToSquare(bin);
+                if(non_square)
+                    shrinkEdges(bin);
+                break;
+            case atlas_sizing::best_rect_size:
+                compactToRect(bin);
+                break;
+            case atlas_sizing::rect_pow2_size:
+                compactToPow2Rect(bin);
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Returns the biggest bin size allowed by the sizing algorithm
+    size maxBinSize() const {
+        size resultSize(atlasTmpl.size.width, atlasTmpl.size.height);
+        if(sizing_algo == atlas_sizing::rect_pow2_size) {
+            resultSize = size(floorPow2(resultSize.width), floorPow2(resultSize.height));
+        }
+        
+        if(sizing_algo == atlas_sizing::best_rect_size || sizing_algo == atlas_sizing::rect_pow2_size) {
+            // cut the long edge to the max aspect ratio
+            while(!isAspectAllowed(resultSize)) {
+                int& longEdge = resultSize.width > resultSize.height ? resultSize.width : resultSize.height;
+                int shortEdge = (std::min)(resultSize.width, resultSize.height);
+                longEdge = sizing_algo == atlas_sizing::rect_pow2_size ? longEdge / 2 : maxEdgeByAspect(shortEdge, longEdge);
+            }
         }
+        
+        return resultSize;
     }
 
     // Calculates active bin size
     size calcBinsSize() {
-        size resultSize(atlasTmpl.size.width, atlasTmpl.size.height);
+        size resultSize = maxBinSize();
         
         switch (sizing_algo) {
             case atlas_sizing::squared_pow2_size:
@@ -222,26 +557,137 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
         return resultSize;
     }
     
+    // Sorts items in the order
+    void sortItems(HandleList& items, item_order order) const {
+        auto const& sizes = store.sizes;
+        switch (order) {
+            case item_order::by_max_edge:
+                stable_sort(items.begin(), items.end(), [&sizes](ItemHandle a, ItemHandle b) {
+                    return (std::max)(sizes[a].width, sizes[a].height) > (std::max)(sizes[b].width, sizes[b].height);
+                });
+                break;
+            case item_order::by_perimeter:
+                stable_sort(items.begin(), items.end(), [&sizes](ItemHandle a, ItemHandle b) {
+                    return sizes[a].width + sizes[a].height > sizes[b].width + sizes[b].height;
+                });
+                break;
+            case item_order::by_width:
+                stable_sort(items.begin(), items.end(), [&sizes](ItemHandle a, ItemHandle b) {
+                    return sizes[a].width > sizes[b].width;
+                });
+                break;
+            case item_order::by_height:
+                stable_sort(items.begin(), items.end(), [&sizes](ItemHandle a, ItemHandle b) {
+                    return sizes[a].height > sizes[b].height;
+                });
+                break;
+            default:
+                stable_sort(items.begin(), items.end(), SortBySquare{store});
+                break;
+        }
+    }
+    
+    /**
+     Fills the new bin with items by a batch insert. Items which don't fit are left for the next atlas.
+     With the deadline items are inserted by smaller batches, so the clock is checked between them.
+     Returns false if the deadline has passed before all items were tried.
+     */
+    bool fillBin(ActiveBin& bin, bin_factory const& createBin, size const& binSize, HandleList const& items,
+                 chrono::steady_clock::time_point const* deadline = nullptr) {
+        bin = ActiveBin();
+        bin.itemExtraPixels = itemExtraPixels();
+        bin.blockAlign = blockAlign();
+        bin.createBin = createBin;
+        bin.packer = createBin(binSize.width, binSize.height);
+        bin.items.reserve(items.size());
+        bin.placements.reserve(items.size());
+        
+        if(!deadline) {
+            bin.insertItems(store, items.begin(), items.end());
+            return true;
+        }
+        
+        const size_t batchSize = 64;
+        for(auto first = items.begin(); first != items.end(); ) {
+            if(chrono::steady_clock::now() > *deadline)
+                return false;
+            
+            auto last = first + (std::min)(batchSize, (size_t)distance(first, items.end()));
+            bin.insertItems(store, first, last);
+            first = last;
+        }
+        
+        return true;
+    }
+    
+    /**
+     Fills the active bin with each strategy of the portfolio on worker threads.
+     The strategies placing the biggest square of items are compacted and the densest bin is kept.
+     Strategies which don't finish within the time budget are dropped, except the first one.
+     */
+    void fillBinByPortfolio(size const& binSize) {
+        using clock = chrono::steady_clock;
+        const bool isLimited = portfolio_budget > 0;
+        const auto deadline = clock::now() + chrono::milliseconds(portfolio_budget);
+        
+        vector<ActiveBin> bins(portfolio.size());
+        vector<char> completed(portfolio.size(), false);
+        runTasks(portfolio.size(), [&](size_t i) {
+            const bool isMandatory = i == 0 || !isLimited;
+            if(!isMandatory && clock::now() > deadline)
+                return;
+            
+            auto const& strategy = portfolio[i];
+            HandleList items = atlasTmpl.items;
+            sortItems(items, strategy.order);
+            completed[i] = fillBin(bins[i], strategy.create_bin, binSize, items, isMandatory ? nullptr : &deadline);
+        });
+        
+        // Only strategies placing the most items are worth compacting
+        int bestSquare = 0;
+        for(size_t i = 0; i < bins.size(); ++i) {
+            if(completed[i])
+                bestSquare = (std::max)(bestSquare, bins[i].itemsSquare);
+        }
+        
+        size_t best = bins.size();
+        for(size_t i = 0; i < bins.size(); ++i) {
+            if(!completed[i] || bins[i].itemsSquare < bestSquare)
+                continue;
+            
+            if(best != bins.size() && isLimited && clock::now() > deadline)
+                break;
+            
+            // compacting uses worker threads itself, so candidates are compacted one by one
+            if(isCompacting())
+                compactBin(bins[i]);
+            
+            if(best == bins.size() || bins[i].occupancy() > bins[best].occupancy())
+                best = i;
+        }
+        
+        CLOG(INFO, MODULE_LOGGER) << "Portfolio strategy " << portfolio[best].name;
+        activeBin = move(bins[best]);
+    }
+    
     // Builds an atlas
     void buildAtlas(bool finalize = false) {
         // Create the new active bin
-        activeBin = ActiveBin();
-        activeBin.itemExtraPixels = itemExtraPixels();
         size binSize = calcBinsSize();
-        activeBin.packer = this->create_bin(binSize.width, binSize.height);
-        
-        // Fill the bin with items. Try to insert the biggest items first.
-        // We have to insert all items from the biggest to the smallest one
-        // in order to be sure the bin is filled optimally
         auto& atlasItems = atlasTmpl.items;
-        for(auto it = atlasItems.begin(); it != atlasItems.end(); ++it) {
-            activeBin.tryInsertItem(it);
-        }
-        
-        if(sizing_algo == atlas_sizing::best_size) {
-            // In case of best_size sizing algorithm we need to compact the bin as much as possible
-            CLOG(INFO, MODULE_LOGGER) << "Original occupancy = " << activeBin.packer->occupancy();
-            compactBin(activeBin);
+        if(!portfolio.empty()) {
+            fillBinByPortfolio(binSize);
+        } else {
+            // Fill the bin with items. Try to insert the biggest items first.
+            // We have to insert all items from the biggest to the smallest one
+            // in order to be sure the bin is filled optimally
+            fillBin(activeBin, create_bin, binSize, atlasItems);
+            
+            if(isCompacting()) {
+                // In case of best size sizing algorithms we need to compact the bin as much as possible
+                CLOG(INFO, MODULE_LOGGER) << "Original occupancy = " << activeBin.packer->occupancy();
+                compactBin(activeBin);
+            }
         }
         
         // Store updated atlas occupancy
@@ -251,28 +697,49 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
         // Then we transfer content of the bin to an atlas
         atlas_props atlas = atlasTmpl;
         atlas.size = activeBin.binSize();
+        atlas.block_align = blockAlign();
         mainChain->begin_atlas(atlas);
-        for(auto const& itemIndex : activeBin.itemIndexes) {
-            auto const& atlasItem = *itemIndex;
+        vector<bool> placed(store.count(), false);
+        for(size_t i = 0; i < activeBin.items.size(); ++i) {
+            auto handle = activeBin.items[i];
+            auto const& placement = activeBin.placements[i];
+            
+            atlas_item atlasItem;
+            atlasItem.size = store.sizes[handle];
+            atlasItem.fmt = store.formats[handle];
+            atlasItem.pixels = store.pixels[handle];
+            atlasItem.image_path = store.path(handle);
+            atlasItem.source_size = store.sourceSizes[handle];
+            atlasItem.trim_offset = store.trimOffsets[handle];
+            atlasItem.aliases = move(store.aliases[handle]);
+            atlasItem.box = placement.box;
+            atlasItem.rotated = placement.rotated;
             mainChain->add_atlas_item(atlasItem);
             
             // Update atlas' data
-            atlasTmpl.itemsSquare -= atlasItem.square;
+            atlasTmpl.itemsSquare -= store.squares[handle];
             assert(atlasTmpl.itemsSquare >= 0);
-            atlasItems.erase(itemIndex);
+            placed[handle] = true;
+            store.release(handle);
         }
+        
+        // Keep the rest items in their order
+        atlasItems.erase(remove_if(atlasItems.begin(), atlasItems.end(), [&placed](ItemHandle handle) {
+            return placed[handle];
+        }), atlasItems.end());
         mainChain->end_atlas(atlasItems.empty() && finalize);
     }
     
     // Builds atlases for collected items
     bool buildAtlases(bool finalize = false) {
         // First of all we need to sort all items according to atlas sizing algorithm
+        auto& atlasItems = atlasTmpl.items;
         switch (sizing_algo) {
             case atlas_sizing::squared_pow2_size:
-                atlasTmpl.items.sort(&sortBySqpow2);
+                stable_sort(atlasItems.begin(), atlasItems.end(), SortBySqpow2{store});
                 break;
             default:
-                atlasTmpl.items.sort(&sortBySquare);
+                stable_sort(atlasItems.begin(), atlasItems.end(), SortBySquare{store});
                 break;
         }
 
@@ -289,6 +756,7 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
         AtlasTemplate tmpl;
         (atlas_props&)tmpl = atlas;
         atlasTmpl = move(tmpl);
+        store.clear();
         
         // reset active bin
         activeBin = ActiveBin();
@@ -296,18 +764,14 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
     
     // Store the item
     void addAtlasItem(atlas_item const& item) {
-        WeightedItem weighted;
-        (atlas_item&)weighted = item;
-
         // calculate item's square weights
         size itemSize = getItemExtraSize(item);
-        weighted.square = itemSize.height * itemSize.width;
-        weighted.sqpow2Exp = calcBestSqpow2ExpOf(itemSize);
+        auto handle = store.add(item, itemSize, calcBestSqpow2ExpOf(itemSize));
 
         // update atlas' square
-        atlasTmpl.itemsSquare += weighted.square;
+        atlasTmpl.itemsSquare += store.squares[handle];
         
-        atlasTmpl.items.push_back(move(weighted));
+        atlasTmpl.items.push_back(handle);
     }
 };
 
@@ -315,6 +779,10 @@ struct atlas_mapper_node::Pimpl: atlas_mapper_props {
 atlas_mapper_node::atlas_mapper_node(atlas_mapper_props const& props): _pimpl(new Pimpl) {
     (atlas_mapper_props&)(*_pimpl) = props;
     
+    // the long edge can't be shorter than the short one
+    if(_pimpl->max_aspect > 0 && _pimpl->max_aspect < 1)
+        _pimpl->max_aspect = 1;
+    
     auto& safeForwarder = this->safe_fwd();
     _pimpl->mainChain = &safeForwarder;
 }
@@ -329,12 +797,12 @@ bool atlas_mapper_node::begin_atlas(atlas_props const& atlas) {
 }
 
 bool atlas_mapper_node::add_atlas_item(atlas_item const& item) {
-    auto const& atlas = _pimpl->atlasTmpl;
-    int padding = _pimpl->itemExtraPixels();
+    const size maxSize = _pimpl->maxBinSize();
+    const size cellSize = _pimpl->getItemExtraSize(item);
     
     // Check item size
-    if(atlas.size.width < item.size.width + padding ||
-       atlas.size.height < item.size.height + padding) {
+    if(maxSize.width < cellSize.width ||
+       maxSize.height < cellSize.height) {
         CLOG(ERROR, MODULE_LOGGER) << "The sprite size is too big to fit";
         return false;
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "chain_node.hpp"
+#include <vector>
 
 /// Atlas mapper properties
 struct atlas_mapper_props {
@@ -11,11 +12,35 @@ struct atlas_mapper_props {
         constant_size = 0,  ///< Prefer strict size
         best_size,          ///< Choose the best size
         squared_pow2_size,  ///< Choose the best suqared power of two size
+        best_rect_size,     ///< Choose the best size searching width and height independently
+        rect_pow2_size,     ///< Choose the best power of two size with independent width and height
+    };
+    
+    /// Order of inserting items into a bin
+    enum item_order {
+        by_square = 0,      ///< The biggest square first
+        by_max_edge,        ///< The longest edge first
+        by_perimeter,       ///< The biggest perimeter first
+        by_width,           ///< The widest first
+        by_height,          ///< The highest first
+    };
+    
+    /// Packing strategy of the portfolio
+    struct packing_strategy {
+        std::string name;                   ///< Name of the strategy
+        bin_factory create_bin;             ///< Bin factory
+        item_order order = by_square;       ///< Order of inserting items
     };
 
     atlas_sizing sizing_algo = atlas_sizing::best_size; ///< Atlas size algorithm
     bin_factory create_bin;                             ///< Bin factory
     float sqpow2_factor = 0.0f;
+    bool non_square = false;                            ///< Allows the best_size algorithm to shrink atlases to rects
+    float max_aspect = 0.0f;                            ///< Max ratio of the long atlas edge to the short one (0 - unlimited)
+    thread_pool_ptr pool;                               ///< Worker threads to try bin sizes on
+    std::vector<packing_strategy> portfolio;            ///< Strategies tried for each atlas
+    unsigned portfolio_budget = 0;                      ///< Time budget of the portfolio per atlas in ms (0 - unlimited)
+    int block_align = 1;                                ///< Size of blocks cells of items are aligned to
 };
 
 
@@ -29,6 +54,24 @@ public:
         props& set_algo(atlas_sizing arg) {sizing_algo = arg; return *this;}
         /// Set bin factory
         props& set_bin_factory(bin_factory arg) {create_bin=std::move(arg); return *this;}
+        /// Allows non-square atlases
+        props& allow_non_square(bool arg=true) {non_square=arg; return *this;}
+        /// Sets max aspect ratio of non-square atlases. Zero means unlimited, values below one keep atlases square
+        props& set_max_aspect_ratio(float arg) {max_aspect=arg; return *this;}
+        /// Sets worker threads to try bin sizes on. Sizes are tried on the calling thread by default
+        props& set_thread_pool(thread_pool_ptr arg) {pool=std::move(arg); return *this;}
+        /**
+         Sets strategies to pack each atlas with. The atlas is packed with all of them
+         and the densest result is kept. The bin factory is used if the portfolio is empty.
+         */
+        props& set_portfolio(std::vector<packing_strategy> arg) {portfolio=std::move(arg); return *this;}
+        /// Sets time budget of the portfolio per atlas. The first strategy is always tried
+        props& set_portfolio_budget(unsigned arg) {portfolio_budget=arg; return *this;}
+        /**
+         Aligns cells of items (images with their paddings) to blocks of the size,
+         so blocks of compressed textures never mix pixels of different sprites
+         */
+        props& set_block_align(int arg) {block_align=arg; return *this;}
     };
     
     explicit atlas_mapper_node(atlas_mapper_props const& props);
@@ -16,6 +16,10 @@ namespace {
         return name.empty() || name == "/" || name == "\\" ? defaultAtlasName : name;
     }
     
+    string compose_atlas_name(string const& name, int counter) {
+        return counter ? name + to_string(counter) : name;
+    }
+    
 }
 
 struct atlas_naming_node::Pimpl: atlas_naming_props {
@@ -32,10 +36,14 @@ struct atlas_naming_node::Pimpl: atlas_naming_props {
         last_name = name;
         auto pos = used_names.find(name);
         if(pos == used_names.end()) {
-            used_names.insert(make_pair(name, 0));
-            return;
+            pos = used_names.insert(make_pair(name, 0)).first;
+        } else {
+            ++(pos->second);
         }
-        ++(pos->second);
+        
+        // skip names taken by other atlases
+        while(reserved_names.count(compose_atlas_name(name, pos->second)))
+            ++(pos->second);
     }
 
     string get_atlas_name() const {
@@ -48,10 +56,7 @@ struct atlas_naming_node::Pimpl: atlas_naming_props {
             counter = pos->second;
         }
 
-        if(counter)
-            filename += to_string(counter);
-        
-        return filename;
+        return compose_atlas_name(filename, counter);
     }
     
     void reset() {
@@ -95,6 +100,10 @@ string atlas_naming_node::get_atlas_name() const {
     return _pimpl->get_atlas_name();
 }
 
+string atlas_naming_node::get_item_atlas_name(atlas_item const& item) const {
+    return _pimpl->naming_after_dir ? extract_atlas_name(item) : defaultAtlasName;
+}
+
 bool atlas_naming_node::begin_atlas(atlas_props const& info) {
     // just save current atlas properties
     _pimpl->current_atlas = info;
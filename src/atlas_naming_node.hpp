@@ -1,10 +1,12 @@
 #pragma once
 
 #include "chain_node.hpp"
+#include <set>
 
 /// Atlas naming settings
 struct atlas_naming_props {
-    bool naming_after_dir = false;  ///< Names atlas after its parent directory name
+    bool naming_after_dir = false;          ///< Names atlas after its parent directory name
+    std::set<std::string> reserved_names;   ///< Names which can't be given to atlases
 };
 
 /// The node is responsible for generating atlas file names.
@@ -16,6 +18,8 @@ public:
         
         /// Names atlas after its parent directory name
         props& enable_naming_after_dir(bool arg=true) {naming_after_dir=arg; return *this;}
+        /// Sets names which are already taken by other atlases
+        props& set_reserved_names(std::set<std::string> arg) {reserved_names=std::move(arg); return *this;}
     };
     
     atlas_naming_node(atlas_naming_props const& props);
@@ -29,6 +33,9 @@ public:
     /// Returns generated name for the current atlas
     std::string get_atlas_name() const;
     
+    /// Returns the base name of atlases the item belongs to
+    std::string get_item_atlas_name(atlas_item const& item) const;
+    
 private:
     struct Pimpl;
     std::unique_ptr<Pimpl> _pimpl;
@@ -0,0 +1,112 @@
+#include "atlas_regions.hpp"
+#include "atlas_builder.hpp"
+#include "thread_pool.hpp"
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "atlas_regions"
+
+using namespace ::std;
+
+namespace {
+    // Passes the region with its image to the writer
+    bool addRegion(atlas_region& region, bool isImageRead, atlas_builder& writer) {
+        if(!isImageRead) {
+            CLOG(ERROR, MODULE_LOGGER)\
+            << "Error reading the image "\
+            << region.item.image_path
+            << " of the sprite "
+            << region.sprite_name;
+            return false;
+        }
+        
+        if(!writer.add_atlas_item(region.item)) {
+            CLOG(ERROR, MODULE_LOGGER)\
+            << "Error processing the image "\
+            << region.item.image_path
+            << " of the sprite "
+            << region.sprite_name;
+            return false;
+        }
+        
+        // The image is already drawn, so we don't need to keep it
+        region.item.pixels.reset();
+        return true;
+    }
+} // anonymous
+
+bool fold_aliases(vector<atlas_region>& regions) {
+    map<string, size_t> originals;
+    for(size_t i = 0; i < regions.size(); ++i) {
+        if(regions[i].alias_of.empty())
+            originals[regions[i].sprite_name] = i;
+    }
+    
+    for(auto const& region : regions) {
+        if(region.alias_of.empty())
+            continue;
+        
+        auto pos = originals.find(region.alias_of);
+        if(pos == originals.end()) {
+            CLOG(ERROR, MODULE_LOGGER) << "Unknown sprite " << region.alias_of << " of the alias " << region.sprite_name;
+            return false;
+        }
+        
+        atlas_alias alias;
+        alias.image_path = region.item.image_path;
+        alias.source_size = region.item.source_size;
+        alias.trim_offset = region.item.trim_offset;
+        regions[pos->second].item.aliases.push_back(move(alias));
+    }
+    
+    regions.erase(remove_if(regions.begin(), regions.end(), [](atlas_region const& region) {
+        return !region.alias_of.empty();
+    }), regions.end());
+    return true;
+}
+
+
+bool build_regions(vector<atlas_region>& regions, atlas_builder& writer, json_parser_props const& props) {
+    if(props.sort_regions) {
+        stable_sort(regions.begin(), regions.end(), [](atlas_region const& a, atlas_region const& b) {
+            return a.item.box.y < b.item.box.y;
+        });
+    }
+    
+    if(!props.pool) {
+        for(auto& region : regions) {
+            if(!addRegion(region, props.read_image(region.item), writer))
+                return false;
+        }
+        return true;
+    }
+    
+    const size_t prefetch = props.prefetch ? props.prefetch : props.pool->size() * 2;
+    auto const& readImage = props.read_image;
+    
+    deque<future<bool>> pending;
+    size_t nextToRead = 0;
+    bool hasError = false;
+    for(size_t i = 0; i < regions.size() && !hasError; ++i) {
+        // Keep the prefetch window full
+        for(; nextToRead < regions.size() && nextToRead <= i + prefetch; ++nextToRead) {
+            auto& item = regions[nextToRead].item;
+            pending.push_back(props.pool->submit([&item, &readImage]() {
+                return readImage(item);
+            }));
+        }
+        
+        bool isImageRead = pending.front().get();
+        pending.pop_front();
+        hasError = !addRegion(regions[i], isImageRead, writer);
+    }
+    
+    // Don't leave unfinished reads behind
+    for(auto const& rest : pending) {
+        rest.wait();
+    }
+    
+    return !hasError;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "forwards.hpp"
+#include "helpers.hpp"
+#include "json_atlas_parser.hpp"
+#include <vector>
+
+/// Atlas region waiting for its image. Regions are shared by parsers of all the mapping formats
+struct atlas_region {
+    std::string sprite_name;    ///< Name of the region's sprite
+    std::string alias_of;       ///< Name of the sprite whose image the region shares
+    atlas_item item;            ///< Atlas item to read the image into
+};
+
+/**
+ @brief Moves regions of aliases to the items they share images with, so each image is read once.
+ Fails if an alias refers to an unknown sprite.
+ */
+bool fold_aliases(std::vector<atlas_region>& regions);
+
+/**
+ @brief Reads images of the regions and passes them to the writer in the order of regions
+ or sorted by their tops if the props require it.
+ In case of the thread pool images are read ahead of the writer within the prefetch window,
+ so decoding of the next images overlaps with drawing of the current one.
+ */
+bool build_regions(std::vector<atlas_region>& regions, atlas_builder& writer, json_parser_props const& props);
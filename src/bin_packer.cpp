@@ -0,0 +1,20 @@
+#include "bin_packer.hpp"
+#include "helpers.hpp"
+
+size_t bin_packer::insert_batch(std::vector<batch_item>& items) {
+    size_t placedCount = 0;
+    
+    atlas_item placed;
+    for(auto& item : items) {
+        item.placed = insert_square(item.width, item.height, placed);
+        if(!item.placed)
+            continue;
+        
+        item.x = placed.box.x;
+        item.y = placed.box.y;
+        item.rotated = placed.rotated;
+        ++placedCount;
+    }
+    
+    return placedCount;
+}
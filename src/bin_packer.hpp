@@ -2,6 +2,7 @@
 
 #include "forwards.hpp"
 #include <array>
+#include <vector>
 
 /**
  @brief Generic interface of a bin packer.
@@ -9,6 +10,14 @@
  */
 class bin_packer {
 public:
+    /// Item of the batch insert
+    struct batch_item {
+        int width = 0, height = 0;      ///< Size of the item
+        int x = 0, y = 0;               ///< Position of the placed item
+        bool rotated = false;           ///< Is the placed item rotated
+        bool placed = false;            ///< Was the item placed into the bin
+    };
+    
     virtual ~bin_packer() { ;; }
     
     /// Returns current occupancy of the bin. The value is in [0,1] range.
@@ -23,6 +32,14 @@ public:
      */
     virtual bool insert_square(int width, int height, atlas_item& item) = 0;
     
+    /**
+     * @brief Inserts the bunch of items into the bin and updates the placed ones.
+     * A packer may choose its own order of inserting, items which don't fit are left unplaced.
+     * By default items are inserted one by one in their order.
+     * @return The number of placed items.
+     */
+    virtual size_t insert_batch(std::vector<batch_item>& items);
+    
     /// Erases all preverved squares of the bin
     virtual void clean_bin() = 0;
 
@@ -0,0 +1,110 @@
+#include "binary_atlas_format.hpp"
+#include <cstring>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "binary_atlas"
+
+using namespace ::std;
+
+namespace {
+    // Pointer casts of the records are valid on little-endian hosts only
+    bool isLittleEndianHost() {
+        const uint32_t probe = 1;
+        unsigned char firstByte;
+        memcpy(&firstByte, &probe, 1);
+        return firstByte == 1;
+    }
+
+    // Checks the [offset, offset + count * itemSize) range is inside the data
+    bool isInside(size_t dataSize, uint32_t offset, uint32_t count, size_t itemSize) {
+        if(offset % 4 || offset > dataSize)
+            return false;
+        return (uint64_t)count * itemSize <= dataSize - offset;
+    }
+}
+
+uint32_t binary_atlas::hash_name(char const* name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool binary_atlas::view::init(void const* data, size_t size) {
+    _header = nullptr;
+
+    if(!isLittleEndianHost()) {
+        CLOG(ERROR, MODULE_LOGGER) << "Binary atlases aren't supported on big-endian hosts";
+        return false;
+    }
+
+    unsigned char const* bytes = (unsigned char const*)data;
+    if(!bytes || (uintptr_t)bytes % 4 || size < sizeof(binary_atlas::header)) {
+        CLOG(ERROR, MODULE_LOGGER) << "Invalid binary atlas data";
+        return false;
+    }
+
+    auto const& hdr = *(binary_atlas::header const*)bytes;
+    if(memcmp(hdr.magic, binary_atlas::magic, sizeof(hdr.magic)) != 0) {
+        CLOG(ERROR, MODULE_LOGGER) << "Not a binary atlas";
+        return false;
+    }
+    if(hdr.version != binary_atlas::version) {
+        CLOG(ERROR, MODULE_LOGGER) << "Unsupported binary atlas version " << hdr.version;
+        return false;
+    }
+
+    bool isValid = isInside(size, hdr.regions_offset, hdr.region_count, sizeof(binary_atlas::region)) &&
+                   isInside(size, hdr.buckets_offset, hdr.bucket_count, sizeof(uint32_t)) &&
+                   (hdr.strings_offset <= size && hdr.strings_size <= size - hdr.strings_offset) &&
+                   hdr.bucket_count > hdr.region_count &&
+                   (hdr.bucket_count & (hdr.bucket_count - 1)) == 0 &&
+                   hdr.strings_size > 0 && bytes[hdr.strings_offset + hdr.strings_size - 1] == 0 &&
+                   hdr.pixel_format < hdr.strings_size;
+    if(!isValid) {
+        CLOG(ERROR, MODULE_LOGGER) << "Malformed binary atlas layout";
+        return false;
+    }
+
+    auto regions = (binary_atlas::region const*)(bytes + hdr.regions_offset);
+    auto buckets = (uint32_t const*)(bytes + hdr.buckets_offset);
+    for(uint32_t i = 0; i < hdr.region_count; ++i) {
+        auto const& region = regions[i];
+        if(region.name >= hdr.strings_size || region.image_path >= hdr.strings_size ||
+           (region.alias_of != binary_atlas::no_region && region.alias_of >= hdr.region_count)) {
+            CLOG(ERROR, MODULE_LOGGER) << "Malformed binary atlas region " << i;
+            return false;
+        }
+    }
+    for(uint32_t i = 0; i < hdr.bucket_count; ++i) {
+        if(buckets[i] != binary_atlas::no_region && buckets[i] >= hdr.region_count) {
+            CLOG(ERROR, MODULE_LOGGER) << "Malformed binary atlas index";
+            return false;
+        }
+    }
+
+    _header = &hdr;
+    _regions = regions;
+    _buckets = buckets;
+    _strings = (char const*)(bytes + hdr.strings_offset);
+    return true;
+}
+
+uint32_t binary_atlas::view::find(char const* name) const {
+    const size_t length = strlen(name);
+    const uint32_t hash = hash_name(name, length);
+    const uint32_t mask = _header->bucket_count - 1;
+
+    // Linear probing stops at the first empty bucket, the index always has one
+    for(uint32_t bucket = hash & mask; ; bucket = (bucket + 1) & mask) {
+        uint32_t index = _buckets[bucket];
+        if(index == binary_atlas::no_region)
+            return binary_atlas::no_region;
+
+        auto const& region = _regions[index];
+        if(region.name_hash == hash && strcmp(_strings + region.name, name) == 0)
+            return index;
+    }
+}
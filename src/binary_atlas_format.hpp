@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ @brief Layout of the binary atlas mapping.
+ All the fields are 32 bit little-endian values, so the mapped file is read by pointer casts.
+ The file consists of the header, the array of fixed-size region records, the hash index of sprite names
+ and the table of zero terminated strings. Strings are referred by their offsets in the table.
+ */
+namespace binary_atlas {
+
+    /// File signature
+    static const char magic[4] = {'A', '2', 'D', 'B'};
+
+    /// Current version of the layout
+    static const uint32_t version = 1;
+
+    /// Index value of a missing region
+    static const uint32_t no_region = 0xffffffffu;
+
+    /// Atlas flag: the atlas has premultiplied alpha
+    static const uint32_t atlas_premultiplied = 1u << 0;
+
+    /// Region flag: the region's image is rotated
+    static const uint32_t region_rotated = 1u << 0;
+
+    /// Region flag: the region keeps the source size and the trim offset
+    static const uint32_t region_trimmed = 1u << 1;
+
+    /// File header
+    struct header {
+        char magic[4];              ///< File signature
+        uint32_t version;           ///< Layout version
+        uint32_t flags;             ///< Atlas flags
+        int32_t width, height;      ///< Dimensions of the atlas
+        int32_t padding;            ///< Padding between atlas items
+        uint32_t pixel_format;      ///< Offset of the pixel format name
+        uint32_t region_count;      ///< Number of region records
+        uint32_t regions_offset;    ///< Offset of the first region record from the file start
+        uint32_t bucket_count;      ///< Number of hash index buckets (power of two)
+        uint32_t buckets_offset;    ///< Offset of the hash index from the file start
+        uint32_t strings_offset;    ///< Offset of the string table from the file start
+        uint32_t strings_size;      ///< Size of the string table in bytes
+        int32_t block_align;        ///< Size of blocks cells of regions are aligned to (0 - not aligned)
+        uint32_t reserved[2];       ///< Reserved for future versions, filled with zeros
+    };
+
+    /// Region record
+    struct region {
+        uint32_t name;              ///< Offset of the sprite name
+        uint32_t image_path;        ///< Offset of the relative path to sprite's image
+        uint32_t name_hash;         ///< Hash of the sprite name
+        uint32_t flags;             ///< Region flags
+        int32_t x, y;               ///< Position of the region in the atlas
+        int32_t width, height;      ///< Size of the region in the atlas
+        int32_t source_width;       ///< Width of the image before trimming
+        int32_t source_height;      ///< Height of the image before trimming
+        int32_t trim_x, trim_y;     ///< Offset of the trimmed image in the source one
+        uint32_t alias_of;          ///< Index of the region whose image the sprite shares, or no_region
+    };
+
+    static_assert(sizeof(header) == 64, "Unexpected padding of the binary atlas header");
+    static_assert(sizeof(region) == 52, "Unexpected padding of the binary atlas region");
+
+    /// Hash of the sprite name stored in region records (FNV-1a)
+    uint32_t hash_name(char const* name, size_t length);
+
+    /**
+     @brief Read-only view of the binary atlas in memory.
+     The view doesn't own the data, which must be 4 bytes aligned and outlive the view.
+     The layout is validated once on init, so accessors don't check offsets.
+     */
+    class view {
+    public:
+        view() { ;; }
+
+        /// Validates the data and initializes the view. Returns false on malformed data
+        bool init(void const* data, size_t size);
+
+        /// Returns the header
+        binary_atlas::header const& header() const { return *_header; }
+
+        /// Returns number of regions
+        size_t size() const { return _header->region_count; }
+
+        /// Returns the region by its index
+        binary_atlas::region const& operator[](size_t index) const { return _regions[index]; }
+
+        /// Returns the string by its offset
+        char const* string_at(uint32_t offset) const { return _strings + offset; }
+
+        /// Returns the index of the sprite's region, or no_region if there is no such sprite
+        uint32_t find(char const* name) const;
+
+    private:
+        binary_atlas::header const* _header = nullptr;
+        binary_atlas::region const* _regions = nullptr;
+        uint32_t const* _buckets = nullptr;
+        char const* _strings = nullptr;
+    };
+}
@@ -0,0 +1,87 @@
+#include "binary_atlas_parser.hpp"
+#include "binary_atlas_format.hpp"
+#include "atlas_regions.hpp"
+#include "atlas_builder.hpp"
+#include "mapped_file.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "binary_parser"
+
+using namespace ::std;
+
+const char* const binary_atlas_extension = ".bin";
+
+bool is_binary_atlas_file(std::string const& filename) {
+    const size_t extLength = strlen(binary_atlas_extension);
+    return filename.size() >= extLength &&
+           filename.compare(filename.size() - extLength, extLength, binary_atlas_extension) == 0;
+}
+
+bool parse_binary_atlas(void const* data, size_t size, json_parser_props const& props) {
+    binary_atlas::view atlasView;
+    if(!atlasView.init(data, size))
+        return false;
+    
+    // Parse atlas info
+    auto const& header = atlasView.header();
+    atlas_props atlas;
+    atlas.fmt = atlas2d::pixel_format_details(atlasView.string_at(header.pixel_format)).format;
+    if(atlas.fmt == atlas2d::pixel_format::unknown) {
+        // Unknown pixel format
+        CLOG(ERROR, MODULE_LOGGER) << "Unknown pixel format";
+        return false;
+    }
+    atlas.padding = header.padding;
+    atlas.block_align = (std::max)(1, header.block_align);
+    atlas.size = atlas2d::size(header.width, header.height);
+    atlas.premultipled = (header.flags & binary_atlas::atlas_premultiplied) != 0;
+    
+    auto& writer = *(props.atlas_builder);
+    if(!writer.begin_atlas(atlas))
+        return false;
+    
+    // Parse atlas regions
+    vector<atlas_region> regions(atlasView.size());
+    for(size_t i = 0; i < atlasView.size(); ++i) {
+        auto const& record = atlasView[i];
+        auto& region = regions[i];
+        auto& item = region.item;
+        
+        region.sprite_name = atlasView.string_at(record.name);
+        if(record.alias_of != binary_atlas::no_region)
+            region.alias_of = atlasView.string_at(atlasView[record.alias_of].name);
+        
+        item.image_path = atlasView.string_at(record.image_path);
+        item.box = rect(record.x, record.y, record.width, record.height);
+        item.rotated = (record.flags & binary_atlas::region_rotated) != 0;
+        if(record.flags & binary_atlas::region_trimmed) {
+            item.source_size = atlas2d::size(record.source_width, record.source_height);
+            item.trim_offset = atlas2d::offset(record.trim_x, record.trim_y);
+        }
+    }
+    
+    // Draw regions
+    bool hasError = !fold_aliases(regions) || !build_regions(regions, writer, props);
+    
+    if(hasError) {
+        writer.reset();
+        return false;
+    }
+    
+    return writer.end_atlas(true);
+}
+
+bool parse_binary_atlas(std::string const& filename, json_parser_props const& props) {
+    mapped_file file;
+    if(!file.open(filename)) {
+        CLOG(ERROR, MODULE_LOGGER) << "Error mapping the binary atlas " << filename;
+        return false;
+    }
+    
+    return parse_binary_atlas(file.data(), file.size(), props);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "json_atlas_parser.hpp"
+
+/// Extension of binary mapping files
+extern const char* const binary_atlas_extension;
+
+/// Checks whether the mapping file is a binary one by its extension
+bool is_binary_atlas_file(std::string const& filename);
+
+/**
+ @brief Parses the whole atlas from the binary mapping in memory.
+ The data must be 4 bytes aligned. Sprites are read by image paths kept in the mapping,
+ so no sprites map is needed. The parser properties are the same as the json ones.
+ */
+bool parse_binary_atlas(void const* data, size_t size, json_parser_props const& props);
+
+/**
+ @brief Maps the binary mapping file into memory and parses the atlas.
+ */
+bool parse_binary_atlas(std::string const& filename, json_parser_props const& props);
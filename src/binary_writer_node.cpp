@@ -0,0 +1,216 @@
+#include "binary_writer_node.hpp"
+#include "binary_atlas_format.hpp"
+#include "json_writer_node.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <unordered_set>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "binary_writer"
+
+using namespace ::std;
+
+namespace {
+    std::runtime_error atlas_write_error("Error writing binary atlas");
+
+    // Appends the value in little-endian byte order independently of the host
+    void putU32(vector<unsigned char>& out, uint32_t value) {
+        out.push_back((unsigned char)(value & 0xff));
+        out.push_back((unsigned char)((value >> 8) & 0xff));
+        out.push_back((unsigned char)((value >> 16) & 0xff));
+        out.push_back((unsigned char)((value >> 24) & 0xff));
+    }
+
+    void putI32(vector<unsigned char>& out, int32_t value) {
+        putU32(out, (uint32_t)value);
+    }
+
+    // Returns the least power of two which isn't less than the value
+    uint32_t ceilPow2(uint32_t value) {
+        uint32_t result = 1;
+        while(result < value)
+            result <<= 1;
+        return result;
+    }
+}
+
+struct binary_writer_node::Pimpl: binary_writer_props {
+    atlas_props atlas;                      ///< Properties of the active atlas
+    vector<binary_atlas::region> regions;   ///< Regions of the active atlas
+    string strings;                         ///< String table of the active atlas
+    unordered_set<string> spriteNames;      ///< Sprite names of the active atlas
+
+    void reset() {
+        regions.clear();
+        strings.clear();
+        spriteNames.clear();
+    }
+
+    // Appends the zero terminated string to the table and returns its offset
+    uint32_t addString(string const& value) {
+        uint32_t offset = (uint32_t)strings.size();
+        strings.append(value.c_str(), value.size() + 1);
+        return offset;
+    }
+
+    // Adds the region of the item. Regions of aliases refer to the region they share the image with
+    bool addRegion(atlas_item const& item, string const& imagePath,
+                   atlas2d::size const& sourceSize, atlas2d::offset const& trimOffset,
+                   uint32_t aliasOf) {
+        string spriteName = extract_sprite_name(imagePath);
+        if(!spriteNames.insert(spriteName).second) {
+            // Don't process dublicated items
+            CLOG(ERROR, MODULE_LOGGER)
+                << "Sprite name "
+                << spriteName
+                << " already exists";
+            return false;
+        }
+
+        binary_atlas::region region;
+        region.name = addString(spriteName);
+        region.image_path = addString(imagePath);
+        region.name_hash = binary_atlas::hash_name(spriteName.c_str(), spriteName.size());
+        region.flags = (item.rotated ? binary_atlas::region_rotated : 0) |
+                       (sourceSize.width > 0 ? binary_atlas::region_trimmed : 0);
+        region.x = item.box.x;
+        region.y = item.box.y;
+        region.width = item.box.width;
+        region.height = item.box.height;
+        region.source_width = sourceSize.width;
+        region.source_height = sourceSize.height;
+        region.trim_x = trimOffset.x;
+        region.trim_y = trimOffset.y;
+        region.alias_of = aliasOf;
+        regions.push_back(region);
+        return true;
+    }
+
+    // Builds the open addressing index of sprite names with linear probing
+    vector<uint32_t> buildIndex() const {
+        vector<uint32_t> buckets(ceilPow2((uint32_t)regions.size() * 2), binary_atlas::no_region);
+        const uint32_t mask = (uint32_t)buckets.size() - 1;
+        for(uint32_t i = 0; i < regions.size(); ++i) {
+            uint32_t bucket = regions[i].name_hash & mask;
+            while(buckets[bucket] != binary_atlas::no_region)
+                bucket = (bucket + 1) & mask;
+            buckets[bucket] = i;
+        }
+        return buckets;
+    }
+
+    // Serializes the active atlas to a stream provided by the gen_atlas_stream
+    void writeAtlas() {
+        // The pixel format name goes to the table after the sprite names
+        const uint32_t formatName = addString(atlas2d::pixel_format_details(atlas.fmt).formatName);
+        auto buckets = buildIndex();
+
+        // Keep the file size a multiple of 4 bytes
+        strings.resize((strings.size() + 3) & ~size_t(3), '\0');
+
+        const uint32_t regionsOffset = sizeof(binary_atlas::header);
+        const uint32_t bucketsOffset = regionsOffset + (uint32_t)(regions.size() * sizeof(binary_atlas::region));
+        const uint32_t stringsOffset = bucketsOffset + (uint32_t)(buckets.size() * sizeof(uint32_t));
+
+        vector<unsigned char> out;
+        out.reserve(stringsOffset + strings.size());
+
+        // Fields are written in the order of the records' declaration
+        out.insert(out.end(), binary_atlas::magic, binary_atlas::magic + sizeof(binary_atlas::magic));
+        putU32(out, binary_atlas::version);
+        putU32(out, atlas.premultipled ? binary_atlas::atlas_premultiplied : 0);
+        putI32(out, atlas.size.width);
+        putI32(out, atlas.size.height);
+        putI32(out, atlas.padding);
+        putU32(out, formatName);
+        putU32(out, (uint32_t)regions.size());
+        putU32(out, regionsOffset);
+        putU32(out, (uint32_t)buckets.size());
+        putU32(out, bucketsOffset);
+        putU32(out, stringsOffset);
+        putU32(out, (uint32_t)strings.size());
+        putI32(out, atlas.block_align);
+        for(int i = 0; i < 2; ++i)
+            putU32(out, 0);
+
+        for(auto const& region : regions) {
+            putU32(out, region.name);
+            putU32(out, region.image_path);
+            putU32(out, region.name_hash);
+            putU32(out, region.flags);
+            putI32(out, region.x);
+            putI32(out, region.y);
+            putI32(out, region.width);
+            putI32(out, region.height);
+            putI32(out, region.source_width);
+            putI32(out, region.source_height);
+            putI32(out, region.trim_x);
+            putI32(out, region.trim_y);
+            putU32(out, region.alias_of);
+        }
+
+        for(auto bucket : buckets)
+            putU32(out, bucket);
+
+        out.insert(out.end(), strings.begin(), strings.end());
+
+        auto outs = this->gen_atlas_stream();
+        if(!outs) {
+            CLOG(ERROR, MODULE_LOGGER) << "Invalid binary atlas stream!";
+            throw atlas_write_error;
+        }
+
+        if(!outs->write((char const*)out.data(), out.size())) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing binary atlas";
+            throw atlas_write_error;
+        }
+    }
+};
+
+binary_writer_node::binary_writer_node(binary_writer_props const& props)
+: _pimpl(new Pimpl)
+{
+    ((binary_writer_props&)*_pimpl) = props;
+    _pimpl->reset();
+}
+
+binary_writer_node::~binary_writer_node() {
+    ;;
+}
+
+bool binary_writer_node::begin_atlas(atlas_props const& atlas) {
+    _pimpl->reset();
+    _pimpl->atlas = atlas;
+    return safe_fwd().begin_atlas(atlas);
+}
+
+bool binary_writer_node::add_atlas_item(atlas_item const& item) {
+    const uint32_t itemIndex = (uint32_t)_pimpl->regions.size();
+    if(!_pimpl->addRegion(item, item.image_path, item.source_size, item.trim_offset, binary_atlas::no_region))
+        return false;
+
+    // Aliases share the item's rect, but keep their own names and trims
+    for(auto const& alias : item.aliases) {
+        if(!_pimpl->addRegion(item, alias.image_path, alias.source_size, alias.trim_offset, itemIndex))
+            return false;
+    }
+
+    return safe_fwd().add_atlas_item(item);
+}
+
+bool binary_writer_node::end_atlas(bool finalize) {
+    // Empty atlases aren't written like in the json mapping
+    if(!_pimpl->regions.empty())
+        _pimpl->writeAtlas();
+
+    _pimpl->reset();
+    return safe_fwd().end_atlas(finalize);
+}
+
+void binary_writer_node::reset() {
+    _pimpl->reset();
+    safe_fwd().reset();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "chain_node.hpp"
+#include "helpers.hpp"
+
+/// Binary writer properties
+struct binary_writer_props {
+    using ostream_ptr = std::shared_ptr<std::ostream>;
+    using ostream_generator = std::function<ostream_ptr()>;
+
+    ostream_generator gen_atlas_stream;         ///< Stream factory for storing atlas content
+};
+
+/**
+ @brief The node dumps atlas mapping to the binary format described in binary_atlas_format.hpp.
+ Unlike the json mapping, the binary one keeps image paths of sprites, so it needs no sprites map.
+ */
+class binary_writer_node: public chain_node {
+public:
+    struct init_props: binary_writer_props {
+        using props = init_props;
+
+        /// Sets stream factory for storing atlas content
+        props& set_atlas_stream_generator(ostream_generator arg) {gen_atlas_stream=std::move(arg); return *this;}
+    };
+
+    explicit binary_writer_node(binary_writer_props const& props);
+    virtual ~binary_writer_node();
+
+    bool begin_atlas(atlas_props const& atlas) override;
+    bool add_atlas_item(atlas_item const& item) override;
+    bool end_atlas(bool finalise) override;
+    void reset() override;
+
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
@@ -0,0 +1,364 @@
+#include "etc2_encoder.hpp"
+#include "thread_pool.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <future>
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    // Modifiers of ETC1 tables by pixel indices: a, b, -a, -b
+    const int kColorModifiers[8][4] = {
+        {2, 8, -2, -8}, {5, 17, -5, -17}, {9, 29, -9, -29}, {13, 42, -13, -42},
+        {18, 60, -18, -60}, {24, 80, -24, -80}, {33, 106, -33, -106}, {47, 183, -47, -183},
+    };
+    
+    // Modifiers of EAC tables by pixel indices
+    const int kAlphaModifiers[16][8] = {
+        {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+        {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+        {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+        {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+        {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+        {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+        {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+        {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8},
+    };
+    
+    // The EAC table having the zero modifier encodes flat alpha exactly
+    const int kFlatAlphaTable = 13;
+    const int kFlatAlphaIndex = 4;
+    
+    // Pixels of subblocks by the flip bit and the half. Pixels are numbered by rows, subblocks are walked by columns
+    const int kSubblocks[2][2][8] = {
+        {{0, 4, 8, 12, 1, 5, 9, 13}, {2, 6, 10, 14, 3, 7, 11, 15}},
+        {{0, 4, 1, 5, 2, 6, 3, 7}, {8, 12, 9, 13, 10, 14, 11, 15}},
+    };
+    
+    inline int clamp255(int value) {
+        return value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+    
+    // Expands quantized channels to 8 bits
+    inline int expand4(int c) {
+        return (c << 4) | c;
+    }
+    
+    inline int expand5(int c) {
+        return (c << 3) | (c >> 2);
+    }
+    
+    // Pixels of the block with weights of their color errors
+    struct BlockPixels {
+        int rgb[16][3];     ///< Colors of pixels numbered by rows
+        int alpha[16];      ///< Alpha of pixels
+        int weights[16];    ///< Transparent pixels have lower weights, as their colors are hardly visible
+    };
+    
+    // Encoded half of the color block
+    struct SubblockCode {
+        int table = 0;              ///< Modifier table
+        int indices[8] = {0};       ///< Modifier indices of pixels
+        long long error = LLONG_MAX;///< Weighted squared error
+    };
+    
+    // Returns the weighted average color of the subblock
+    void averageColor(BlockPixels const& block, int const* pixels, int avg[3]) {
+        int sums[3] = {0, 0, 0};
+        int weights = 0;
+        for(int i = 0; i < 8; ++i) {
+            const int p = pixels[i];
+            for(int c = 0; c < 3; ++c)
+                sums[c] += block.rgb[p][c] * block.weights[p];
+            weights += block.weights[p];
+        }
+        for(int c = 0; c < 3; ++c)
+            avg[c] = (sums[c] + weights / 2) / weights;
+    }
+    
+    /**
+     Chooses the modifier table and pixel indices of the subblock with the base color.
+     A modifier moves all channels together, so unless a channel is clamped the squared distance
+     to the pixel is |pixel - base|^2 - 2 * mod * sum(pixel - base) + 3 * mod^2, where only the last
+     two terms depend on the table. Tables which clamp the base color are checked channel by channel.
+     */
+    void encodeSubblock(BlockPixels const& block, int const* pixels, int const base[3], SubblockCode& code) {
+        int distances[8], sums[8];
+        for(int i = 0; i < 8; ++i) {
+            const int p = pixels[i];
+            distances[i] = sums[i] = 0;
+            for(int c = 0; c < 3; ++c) {
+                const int d = block.rgb[p][c] - base[c];
+                distances[i] += d * d;
+                sums[i] += d;
+            }
+        }
+        
+        const int minBase = (std::min)(base[0], (std::min)(base[1], base[2]));
+        const int maxBase = (std::max)(base[0], (std::max)(base[1], base[2]));
+        
+        code.error = LLONG_MAX;
+        for(int table = 0; table < 8; ++table) {
+            auto const* mods = kColorModifiers[table];
+            const bool isClamped = minBase - mods[1] < 0 || maxBase + mods[1] > 255;
+            
+            long long error = 0;
+            int indices[8];
+            for(int i = 0; i < 8 && error < code.error; ++i) {
+                const int p = pixels[i];
+                int best = INT_MAX;
+                for(int m = 0; m < 4; ++m) {
+                    int dist = 0;
+                    if(isClamped) {
+                        for(int c = 0; c < 3; ++c) {
+                            const int d = clamp255(base[c] + mods[m]) - block.rgb[p][c];
+                            dist += d * d;
+                        }
+                    } else {
+                        dist = distances[i] + mods[m] * (3 * mods[m] - 2 * sums[i]);
+                    }
+                    if(dist < best) {
+                        best = dist;
+                        indices[i] = m;
+                    }
+                }
+                error += (long long)best * block.weights[p];
+            }
+            
+            if(error < code.error) {
+                code.error = error;
+                code.table = table;
+                copy(indices, indices + 8, code.indices);
+            }
+        }
+    }
+    
+    // Writes 64 bits in big-endian order
+    void putU64BE(uint64_t bits, unsigned char* out) {
+        for(int i = 0; i < 8; ++i)
+            out[i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    
+    /**
+     Encodes colors of the block in the differential mode if base colors of subblocks are close enough
+     and in the individual mode otherwise. Both orientations of subblocks are tried.
+     Differential codes keep base colors in range, so the block stays ETC1 compatible under ETC2.
+     */
+    void encodeColorBlock(BlockPixels const& block, unsigned char* out) {
+        long long bestError = LLONG_MAX;
+        uint64_t bestBits = 0;
+        for(int flip = 0; flip < 2; ++flip) {
+            int avg[2][3];
+            averageColor(block, kSubblocks[flip][0], avg[0]);
+            averageColor(block, kSubblocks[flip][1], avg[1]);
+            
+            int quantized[2][3], deltas[3];
+            bool isDifferential = true;
+            for(int c = 0; c < 3; ++c) {
+                quantized[0][c] = (avg[0][c] * 31 + 127) / 255;
+                quantized[1][c] = (avg[1][c] * 31 + 127) / 255;
+                deltas[c] = quantized[1][c] - quantized[0][c];
+                isDifferential = isDifferential && deltas[c] >= -4 && deltas[c] <= 3;
+            }
+            
+            int base[2][3];
+            for(int h = 0; h < 2; ++h) {
+                for(int c = 0; c < 3; ++c) {
+                    if(!isDifferential)
+                        quantized[h][c] = (avg[h][c] * 15 + 127) / 255;
+                    base[h][c] = isDifferential ? expand5(quantized[h][c]) : expand4(quantized[h][c]);
+                }
+            }
+            
+            SubblockCode codes[2];
+            encodeSubblock(block, kSubblocks[flip][0], base[0], codes[0]);
+            encodeSubblock(block, kSubblocks[flip][1], base[1], codes[1]);
+            const long long error = codes[0].error + codes[1].error;
+            if(error >= bestError)
+                continue;
+            
+            uint64_t bits = 0;
+            if(isDifferential) {
+                for(int c = 0; c < 3; ++c) {
+                    bits |= (uint64_t)quantized[0][c] << (59 - 8 * c);
+                    bits |= (uint64_t)(deltas[c] & 7) << (56 - 8 * c);
+                }
+                bits |= (uint64_t)1 << 33;
+            } else {
+                for(int c = 0; c < 3; ++c) {
+                    bits |= (uint64_t)quantized[0][c] << (60 - 8 * c);
+                    bits |= (uint64_t)quantized[1][c] << (56 - 8 * c);
+                }
+            }
+            bits |= (uint64_t)codes[0].table << 37;
+            bits |= (uint64_t)codes[1].table << 34;
+            bits |= (uint64_t)flip << 32;
+            
+            // Index bits are numbered by columns: the most significant bits first, then the least significant ones
+            for(int h = 0; h < 2; ++h) {
+                for(int i = 0; i < 8; ++i) {
+                    const int p = kSubblocks[flip][h][i];
+                    const int bit = (p % 4) * 4 + p / 4;
+                    const int index = codes[h].indices[i];
+                    bits |= (uint64_t)(index >> 1) << (16 + bit);
+                    bits |= (uint64_t)(index & 1) << bit;
+                }
+            }
+            
+            bestError = error;
+            bestBits = bits;
+        }
+        putU64BE(bestBits, out);
+    }
+    
+    // Encodes alpha of the block into the EAC block
+    void encodeAlphaBlock(BlockPixels const& block, unsigned char* out) {
+        const int minAlpha = *min_element(block.alpha, block.alpha + 16);
+        const int maxAlpha = *max_element(block.alpha, block.alpha + 16);
+        
+        int bestBase = minAlpha, bestMultiplier = 1, bestTable = kFlatAlphaTable;
+        int bestIndices[16];
+        fill(bestIndices, bestIndices + 16, kFlatAlphaIndex);
+        
+        if(minAlpha != maxAlpha) {
+            long long bestError = LLONG_MAX;
+            for(int table = 0; table < 16; ++table) {
+                auto const* mods = kAlphaModifiers[table];
+                const int modMin = *min_element(mods, mods + 8);
+                const int modMax = *max_element(mods, mods + 8);
+                const int span = modMax - modMin;
+                const int multiplier = (maxAlpha - minAlpha + span / 2) / span;
+                
+                // The multiplier is never zero, so flat alpha is kept by the zero modifier only
+                const int m = (std::max)(1, (std::min)(15, multiplier));
+                const int base = clamp255((minAlpha + maxAlpha - (modMin + modMax) * m + 1) / 2);
+                
+                int values[8];
+                for(int i = 0; i < 8; ++i)
+                    values[i] = clamp255(base + mods[i] * m);
+                
+                long long error = 0;
+                int indices[16];
+                for(int p = 0; p < 16 && error < bestError; ++p) {
+                    int best = INT_MAX;
+                    for(int i = 0; i < 8; ++i) {
+                        const int d = values[i] - block.alpha[p];
+                        if(d * d < best) {
+                            best = d * d;
+                            indices[p] = i;
+                        }
+                    }
+                    error += best;
+                }
+                
+                if(error < bestError) {
+                    bestError = error;
+                    bestBase = base;
+                    bestMultiplier = m;
+                    bestTable = table;
+                    copy(indices, indices + 16, bestIndices);
+                }
+            }
+        }
+        
+        uint64_t bits = (uint64_t)bestBase << 56 | (uint64_t)bestMultiplier << 52 | (uint64_t)bestTable << 48;
+        
+        // Indices go by columns from the most significant bits
+        for(int x = 0; x < 4; ++x) {
+            for(int y = 0; y < 4; ++y)
+                bits |= (uint64_t)bestIndices[y * 4 + x] << (45 - 3 * (x * 4 + y));
+        }
+        putU64BE(bits, out);
+    }
+    
+    // Encodes the rows of blocks in [first, last) range
+    void encodeBlockRows(image_props const& image, int first, int last, unsigned char* out) {
+        const int width = image.size.width;
+        const int height = image.size.height;
+        const size_t bpp = pixel_format_details(image.fmt).bpp;
+        const bool hasAlpha = image.fmt == pixel_format::rgba8;
+        const size_t blockSize = etc2_block_size(image.fmt);
+        const int blocksX = (width + etc2_block_dim - 1) / etc2_block_dim;
+        unsigned char const* pixels = image.pixels.get();
+        
+        unsigned char block[16 * 4];
+        for(int by = first; by < last; ++by) {
+            for(int bx = 0; bx < blocksX; ++bx) {
+                for(int y = 0; y < 4; ++y) {
+                    const int sy = (std::min)(by * 4 + y, height - 1);
+                    for(int x = 0; x < 4; ++x) {
+                        const int sx = (std::min)(bx * 4 + x, width - 1);
+                        unsigned char const* src = pixels + ((size_t)sy * width + sx) * bpp;
+                        unsigned char* dst = block + (y * 4 + x) * 4;
+                        dst[0] = src[0];
+                        dst[1] = src[1];
+                        dst[2] = src[2];
+                        dst[3] = hasAlpha ? src[3] : 0xff;
+                    }
+                }
+                encode_etc2_block(block, hasAlpha, out + ((size_t)by * blocksX + bx) * blockSize);
+            }
+        }
+    }
+
+} // anonymous
+
+size_t etc2_block_size(atlas2d::pixel_format fmt) {
+    if(fmt == pixel_format::rgba8)
+        return 16;
+    return fmt == pixel_format::rgb8 ? 8 : 0;
+}
+
+void encode_etc2_block(unsigned char const* pixels, bool has_alpha, unsigned char* out) {
+    BlockPixels block;
+    for(int p = 0; p < 16; ++p) {
+        unsigned char const* pixel = pixels + p * 4;
+        block.rgb[p][0] = pixel[0];
+        block.rgb[p][1] = pixel[1];
+        block.rgb[p][2] = pixel[2];
+        block.alpha[p] = pixel[3];
+        block.weights[p] = has_alpha ? (pixel[3] >> 4) + 1 : 1;
+    }
+    
+    if(has_alpha) {
+        encodeAlphaBlock(block, out);
+        out += 8;
+    }
+    encodeColorBlock(block, out);
+}
+
+bool encode_etc2(image_props const& image, thread_pool_ptr const& pool, std::vector<unsigned char>& blocks) {
+    const size_t blockSize = etc2_block_size(image.fmt);
+    if(!blockSize || !image.pixels || image.size.width <= 0 || image.size.height <= 0)
+        return false;
+    
+    const int blocksX = (image.size.width + etc2_block_dim - 1) / etc2_block_dim;
+    const int blocksY = (image.size.height + etc2_block_dim - 1) / etc2_block_dim;
+    blocks.resize((size_t)blocksX * blocksY * blockSize);
+    
+    if(!pool || pool->size() <= 1) {
+        encodeBlockRows(image, 0, blocksY, blocks.data());
+        return true;
+    }
+    
+    // A few tasks per worker balance rows of different complexity
+    const int tasksCount = (int)pool->size() * 4;
+    const int rowsPerTask = (std::max)(1, (blocksY + tasksCount - 1) / tasksCount);
+    
+    vector<future<void>> pending;
+    unsigned char* out = blocks.data();
+    for(int row = 0; row < blocksY; row += rowsPerTask) {
+        const int last = (std::min)(row + rowsPerTask, blocksY);
+        pending.push_back(pool->submit([&image, row, last, out]() {
+            encodeBlockRows(image, row, last, out);
+        }));
+    }
+    for(auto& res : pending) {
+        res.get();
+    }
+    return true;
+}
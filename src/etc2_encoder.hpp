@@ -0,0 +1,25 @@
+#pragma once
+
+#include "forwards.hpp"
+#include "helpers.hpp"
+#include <vector>
+
+/// Side of ETC2 blocks in pixels
+const int etc2_block_dim = 4;
+
+/// Returns the size of ETC2 blocks of the pixel format in bytes: 8 for rgb8, 16 for rgba8 and 0 for others
+size_t etc2_block_size(atlas2d::pixel_format fmt);
+
+/**
+ @brief Encodes the 4x4 block of rgba pixels, stored by rows.
+ The alpha is encoded into the EAC block preceding the color one if the output is 16 bytes (RGBA8 ETC2 EAC),
+ the color only otherwise (RGB8 ETC2). Colors are encoded in ETC1 compatible modes.
+ */
+void encode_etc2_block(unsigned char const* pixels, bool has_alpha, unsigned char* out);
+
+/**
+ @brief Encodes the rgb8 image into RGB8 ETC2 and the rgba8 one into RGBA8 ETC2 EAC blocks.
+ Blocks are stored by rows. The right and the bottom blocks of an image which size isn't a multiple of 4
+ repeat the edge pixels. Rows of blocks are encoded in parallel on the pool if it's set.
+ */
+bool encode_etc2(image_props const& image, thread_pool_ptr const& pool, std::vector<unsigned char>& blocks);
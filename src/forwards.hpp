@@ -10,6 +10,7 @@ struct rect;
 struct atlas_item;
 struct atlas_props;
 struct image_props;
+struct pixel_buffer;
 
 class chain_node;
 using chain_node_ptr = std::shared_ptr<chain_node>;
@@ -20,3 +21,8 @@ using atlas_builder_ptr = std::shared_ptr<atlas_builder>;
 class bin_packer;
 using bin_packer_ptr = std::shared_ptr<bin_packer>;
 
+class thread_pool;
+using thread_pool_ptr = std::shared_ptr<thread_pool>;
+
+class image_rows_writer;
+using image_rows_writer_ptr = std::shared_ptr<image_rows_writer>;
@@ -4,6 +4,9 @@
 #include <atlas2d/pixel_format.hpp>
 #include <atlas2d/image.hpp>
 #include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
 
 /// Simple rect
 struct rect {
@@ -22,11 +25,31 @@ struct image_props {
     atlas2d::raw_data_ptr pixels;   ///< Pixels array
 };
 
+/// Destination buffer to decode pixels into
+struct pixel_buffer {
+    unsigned char* data = nullptr;  ///< The first pixel of the buffer
+    size_t stride = 0;              ///< Distance between rows in bytes
+    atlas2d::size dims;             ///< Dimensions of the buffer
+    atlas2d::pixel_format fmt;      ///< Pixel format of the buffer
+    bool premultiplied = false;     ///< Pixels are stored with premultiplied alpha
+};
+
+/// Sprite sharing the image of another atlas item
+struct atlas_alias {
+    std::string image_path;         ///< Relative path to alias's image
+    atlas2d::size source_size;      ///< Size of the alias's image before trimming. Empty if the image isn't trimmed
+    atlas2d::offset trim_offset;    ///< Offset of the trimmed image in the alias's one
+};
+
 /// Describes atlas item generic properties
 struct atlas_item: image_props {
     std::string image_path;         ///< Relative path to item's image
     bool rotated=false;             ///< Is the image rotated
     rect box;                       ///< Rect to place the image into
+    atlas2d::size source_size;      ///< Size of the image before trimming. Empty if the image isn't trimmed
+    atlas2d::offset trim_offset;    ///< Offset of the trimmed image in the source one
+    uint64_t pixels_hash = 0;       ///< Hash of the decoded pixels (0 - unknown)
+    std::vector<atlas_alias> aliases; ///< Sprites having the same image
 };
 
 /// Describes atlas properties
@@ -34,10 +57,10 @@ struct atlas_props {
     atlas2d::pixel_format fmt;      ///< Atlas pixel format
     bool premultipled = false;      ///< Has premultipled alpha
     int padding = 0;                ///< Padding between atlas items
+    int block_align = 1;            ///< Size of blocks cells of atlas items are aligned to
     float occupancy = 0;            ///< Atlas ocuppancy factor (the value in the range [0,1])
     atlas2d::size size;             ///< Dimensions of the atlas
 };
 
-
-
-
+/// Sprite name to image path dictionary
+using sprites_map = std::map<std::string, std::string>;
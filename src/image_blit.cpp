@@ -0,0 +1,582 @@
+#include "image_blit.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// IMAGE_BLIT_NO_SIMD and IMAGE_BLIT_NO_AVX2 turn kernels off to test and benchmark the rest ones
+#if !defined(IMAGE_BLIT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define IMAGE_BLIT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernels are compiled for the target and chosen at runtime, so the tool still runs on older CPUs
+#if defined(IMAGE_BLIT_SSE2) && !defined(IMAGE_BLIT_NO_AVX2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMAGE_BLIT_AVX2 1
+#define IMAGE_BLIT_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    // Side of the square block rotated at once, so source rows and destination rows stay in L1 cache
+    const int kRotateTile = 64;
+    
+    // Returns round(channel * alpha / 255) exactly
+    inline unsigned char premultiplyChannel(unsigned channel, unsigned alpha) {
+        unsigned t = channel * alpha + 128;
+        return (unsigned char)((t + (t >> 8)) >> 8);
+    }
+    
+    // Premultiplies colors of the rgba pixel by its alpha. The destination can be the source
+    inline void premultiplyPixel(unsigned char const* src, unsigned char* dst) {
+        const unsigned alpha = src[3];
+        dst[0] = premultiplyChannel(src[0], alpha);
+        dst[1] = premultiplyChannel(src[1], alpha);
+        dst[2] = premultiplyChannel(src[2], alpha);
+        dst[3] = (unsigned char)alpha;
+    }
+    
+    template<int Bpp, bool Premultiply>
+    inline void copyPixel(unsigned char const* src, unsigned char* dst) {
+        if(Premultiply)
+            premultiplyPixel(src, dst);
+        else
+            memcpy(dst, src, Bpp);
+    }
+    
+    void premultiplyRowScalar(unsigned char const* src, unsigned char* dst, int count) {
+        for(int i = 0; i < count; ++i)
+            premultiplyPixel(src + i * 4, dst + i * 4);
+    }
+    
+    // Averages 2x2 pixels of the two source rows into each of `count` destination pixels
+    template<int Bpp>
+    void downsampleRowScalar(unsigned char const* row0, unsigned char const* row1, unsigned char* dst, int count) {
+        for(int i = 0; i < count; ++i) {
+            unsigned char const* top = row0 + i * 2 * Bpp;
+            unsigned char const* bottom = row1 + i * 2 * Bpp;
+            for(int c = 0; c < Bpp; ++c)
+                dst[i * Bpp + c] = (unsigned char)((top[c] + top[Bpp + c] + bottom[c] + bottom[Bpp + c] + 2) >> 2);
+        }
+    }
+    
+    /**
+     Rotates the [x0, x1) x [y0, y1) part of the source by 90 degrees clockwise.
+     The source pixel (x, y) goes to the destination pixel (height - 1 - y, x).
+     */
+    template<int Bpp, bool Premultiply>
+    void rotateArea(unsigned char const* src, size_t srcStride, int height,
+                    int x0, int y0, int x1, int y1,
+                    unsigned char* dst, size_t dstStride) {
+        for(int y = y0; y < y1; ++y) {
+            unsigned char const* srcRow = src + y * srcStride;
+            unsigned char* dstColumn = dst + (height - 1 - y) * Bpp;
+            for(int x = x0; x < x1; ++x)
+                copyPixel<Bpp, Premultiply>(srcRow + x * Bpp, dstColumn + x * dstStride);
+        }
+    }
+    
+    template<int Bpp, bool Premultiply>
+    void rotateScalar(unsigned char const* src, size_t srcStride, int width, int height,
+                      unsigned char* dst, size_t dstStride) {
+        for(int by = 0; by < height; by += kRotateTile) {
+            const int by1 = (std::min)(by + kRotateTile, height);
+            for(int bx = 0; bx < width; bx += kRotateTile) {
+                const int bx1 = (std::min)(bx + kRotateTile, width);
+                rotateArea<Bpp, Premultiply>(src, srcStride, height, bx, by, bx1, by1, dst, dstStride);
+            }
+        }
+    }
+    
+    /**
+     Rotates the blocks of Block x Block pixels by the kernel and the rest of the image by the scalar code.
+     The kernel transposes the block with its rows taken from the bottom, that makes the rotation.
+     */
+    template<int Block, bool Premultiply, typename KernelT>
+    void rotateBlocked(unsigned char const* src, size_t srcStride, int width, int height,
+                       unsigned char* dst, size_t dstStride, KernelT kernel) {
+        const int blockedWidth = width - width % Block;
+        const int blockedHeight = height - height % Block;
+        for(int by = 0; by < blockedHeight; by += kRotateTile) {
+            const int by1 = (std::min)(by + kRotateTile, blockedHeight);
+            for(int bx = 0; bx < blockedWidth; bx += kRotateTile) {
+                const int bx1 = (std::min)(bx + kRotateTile, blockedWidth);
+                for(int y = by; y < by1; y += Block) {
+                    for(int x = bx; x < bx1; x += Block) {
+                        kernel(src + (y + Block - 1) * srcStride + x * 4, srcStride,
+                               dst + x * dstStride + (height - Block - y) * 4, dstStride);
+                    }
+                }
+            }
+        }
+        
+        // the right columns and the bottom rows out of blocks
+        rotateArea<4, Premultiply>(src, srcStride, height, blockedWidth, 0, width, blockedHeight, dst, dstStride);
+        rotateArea<4, Premultiply>(src, srcStride, height, 0, blockedHeight, width, height, dst, dstStride);
+    }
+
+#ifdef IMAGE_BLIT_SSE2
+    // Multiplies 16 bit channels by the factors with the exact rounding of the scalar code
+    inline __m128i mulDiv255(__m128i channels, __m128i factors) {
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(channels, factors), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+    
+    // Returns alpha of two unpacked rgba pixels in color lanes and 255 in alpha lanes
+    inline __m128i alphaFactors(__m128i pixels) {
+        const __m128i colorLanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+        const __m128i alphaLanes = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixels, 0xFF), 0xFF);
+        return _mm_or_si128(_mm_and_si128(alpha, colorLanes), alphaLanes);
+    }
+    
+    // Premultiplies colors of four rgba pixels by their alpha
+    inline __m128i premultiply4(__m128i pixels) {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        return _mm_packus_epi16(mulDiv255(lo, alphaFactors(lo)), mulDiv255(hi, alphaFactors(hi)));
+    }
+    
+    template<bool Premultiply>
+    inline void store4(unsigned char* dst, __m128i pixels) {
+        _mm_storeu_si128((__m128i*)dst, Premultiply ? premultiply4(pixels) : pixels);
+    }
+    
+    void premultiplyRowSse2(unsigned char const* src, unsigned char* dst, int count) {
+        int i = 0;
+        for(; i + 4 <= count; i += 4)
+            store4<true>(dst + i * 4, _mm_loadu_si128((__m128i const*)(src + i * 4)));
+        premultiplyRowScalar(src + i * 4, dst + i * 4, count - i);
+    }
+    
+    // Transposes 4x4 pixels. The source rows are read from the bottom one upwards
+    template<bool Premultiply>
+    void transpose4x4(unsigned char const* srcBottom, size_t srcStride, unsigned char* dst, size_t dstStride) {
+        __m128i r0 = _mm_loadu_si128((__m128i const*)(srcBottom));
+        __m128i r1 = _mm_loadu_si128((__m128i const*)(srcBottom - srcStride));
+        __m128i r2 = _mm_loadu_si128((__m128i const*)(srcBottom - 2 * srcStride));
+        __m128i r3 = _mm_loadu_si128((__m128i const*)(srcBottom - 3 * srcStride));
+        
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        
+        store4<Premultiply>(dst, _mm_unpacklo_epi64(t0, t1));
+        store4<Premultiply>(dst + dstStride, _mm_unpackhi_epi64(t0, t1));
+        store4<Premultiply>(dst + 2 * dstStride, _mm_unpacklo_epi64(t2, t3));
+        store4<Premultiply>(dst + 3 * dstStride, _mm_unpackhi_epi64(t2, t3));
+    }
+    
+    template<bool Premultiply>
+    void rotate32Sse2(unsigned char const* src, size_t srcStride, int width, int height,
+                      unsigned char* dst, size_t dstStride) {
+        rotateBlocked<4, Premultiply>(src, srcStride, width, height, dst, dstStride, &transpose4x4<Premultiply>);
+    }
+    
+    // Averages 8x2 rgba pixels into 4 ones. Sums of 16 bit channels are added by pairs of pixels
+    void downsampleRowSse2(unsigned char const* row0, unsigned char const* row1, unsigned char* dst, int count) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i half = _mm_set1_epi16(2);
+        int i = 0;
+        for(; i + 4 <= count; i += 4) {
+            __m128i q[2];
+            for(int k = 0; k < 2; ++k) {
+                __m128i top = _mm_loadu_si128((__m128i const*)(row0 + i * 8 + k * 16));
+                __m128i bottom = _mm_loadu_si128((__m128i const*)(row1 + i * 8 + k * 16));
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+                __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+                __m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                q[k] = _mm_srli_epi16(_mm_add_epi16(sum, half), 2);
+            }
+            _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_packus_epi16(q[0], q[1]));
+        }
+        downsampleRowScalar<4>(row0 + i * 8, row1 + i * 8, dst + i * 4, count - i);
+    }
+    
+    // Reverses the order of four rgba pixels
+    void reverse4(unsigned char const* src, unsigned char* dst) {
+        __m128i v = _mm_loadu_si128((__m128i const*)src);
+        _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+#endif
+
+#ifdef IMAGE_BLIT_AVX2
+    IMAGE_BLIT_TARGET_AVX2
+    inline __m256i mulDiv255(__m256i channels, __m256i factors) {
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(channels, factors), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+    
+    IMAGE_BLIT_TARGET_AVX2
+    inline __m256i alphaFactors(__m256i pixels) {
+        const __m256i colorLanes = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+        const __m256i alphaLanes = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+        __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixels, 0xFF), 0xFF);
+        return _mm256_or_si256(_mm256_and_si256(alpha, colorLanes), alphaLanes);
+    }
+    
+    // Premultiplies colors of eight rgba pixels. Unpacking and packing keep the order within 128 bit lanes
+    IMAGE_BLIT_TARGET_AVX2
+    inline __m256i premultiply8(__m256i pixels) {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+        __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+        return _mm256_packus_epi16(mulDiv255(lo, alphaFactors(lo)), mulDiv255(hi, alphaFactors(hi)));
+    }
+    
+    template<bool Premultiply>
+    IMAGE_BLIT_TARGET_AVX2
+    inline void store8(unsigned char* dst, __m256i pixels) {
+        _mm256_storeu_si256((__m256i*)dst, Premultiply ? premultiply8(pixels) : pixels);
+    }
+    
+    IMAGE_BLIT_TARGET_AVX2
+    void premultiplyRowAvx2(unsigned char const* src, unsigned char* dst, int count) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+            store8<true>(dst + i * 4, _mm256_loadu_si256((__m256i const*)(src + i * 4)));
+        premultiplyRowScalar(src + i * 4, dst + i * 4, count - i);
+    }
+    
+    // Averages 16x2 rgba pixels into 8 ones. Packing interleaves 128 bit lanes, so 64 bit halves are reordered
+    IMAGE_BLIT_TARGET_AVX2
+    void downsampleRowAvx2(unsigned char const* row0, unsigned char const* row1, unsigned char* dst, int count) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i half = _mm256_set1_epi16(2);
+        int i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256i q[2];
+            for(int k = 0; k < 2; ++k) {
+                __m256i top = _mm256_loadu_si256((__m256i const*)(row0 + i * 8 + k * 32));
+                __m256i bottom = _mm256_loadu_si256((__m256i const*)(row1 + i * 8 + k * 32));
+                __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(top, zero), _mm256_unpacklo_epi8(bottom, zero));
+                __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(top, zero), _mm256_unpackhi_epi8(bottom, zero));
+                __m256i sum = _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+                q[k] = _mm256_srli_epi16(_mm256_add_epi16(sum, half), 2);
+            }
+            __m256i packed = _mm256_packus_epi16(q[0], q[1]);
+            _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        downsampleRowScalar<4>(row0 + i * 8, row1 + i * 8, dst + i * 4, count - i);
+    }
+    
+    // Transposes 8x8 pixels. The source rows are read from the bottom one upwards
+    template<bool Premultiply>
+    IMAGE_BLIT_TARGET_AVX2
+    void transpose8x8(unsigned char const* srcBottom, size_t srcStride, unsigned char* dst, size_t dstStride) {
+        __m256i r[8];
+        for(int i = 0; i < 8; ++i)
+            r[i] = _mm256_loadu_si256((__m256i const*)(srcBottom - i * srcStride));
+        
+        __m256i t[8];
+        for(int i = 0; i < 8; i += 2) {
+            t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+            t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+        }
+        
+        __m256i u[8];
+        for(int i = 0; i < 8; i += 4) {
+            u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+            u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+            u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+            u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+        }
+        
+        // 128 bit lanes keep the left and the right halves of the source rows
+        for(int i = 0; i < 4; ++i) {
+            store8<Premultiply>(dst + i * dstStride, _mm256_permute2x128_si256(u[i], u[i + 4], 0x20));
+            store8<Premultiply>(dst + (i + 4) * dstStride, _mm256_permute2x128_si256(u[i], u[i + 4], 0x31));
+        }
+    }
+    
+    template<bool Premultiply>
+    IMAGE_BLIT_TARGET_AVX2
+    void rotate32Avx2(unsigned char const* src, size_t srcStride, int width, int height,
+                      unsigned char* dst, size_t dstStride) {
+        rotateBlocked<8, Premultiply>(src, srcStride, width, height, dst, dstStride, &transpose8x8<Premultiply>);
+    }
+#endif
+    
+    /// Kernels chosen once for the CPU
+    struct BlitKernels {
+        using rotate_fn = void (*)(unsigned char const*, size_t, int, int, unsigned char*, size_t);
+        using row_fn = void (*)(unsigned char const*, unsigned char*, int);
+        using downsample_fn = void (*)(unsigned char const*, unsigned char const*, unsigned char*, int);
+        
+        char const* name;               ///< Name of the instruction set
+        rotate_fn rotate32;             ///< Rotation of 32 bit pixels
+        rotate_fn rotatePremultiplied;  ///< Rotation of rgba pixels premultiplying their alpha
+        row_fn premultiplyRow;          ///< Premultiplication of rgba pixels
+        downsample_fn downsampleRow;    ///< Averaging of 2x2 rgba pixels
+    };
+    
+    BlitKernels selectKernels() {
+#ifdef IMAGE_BLIT_AVX2
+        if(__builtin_cpu_supports("avx2"))
+            return BlitKernels{"avx2", &rotate32Avx2<false>, &rotate32Avx2<true>, &premultiplyRowAvx2, &downsampleRowAvx2};
+#endif
+#ifdef IMAGE_BLIT_SSE2
+        return BlitKernels{"sse2", &rotate32Sse2<false>, &rotate32Sse2<true>, &premultiplyRowSse2, &downsampleRowSse2};
+#else
+        return BlitKernels{"scalar", &rotateScalar<4, false>, &rotateScalar<4, true>, &premultiplyRowScalar, &downsampleRowScalar<4>};
+#endif
+    }
+    
+    BlitKernels const& kernels() {
+        static const BlitKernels selected = selectKernels();
+        return selected;
+    }
+    
+    // Rotates pixels of the same format in the source and the destination
+    void rotatePixels(unsigned char const* src, size_t srcStride, int width, int height, size_t bpp,
+                      bool premultiply, unsigned char* dst, size_t dstStride) {
+        if(bpp == 4) {
+            auto rotate = premultiply ? kernels().rotatePremultiplied : kernels().rotate32;
+            rotate(src, srcStride, width, height, dst, dstStride);
+        } else {
+            rotateScalar<3, false>(src, srcStride, width, height, dst, dstStride);
+        }
+    }
+    
+    // Writes `count` pixels of the source to the destination in the reversed order
+    void reverseCopy(unsigned char const* src, int count, size_t bpp, unsigned char* dst) {
+        int i = 0;
+#ifdef IMAGE_BLIT_SSE2
+        if(bpp == 4) {
+            for(; i + 4 <= count; i += 4)
+                reverse4(src + (count - 4 - i) * bpp, dst + i * bpp);
+        }
+#endif
+        for(; i < count; ++i)
+            memcpy(dst + i * bpp, src + (count - 1 - i) * bpp, bpp);
+    }
+    
+    // Repeats the pixel `count` times
+    void repeatPixel(unsigned char const* pixel, int count, size_t bpp, unsigned char* dst) {
+        for(int i = 0; i < count; ++i)
+            memcpy(dst + i * bpp, pixel, bpp);
+    }
+    
+    // Writes the rounded average of the [x0, x1) x [y0, y1) pixels of the source
+    void averageArea(pixel_buffer const& src, int x0, int y0, int x1, int y1, size_t bpp, unsigned char* dst) {
+        unsigned sums[4] = {0, 0, 0, 0};
+        for(int y = y0; y < y1; ++y) {
+            unsigned char const* row = src.data + y * src.stride;
+            for(int x = x0; x < x1; ++x) {
+                for(size_t c = 0; c < bpp; ++c)
+                    sums[c] += row[x * bpp + c];
+            }
+        }
+        
+        const unsigned count = (unsigned)((x1 - x0) * (y1 - y0));
+        for(size_t c = 0; c < bpp; ++c)
+            dst[c] = (unsigned char)((sums[c] + count / 2) / count);
+    }
+
+} // anonymous
+
+bool convert_row(unsigned char const* src, atlas2d::pixel_format src_fmt,
+                 unsigned char* dst, atlas2d::pixel_format dst_fmt,
+                 int count, bool premultiply) {
+    const bool isSrcRgba = src_fmt == pixel_format::rgba8;
+    const bool isDstRgba = dst_fmt == pixel_format::rgba8;
+    if((!isSrcRgba && src_fmt != pixel_format::rgb8) ||
+       (!isDstRgba && dst_fmt != pixel_format::rgb8))
+        return false;
+    
+    if(isSrcRgba && isDstRgba && premultiply) {
+        kernels().premultiplyRow(src, dst, count);
+    } else if(src_fmt == dst_fmt) {
+        if(src != dst)
+            memcpy(dst, src, count * pixel_format_details(src_fmt).bpp);
+    } else if(isDstRgba) {
+        // opaque pixels don't change on premultiplication
+        for(int i = 0; i < count; ++i) {
+            memcpy(dst + i * 4, src + i * 3, 3);
+            dst[i * 4 + 3] = 0xff;
+        }
+    } else {
+        for(int i = 0; i < count; ++i) {
+            unsigned char const* pixel = src + i * 4;
+            unsigned char* converted = dst + i * 3;
+            if(premultiply) {
+                converted[0] = premultiplyChannel(pixel[0], pixel[3]);
+                converted[1] = premultiplyChannel(pixel[1], pixel[3]);
+                converted[2] = premultiplyChannel(pixel[2], pixel[3]);
+            } else {
+                memmove(converted, pixel, 3);
+            }
+        }
+    }
+    return true;
+}
+
+bool blit_image(image_props const& image, bool rotated, pixel_buffer const& target, atlas2d::offset const& at) {
+    if(!image.pixels || !target.data)
+        return false;
+    
+    if((image.fmt != pixel_format::rgba8 && image.fmt != pixel_format::rgb8) ||
+       (target.fmt != pixel_format::rgba8 && target.fmt != pixel_format::rgb8))
+        return false;
+    
+    const int width = rotated ? image.size.height : image.size.width;
+    const int height = rotated ? image.size.width : image.size.height;
+    if(at.x < 0 || at.y < 0 ||
+       at.x + width > target.dims.width ||
+       at.y + height > target.dims.height)
+        return false;
+    
+    const size_t srcBpp = pixel_format_details(image.fmt).bpp;
+    const size_t dstBpp = pixel_format_details(target.fmt).bpp;
+    const size_t srcStride = image.size.width * srcBpp;
+    const bool premultiply = target.premultiplied && image.fmt == pixel_format::rgba8;
+    unsigned char const* src = image.pixels.get();
+    unsigned char* dst = target.data + at.y * target.stride + at.x * dstBpp;
+    
+    if(!rotated) {
+        // Each row is converted right into the target
+        for(int y = 0; y < height; ++y)
+            convert_row(src + y * srcStride, image.fmt, dst + y * target.stride, target.fmt, width, premultiply);
+    } else if(image.fmt == target.fmt) {
+        rotatePixels(src, srcStride, image.size.width, image.size.height, srcBpp,
+                     premultiply, dst, target.stride);
+    } else {
+        // Rotated images of another format are converted before the rotation
+        const size_t convertedStride = image.size.width * dstBpp;
+        vector<unsigned char> converted(convertedStride * image.size.height);
+        for(int y = 0; y < image.size.height; ++y) {
+            convert_row(src + y * srcStride, image.fmt, converted.data() + y * convertedStride, target.fmt,
+                        image.size.width, premultiply);
+        }
+        rotatePixels(converted.data(), convertedStride, image.size.width, image.size.height, dstBpp,
+                     false, dst, target.stride);
+    }
+    return true;
+}
+
+void mirror_padding(pixel_buffer const& target, rect const& area, int padding) {
+    if(!target.data || padding <= 0 || area.width <= 0 || area.height <= 0)
+        return;
+    
+    const size_t bpp = pixel_format_details(target.fmt).bpp;
+    const int left = (std::min)(padding, area.x);
+    const int right = (std::min)(padding, target.dims.width - area.x - area.width);
+    const int top = (std::min)(padding, area.y);
+    const int bottom = (std::min)(padding, target.dims.height - area.y - area.height);
+    auto rowAt = [&target](int y) {
+        return target.data + y * target.stride;
+    };
+    
+    // Paddings wider than the area repeat its farthest pixels
+    const int mirroredLeft = (std::min)(left, area.width);
+    const int mirroredRight = (std::min)(right, area.width);
+    for(int y = area.y; y < area.y + area.height; ++y) {
+        unsigned char* begin = rowAt(y) + area.x * bpp;
+        unsigned char* end = begin + area.width * bpp;
+        
+        reverseCopy(begin, mirroredLeft, bpp, begin - mirroredLeft * bpp);
+        repeatPixel(end - bpp, left - mirroredLeft, bpp, begin - left * bpp);
+        
+        reverseCopy(end - mirroredRight * bpp, mirroredRight, bpp, end);
+        repeatPixel(begin, right - mirroredRight, bpp, end + mirroredRight * bpp);
+    }
+    
+    // The top and the bottom paddings include the corners
+    const size_t rowOffset = (area.x - left) * bpp;
+    const size_t rowBytes = (left + area.width + right) * bpp;
+    for(int k = 0; k < top; ++k) {
+        const int mirrored = area.y + (std::min)(k, area.height - 1);
+        memcpy(rowAt(area.y - 1 - k) + rowOffset, rowAt(mirrored) + rowOffset, rowBytes);
+    }
+    
+    const int lastRow = area.y + area.height - 1;
+    for(int k = 0; k < bottom; ++k) {
+        const int mirrored = lastRow - (std::min)(k, area.height - 1);
+        memcpy(rowAt(lastRow + 1 + k) + rowOffset, rowAt(mirrored) + rowOffset, rowBytes);
+    }
+}
+
+bool downsample_image(pixel_buffer const& src, pixel_buffer const& dst, std::vector<rect>& regions) {
+    if(src.fmt != dst.fmt ||
+       (src.fmt != pixel_format::rgba8 && src.fmt != pixel_format::rgb8))
+        return false;
+    
+    if(dst.dims.width != (std::max)(1, src.dims.width / 2) ||
+       dst.dims.height != (std::max)(1, src.dims.height / 2))
+        return false;
+    
+    const size_t bpp = pixel_format_details(src.fmt).bpp;
+    if(src.dims.width >= 2 && src.dims.height >= 2) {
+        for(int y = 0; y < dst.dims.height; ++y) {
+            unsigned char const* row0 = src.data + 2 * y * src.stride;
+            unsigned char* dstRow = dst.data + y * dst.stride;
+            if(bpp == 4)
+                kernels().downsampleRow(row0, row0 + src.stride, dstRow, dst.dims.width);
+            else
+                downsampleRowScalar<3>(row0, row0 + src.stride, dstRow, dst.dims.width);
+        }
+    } else {
+        // The single row or column is averaged by pairs of pixels
+        for(int y = 0; y < dst.dims.height; ++y) {
+            for(int x = 0; x < dst.dims.width; ++x) {
+                averageArea(src, 2 * x, 2 * y,
+                            (std::min)(2 * x + 2, src.dims.width), (std::min)(2 * y + 2, src.dims.height),
+                            bpp, dst.data + y * dst.stride + x * bpp);
+            }
+        }
+    }
+    
+    for(auto& region : regions) {
+        const int x0 = (std::max)(0, region.x);
+        const int y0 = (std::max)(0, region.y);
+        const int x1 = (std::min)(src.dims.width, region.x + region.width);
+        const int y1 = (std::min)(src.dims.height, region.y + region.height);
+        if(x0 >= x1 || y0 >= y1) {
+            region = rect(x0 / 2, y0 / 2, 0, 0);
+            continue;
+        }
+        
+        const int dstX0 = x0 / 2;
+        const int dstY0 = y0 / 2;
+        const int dstX1 = (std::min)((x1 + 1) / 2, dst.dims.width);
+        const int dstY1 = (std::min)((y1 + 1) / 2, dst.dims.height);
+        if(dstX0 >= dstX1 || dstY0 >= dstY1) {
+            // The region is within the odd last column or row, which is dropped
+            region = rect(dstX0, dstY0, 0, 0);
+            continue;
+        }
+        
+        // Only pixels of the odd borders average the region with its neighbours, they are averaged again within the region
+        auto averageWithin = [&](int x, int y) {
+            averageArea(src, (std::max)(2 * x, x0), (std::max)(2 * y, y0),
+                        (std::min)(2 * x + 2, x1), (std::min)(2 * y + 2, y1),
+                        bpp, dst.data + y * dst.stride + x * bpp);
+        };
+        for(int y = dstY0; y < dstY1; ++y) {
+            if(x0 % 2)
+                averageWithin(dstX0, y);
+            if(x1 % 2)
+                averageWithin(dstX1 - 1, y);
+        }
+        for(int x = dstX0; x < dstX1; ++x) {
+            if(y0 % 2)
+                averageWithin(x, dstY0);
+            if(y1 % 2)
+                averageWithin(x, dstY1 - 1);
+        }
+        
+        region = rect(dstX0, dstY0, dstX1 - dstX0, dstY1 - dstY0);
+    }
+    return true;
+}
+
+char const* blit_kernels_name() {
+    return kernels().name;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "helpers.hpp"
+#include <vector>
+
+/**
+ @brief Converts the row of pixels between rgba8 and rgb8 formats.
+ Colors are premultiplied by alpha exactly (the product is rounded to nearest) if required.
+ The destination can be the source unless rgb8 pixels are expanded to rgba8.
+ Returns false if any of the formats isn't rgba8 or rgb8.
+ */
+bool convert_row(unsigned char const* src, atlas2d::pixel_format src_fmt,
+                 unsigned char* dst, atlas2d::pixel_format dst_fmt,
+                 int count, bool premultiply);
+
+/**
+ @brief Draws the image into the target pixels at the offset.
+ A rotated image is turned by 270 degrees counter-clockwise (90 degrees clockwise) like raw_pixel_area::rotate_270_degree,
+ so its top row becomes the right column of the drawn area.
+ Pixels are converted to the target format and premultiplied if the target is, on the same pass.
+ Returns false if any of the formats isn't rgba8 or rgb8 or the image doesn't fit the target.
+ */
+bool blit_image(image_props const& image, bool rotated, pixel_buffer const& target, atlas2d::offset const& at);
+
+/**
+ @brief Fills the padding around the area of the target by mirroring pixels of the area.
+ The left and right paddings are mirrored first, so the corners are mirrored from them by the top and bottom ones.
+ The padding is clipped by the target bounds.
+ */
+void mirror_padding(pixel_buffer const& target, rect const& area, int padding);
+
+/**
+ @brief Halves the source image into the destination by averaging each 2x2 pixels.
+ The destination dimensions are halves of the source ones rounded down, but at least 1.
+ Pixels at the borders of the regions which split 2x2 pixels are averaged within their regions only,
+ so sprites don't bleed into their neighbours. The regions are scaled to the destination on return.
+ Returns false if the formats differ or aren't rgba8 or rgb8, or the destination has wrong dimensions.
+ */
+bool downsample_image(pixel_buffer const& src, pixel_buffer const& dst, std::vector<rect>& regions);
+
+/// Returns the name of kernels chosen for the CPU: "avx2", "sse2" or "scalar"
+char const* blit_kernels_name();
@@ -1,10 +1,20 @@
 #include "image_io.hpp"
 #include "helpers.hpp"
+#include "etc2_encoder.hpp"
+#include "image_blit.hpp"
+#include "thread_pool.hpp"
+#include "mapped_file.hpp"
 #include <atlas2d/pixel_format.hpp>
 #include <atlas2d/forwards.hpp>
 #include <boost/filesystem.hpp>
 #include <png.h>
+#include <zlib.h>
 #include <set>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <easylogging++.h>
 
@@ -16,8 +26,10 @@ using namespace ::atlas2d;
 namespace fs = boost::filesystem;
 
 namespace {
-    using img_writer = std::function<bool(std::string const&, image_props const&)>;
-    using img_reader = std::function<bool(std::string const&, image_props&, bool)>;
+    using img_writer = std::function<bool(std::string const&, image_props const&, image_write_props const&)>;
+    using img_levels_writer = std::function<bool(std::string const&, std::vector<image_props> const&, image_write_props const&)>;
+    using img_reader = std::function<bool(std::string const&, image_props&, bool, pixel_buffer const*)>;
+    using img_rows_opener = std::function<image_rows_writer_ptr(std::string const&, image_props const&, image_write_props const&)>;
 
     // default error handler
     void png_error(png_structp pngStruct, png_const_charp msg) {
@@ -29,15 +41,87 @@ namespace {
         CLOG(WARNING, MODULE_LOGGER) << msg;
     }
 
+    /// Memory mapped PNG file libpng reads from
+    struct MappedPngSource {
+        mapped_file file;   ///< Mapped content of the file
+        size_t pos = 0;     ///< Read position
+    };
+    
+    // Reads next bytes of the mapped PNG file
+    void readMappedPng(png_structp pngStruct, png_bytep out, png_size_t length) {
+        auto* source = static_cast<MappedPngSource*>(png_get_io_ptr(pngStruct));
+        if(source->file.size() - source->pos < length) {
+            ::png_error((png_const_structrp)pngStruct, "Unexpected end of file");
+        }
+        
+        memcpy(out, source->file.data() + source->pos, length);
+        source->pos += length;
+    }
+    
+    /// Reads big-endian 32-bit value
+    inline uint32_t readUint32BE(unsigned char const* data) {
+        return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+    }
+    
+#ifndef IMAGE_IO_NO_PNG_PROBE
+    /**
+     @brief Reads dimensions of the png file from its IHDR chunk only.
+     The signature, the chunk and its CRC are validated. Returns false for anything unexpected,
+     so the caller can fall back to libpng.
+     */
+    bool probePngHeader(std::string const& filename, image_props& props) {
+        // Signature (8) + IHDR length (4) + IHDR type (4) + IHDR data (13) + IHDR CRC (4)
+        unsigned char header[33];
+        
+        shared_ptr<FILE> fp(fopen(filename.c_str(), "rb"), [](FILE* fp){ if(fp) fclose(fp); });
+        if(!fp || fread(header, 1, sizeof(header), fp.get()) != sizeof(header))
+            return false;
+        
+        if(png_sig_cmp(header, 0, 8) != 0)
+            return false;
+        
+        unsigned char const* chunk = header + 8;
+        if(readUint32BE(chunk) != 13 || memcmp(chunk + 4, "IHDR", 4) != 0)
+            return false;
+        
+        // CRC covers the chunk type and data
+        uLong crc = crc32(0L, chunk + 4, 4 + 13);
+        if(crc != readUint32BE(chunk + 4 + 4 + 13))
+            return false;
+        
+        unsigned char const* ihdr = chunk + 8;
+        uint32_t width = readUint32BE(ihdr);
+        uint32_t height = readUint32BE(ihdr + 4);
+        if(!width || !height || width > PNG_UINT_31_MAX || height > PNG_UINT_31_MAX)
+            return false;
+        
+        props.size.width = (int)width;
+        props.size.height = (int)height;
+        props.fmt = atlas2d::pixel_format::rgba8;
+        
+        return true;
+    }
+#endif
+    
     /**
      @brief Reads all necessary information of a specific png file.
      Use loadData=true if whole image's pixels is required, otherwise only
      generic information will be read.
+     If the dst buffer is set and matches the image, the pixels are decoded straight into the buffer
+     and props.pixels stays empty.
      */
-    bool readPng(std::string const& filename, image_props& props, bool loadData) {
-        shared_ptr<FILE> fp(fopen(filename.c_str(), "rb"), [](FILE* fp){ fclose(fp); });
-        if(!fp) {
-            CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for write";
+    bool readPng(std::string const& filename, image_props& props, bool loadData, pixel_buffer const* dst) {
+        // Dimensions are stored in the very first chunk,
+        // so there is no need to involve libpng in case of a well-formed file.
+        // IMAGE_IO_NO_PNG_PROBE turns the probe off to benchmark libpng
+#ifndef IMAGE_IO_NO_PNG_PROBE
+        if(!loadData && probePngHeader(filename, props))
+            return true;
+#endif
+        
+        MappedPngSource source;
+        if(!source.file.open(filename)) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for read";
             return false;
         }
         
@@ -48,7 +132,6 @@ namespace {
             png_destroy_read_struct(&pngStruct, &pngInfo, NULL);
         });
         
-        shared_ptr<png_bytep> rowPtrsGuard;
         atlas2d::raw_data_ptr pixelsGuard;
         
         if(!pngStruct || !pngInfo) {
@@ -62,7 +145,7 @@ namespace {
 
         png_set_error_fn(pngStruct, nullptr, &png_error, &png_warning);
         
-        png_init_io(pngStruct, fp.get());
+        png_set_read_fn(pngStruct, &source, &readMappedPng);
         png_set_sig_bytes(pngStruct, 0);
         
         png_read_info(pngStruct, pngInfo);
@@ -78,6 +161,7 @@ namespace {
         png_uint_32 bitdepth   = png_get_bit_depth(pngStruct, pngInfo);
         png_uint_32 channels   = png_get_channels(pngStruct, pngInfo);
         png_uint_32 color_type = png_get_color_type(pngStruct, pngInfo);
+        bool hasAlpha = (color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(pngStruct, pngInfo, PNG_INFO_tRNS);
         
         // Convert palette color to true color
         if (color_type == PNG_COLOR_TYPE_PALETTE)
@@ -103,110 +187,764 @@ namespace {
         if (color_type==PNG_COLOR_TYPE_GRAY || color_type==PNG_COLOR_TYPE_GRAY_ALPHA)
             png_set_gray_to_rgb(pngStruct);
         
-        png_set_interlace_handling(pngStruct);
+        // Check whether the image can be decoded into the destination
+        uint32_t width = (uint32_t)png_get_image_width(pngStruct, pngInfo);
+        uint32_t height = (uint32_t)png_get_image_height(pngStruct, pngInfo);
+        bool inPlace = dst && dst->data &&
+            dst->dims.width == (int)width && dst->dims.height == (int)height &&
+            (dst->fmt == atlas2d::pixel_format::rgba8 || (dst->fmt == atlas2d::pixel_format::rgb8 && !hasAlpha));
+        
+        // Add opaque alpha channel if the destination requires it
+        if (inPlace && dst->fmt == atlas2d::pixel_format::rgba8 && !hasAlpha)
+            png_set_filler(pngStruct, 0xff, PNG_FILLER_AFTER);
+        
+        int passes = png_set_interlace_handling(pngStruct);
         
         // Update the changes
         png_read_update_info(pngStruct, pngInfo);
         
-        
-        uint32_t width = (uint32_t)png_get_image_width(pngStruct, pngInfo);
-        uint32_t height = (uint32_t)png_get_image_height(pngStruct, pngInfo);
         bitdepth = png_get_bit_depth(pngStruct, pngInfo);
         channels = png_get_channels(pngStruct, pngInfo);
         uint32_t bpp = channels * bitdepth / 8;
-        uint32_t bytesInRow = width * bpp;
-        bool hasAlpha = (channels == 4);
-
-        pixelsGuard = atlas2d::raw_data_ptr((unsigned char*)malloc(sizeof(unsigned char) * width * height * bpp),
-                                        [](unsigned char* p){free(p);});
-        unsigned char* pixels = pixelsGuard.get();
+        const size_t bytesInRow = width * bpp;
         
-        // Map each image's row to the pixels array
-        {
-            
-            rowPtrsGuard = shared_ptr<png_bytep>((png_bytepp)malloc(sizeof(png_bytep)*height),
-                                                     [](png_bytepp ptr){free(ptr);});
-            png_bytepp rowPtrs = rowPtrsGuard.get();
-
+        unsigned char* pixels = nullptr;
+        if(inPlace) {
+            pixels = dst->data;
+        } else {
+            pixelsGuard = atlas2d::raw_data_ptr((unsigned char*)malloc(sizeof(unsigned char) * width * height * bpp),
+                                                [](unsigned char* p){free(p);});
+            pixels = pixelsGuard.get();
+        }
+        
+        const size_t stride = inPlace ? dst->stride : bytesInRow;
+        const atlas2d::pixel_format fmt = channels == 4 ? atlas2d::pixel_format::rgba8 : atlas2d::pixel_format::rgb8;
+        
+        // Alpha of the destination is premultiplied while the decoded row is still in the cache.
+        // A row is complete after the last interlacing pass only
+        const bool premultiply = inPlace && dst->premultiplied && hasAlpha;
+        
+        // Decode rows one by one, so no row pointers are required
+        for (int pass = 0; pass < passes; ++pass) {
             for (uint32_t i = 0; i < height; i++) {
-                rowPtrs[i] = &pixels[i * bytesInRow];
+                png_read_row(pngStruct, pixels + i * stride, nullptr);
+                if (premultiply && pass + 1 == passes)
+                    convert_row(pixels + i * stride, fmt, pixels + i * stride, fmt, width, true);
             }
-            
-            png_read_image(pngStruct, rowPtrs);
         }
 
         props.pixels = pixelsGuard;
         props.size.width = width;
         props.size.height = height;
-        props.fmt = hasAlpha ? atlas2d::pixel_format::rgba8 : atlas2d::pixel_format::rgb8;
+        props.fmt = fmt;
 
         return true;
     }
 
-    /// Writes the image to the filename png file.
-    bool writePng(std::string const& filename, image_props const& image) {
-        if(image.fmt != pixel_format::rgba8 &&
-           image.fmt != pixel_format::rgb8) {
+    /// Returns libpng filters mask of the filter
+    int pngFiltersMask(image_write_props::png_filter filter) {
+        switch (filter) {
+            case image_write_props::png_filter_none:
+                return PNG_FILTER_NONE;
+            case image_write_props::png_filter_sub:
+                return PNG_FILTER_SUB;
+            case image_write_props::png_filter_up:
+                return PNG_FILTER_UP;
+            case image_write_props::png_filter_average:
+                return PNG_FILTER_AVG;
+            case image_write_props::png_filter_paeth:
+                return PNG_FILTER_PAETH;
+            default:
+                return PNG_ALL_FILTERS;
+        }
+    }
+    
+    /// Writes rows of the png file by means of libpng on the calling thread
+    class PngRowsWriter: public image_rows_writer {
+    public:
+        ~PngRowsWriter() {
+            if(pngStruct)
+                png_destroy_write_struct(&pngStruct, &pngInfo);
+        }
+        
+        /// Opens the file and writes the header of the image
+        bool open(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+            fp = shared_ptr<FILE>(fopen(filename.c_str(), "wb"), [](FILE* fp){ if(fp) fclose(fp); });
+            if(!fp) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for write";
+                return false;
+            }
+            
+            pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+            pngInfo = pngStruct ? png_create_info_struct(pngStruct) : nullptr;
+            if(!pngStruct || !pngInfo) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error initializing png struct";
+                return false;
+            }
+            
+            if(setjmp(png_jmpbuf(pngStruct))) {
+                return false;
+            }
+            
+            png_set_error_fn(pngStruct, nullptr, &png_error, &png_warning);
+            
+            png_init_io(pngStruct, fp.get());
+            
+            if(writeProps.compression_level >= 0)
+                png_set_compression_level(pngStruct, writeProps.compression_level);
+            
+            if(writeProps.filter != image_write_props::png_filter_default)
+                png_set_filter(pngStruct, PNG_FILTER_TYPE_BASE, pngFiltersMask(writeProps.filter));
+            
+            png_set_IHDR(pngStruct,
+                         pngInfo,
+                         image.size.width,
+                         image.size.height,
+                         8,
+                         image.fmt == pixel_format::rgba8 ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
+                         PNG_INTERLACE_NONE,
+                         PNG_COMPRESSION_TYPE_BASE,
+                         PNG_FILTER_TYPE_BASE);
+            
+            png_write_info(pngStruct, pngInfo);
+            rowsLeft = image.size.height;
+            return true;
+        }
+        
+        bool write_rows(unsigned char const* rows, size_t stride, int count) override {
+            if(count > rowsLeft)
+                return false;
+            
+            if(setjmp(png_jmpbuf(pngStruct))) {
+                return false;
+            }
+            
+            for(int i = 0; i < count; ++i)
+                png_write_row(pngStruct, (png_const_bytep)(rows + i * stride));
+            
+            rowsLeft -= count;
+            return true;
+        }
+        
+        bool finish() override {
+            if(rowsLeft)
+                return false;
+            
+            if(setjmp(png_jmpbuf(pngStruct))) {
+                return false;
+            }
+            
+            png_write_end(pngStruct, pngInfo);
+            return true;
+        }
+        
+    private:
+        shared_ptr<FILE> fp;
+        png_structp pngStruct = nullptr;
+        png_infop pngInfo = nullptr;
+        int rowsLeft = 0;   ///< Number of rows to write before the end of the image
+    };
+    
+    /// Writes the image to the filename png file by means of libpng on the calling thread
+    bool writePngSingleThreaded(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+        PngRowsWriter writer;
+        if(!writer.open(filename, image, writeProps))
+            return false;
+        
+        const size_t bytesInRow = image.size.width * pixel_format_details(image.fmt).bpp;
+        return writer.write_rows(image.pixels.get(), bytesInRow, image.size.height) && writer.finish();
+    }
+    
+    /// Describes the stripe of rows compressed independently
+    struct PngStripe {
+        uint32_t firstRow = 0;          ///< The first row of the stripe
+        uint32_t rowsCount = 0;         ///< Number of rows in the stripe
+        vector<unsigned char> filtered;  ///< Filtered rows, each one prefixed with its filter type
+        vector<unsigned char> deflated;  ///< Raw deflate blocks of the filtered rows
+        uLong adler = 0;                ///< Adler-32 of the filtered rows
+    };
+    
+    /// Paeth predictor as described in the PNG specification
+    inline unsigned char paethPredictor(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if(pa <= pb && pa <= pc)
+            return (unsigned char)a;
+        return (unsigned char)(pb <= pc ? b : c);
+    }
+    
+    /// Applies the filter type to the row. The prevRow is null for the first row of the image.
+    void filterPngRow(int filterType, unsigned char const* row, unsigned char const* prevRow,
+                      size_t rowBytes, size_t bpp, unsigned char* out)
+    {
+        for(size_t i = 0; i < rowBytes; ++i) {
+            int left = i >= bpp ? row[i - bpp] : 0;
+            int up = prevRow ? prevRow[i] : 0;
+            int upLeft = prevRow && i >= bpp ? prevRow[i - bpp] : 0;
+            
+            int predicted = 0;
+            switch (filterType) {
+                case PNG_FILTER_VALUE_SUB:   predicted = left; break;
+                case PNG_FILTER_VALUE_UP:    predicted = up; break;
+                case PNG_FILTER_VALUE_AVG:   predicted = (left + up) / 2; break;
+                case PNG_FILTER_VALUE_PAETH: predicted = paethPredictor(left, up, upLeft); break;
+                default: break;
+            }
+            out[i] = (unsigned char)(row[i] - predicted);
+        }
+    }
+    
+    /// Filters the row with the filter type of the minimum sum of absolute differences. Returns the chosen filter type.
+    int filterPngRowAdaptive(unsigned char const* row, unsigned char const* prevRow,
+                             size_t rowBytes, size_t bpp, unsigned char* out, vector<unsigned char>& scratch)
+    {
+        scratch.resize(rowBytes);
+        
+        int bestFilterType = PNG_FILTER_VALUE_NONE;
+        unsigned long bestSum = ~0ul;
+        for(int filterType = PNG_FILTER_VALUE_NONE; filterType < PNG_FILTER_VALUE_LAST; ++filterType) {
+            filterPngRow(filterType, row, prevRow, rowBytes, bpp, scratch.data());
+            
+            unsigned long sum = 0;
+            for(auto v : scratch) {
+                sum += v < 128 ? v : 256 - v;
+            }
+            
+            if(sum < bestSum) {
+                bestSum = sum;
+                bestFilterType = filterType;
+                copy(scratch.begin(), scratch.end(), out);
+            }
+        }
+        
+        return bestFilterType;
+    }
+    
+    /**
+     @brief Filters rows of the stripe. Each row is prefixed with its filter type.
+     The rows follow each other and the previous row is the last one of the previous stripe (null for the first stripe).
+     */
+    void filterPngStripe(unsigned char const* rows, unsigned char const* prevRow, size_t rowBytes, size_t bpp,
+                         image_write_props::png_filter filter, PngStripe& stripe) {
+        
+        int filterType = -1;
+        switch (filter) {
+            case image_write_props::png_filter_none:    filterType = PNG_FILTER_VALUE_NONE; break;
+            case image_write_props::png_filter_sub:     filterType = PNG_FILTER_VALUE_SUB; break;
+            case image_write_props::png_filter_up:      filterType = PNG_FILTER_VALUE_UP; break;
+            case image_write_props::png_filter_average: filterType = PNG_FILTER_VALUE_AVG; break;
+            case image_write_props::png_filter_paeth:   filterType = PNG_FILTER_VALUE_PAETH; break;
+            default: break;
+        }
+        
+        stripe.filtered.resize(stripe.rowsCount * (rowBytes + 1));
+        vector<unsigned char> scratch;
+        for(uint32_t i = 0; i < stripe.rowsCount; ++i) {
+            unsigned char const* rowData = rows + i * rowBytes;
+            unsigned char const* prevRowData = i ? rowData - rowBytes : prevRow;
+            unsigned char* out = &stripe.filtered[i * (rowBytes + 1)];
+            
+            if(filterType < 0) {
+                out[0] = (unsigned char)filterPngRowAdaptive(rowData, prevRowData, rowBytes, bpp, out + 1, scratch);
+            } else {
+                out[0] = (unsigned char)filterType;
+                filterPngRow(filterType, rowData, prevRowData, rowBytes, bpp, out + 1);
+            }
+        }
+        
+        stripe.adler = adler32(adler32(0L, Z_NULL, 0), stripe.filtered.data(), (uInt)stripe.filtered.size());
+    }
+    
+    /// Compresses filtered rows of the stripe. The dictionary primes the compressor with the tail of the previous stripe.
+    bool compressPngStripe(image_write_props const& writeProps, PngStripe& stripe,
+                           vector<unsigned char> const* dictionary, bool isLast)
+    {
+        const int level = writeProps.compression_level >= 0 ? writeProps.compression_level : Z_DEFAULT_COMPRESSION;
+        const int strategy = writeProps.filter == image_write_props::png_filter_none ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+        
+        z_stream zs;
+        zs.zalloc = Z_NULL;
+        zs.zfree = Z_NULL;
+        zs.opaque = Z_NULL;
+        
+        // Raw deflate stream, as the zlib wrapper is written once for all stripes
+        if(deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, strategy) != Z_OK)
+            return false;
+        
+        shared_ptr<z_stream> zsGuard(&zs, [](z_stream* zs) { deflateEnd(zs); });
+        
+        if(dictionary && !dictionary->empty()) {
+            const size_t dictLen = (std::min)(dictionary->size(), (size_t)(1 << MAX_WBITS));
+            deflateSetDictionary(&zs, dictionary->data() + dictionary->size() - dictLen, (uInt)dictLen);
+        }
+        
+        // Reserve extra space for the sync flush marker
+        stripe.deflated.resize(deflateBound(&zs, (uLong)stripe.filtered.size()) + 16);
+        zs.next_in = stripe.filtered.data();
+        zs.avail_in = (uInt)stripe.filtered.size();
+        zs.next_out = stripe.deflated.data();
+        zs.avail_out = (uInt)stripe.deflated.size();
+        
+        // Non-final stripes are ended with the byte aligned empty block,
+        // so the stripes can be concatenated into a single deflate stream
+        const int flush = isLast ? Z_FINISH : Z_SYNC_FLUSH;
+        int res = deflate(&zs, flush);
+        while(res == Z_OK && zs.avail_out == 0) {
+            size_t used = stripe.deflated.size();
+            stripe.deflated.resize(used * 2);
+            zs.next_out = stripe.deflated.data() + used;
+            zs.avail_out = (uInt)(stripe.deflated.size() - used);
+            res = deflate(&zs, flush);
+        }
+        
+        if(isLast ? res != Z_STREAM_END : res != Z_OK) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error compressing the image stripe";
+            return false;
+        }
+        
+        stripe.deflated.resize(stripe.deflated.size() - zs.avail_out);
+        return true;
+    }
+    
+    /// Writes the PNG chunk to the file
+    bool writePngChunk(FILE* fp, char const* type, unsigned char const* data, size_t length) {
+        unsigned char header[8] = {
+            (unsigned char)(length >> 24), (unsigned char)(length >> 16),
+            (unsigned char)(length >> 8), (unsigned char)length,
+            (unsigned char)type[0], (unsigned char)type[1], (unsigned char)type[2], (unsigned char)type[3]
+        };
+        
+        uLong crc = crc32(0L, header + 4, 4);
+        if(length)
+            crc = crc32(crc, data, (uInt)length);
+        
+        unsigned char footer[4] = {
+            (unsigned char)(crc >> 24), (unsigned char)(crc >> 16),
+            (unsigned char)(crc >> 8), (unsigned char)crc
+        };
+        
+        return fwrite(header, 1, sizeof(header), fp) == sizeof(header) &&
+            (!length || fwrite(data, 1, length, fp) == length) &&
+            fwrite(footer, 1, sizeof(footer), fp) == sizeof(footer);
+    }
+    
+    /// Returns the number of rows in stripes of the image compressed in parallel
+    uint32_t pngStripeRows(size_t rowBytes, uint32_t height, size_t workers) {
+        // Each stripe holds at least 256KB of pixels to keep the compression ratio
+        const size_t minStripeRows = (std::max)((size_t)1, (size_t)(256 * 1024) / rowBytes);
+        const size_t stripesCount = (std::max)((size_t)1, (std::min)(workers * 4, height / minStripeRows));
+        return (uint32_t)((height + stripesCount - 1) / stripesCount);
+    }
+    
+    /// Writes the PNG signature, the image header and the zlib header of stripes compressed in parallel
+    bool writePngStripedHeader(FILE* fp, atlas2d::size const& dims, pixel_format fmt, image_write_props const& writeProps) {
+        static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+        bool isOk = fwrite(signature, 1, sizeof(signature), fp) == sizeof(signature);
+        
+        // Image header
+        const uint32_t width = dims.width;
+        const uint32_t height = dims.height;
+        unsigned char ihdr[13] = {
+            (unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+            (unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+            8,
+            (unsigned char)(fmt == pixel_format::rgba8 ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB),
+            PNG_COMPRESSION_TYPE_BASE,
+            PNG_FILTER_TYPE_BASE,
+            PNG_INTERLACE_NONE
+        };
+        isOk = isOk && writePngChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+        
+        // Zlib header: deflate with 32K window and the level hint
+        const int level = writeProps.compression_level;
+        const unsigned char cmf = 0x78;
+        unsigned char flg = (unsigned char)((level >= 0 && level < 2 ? 0 :
+                                             level >= 2 && level < 6 ? 1 :
+                                             level == 6 || level < 0 ? 2 : 3) << 6);
+        flg = (unsigned char)(flg + 31 - (cmf * 256 + flg) % 31);
+        
+        const unsigned char zlibHeader[2] = {cmf, flg};
+        return isOk && writePngChunk(fp, "IDAT", zlibHeader, sizeof(zlibHeader));
+    }
+    
+    /// Writes the zlib trailer with the checksum of all filtered rows and ends the PNG file
+    bool writePngStripedTrailer(FILE* fp, uLong adler) {
+        unsigned char zlibTrailer[4] = {
+            (unsigned char)(adler >> 24), (unsigned char)(adler >> 16),
+            (unsigned char)(adler >> 8), (unsigned char)adler
+        };
+        return writePngChunk(fp, "IDAT", zlibTrailer, sizeof(zlibTrailer)) &&
+            writePngChunk(fp, "IEND", nullptr, 0);
+    }
+    
+    /**
+     @brief Writes the image to the filename png file compressing its stripes in parallel.
+     Each stripe of rows is filtered and deflated independently on the pool (primed with the tail of
+     the previous stripe as a dictionary) and all the stripes are joined into a single zlib stream.
+     */
+    bool writePngStriped(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+        const size_t bpp = pixel_format_details(image.fmt).bpp;
+        const size_t rowBytes = image.size.width * bpp;
+        const uint32_t height = image.size.height;
+        if(!height || !rowBytes)
             return false;
+        
+        const uint32_t stripeRows = pngStripeRows(rowBytes, height, writeProps.pool->size());
+        
+        vector<PngStripe> stripes;
+        for(uint32_t row = 0; row < height; row += stripeRows) {
+            stripes.push_back(PngStripe());
+            stripes.back().firstRow = row;
+            stripes.back().rowsCount = (std::min)(stripeRows, height - row);
+        }
+        
+        // Filter all the stripes first, as each stripe uses the previous one as a dictionary
+        vector<future<void>> filtering;
+        for(auto& stripe : stripes) {
+            auto* stripePtr = &stripe;
+            filtering.push_back(writeProps.pool->submit([&image, &writeProps, stripePtr, rowBytes, bpp]() {
+                unsigned char const* rows = image.pixels.get() + stripePtr->firstRow * rowBytes;
+                filterPngStripe(rows, stripePtr->firstRow ? rows - rowBytes : nullptr, rowBytes, bpp,
+                                writeProps.filter, *stripePtr);
+            }));
+        }
+        for(auto& res : filtering) {
+            res.get();
         }
         
-        shared_ptr<FILE> fp(fopen(filename.c_str(), "wb"), [](FILE* fp){ fclose(fp); });
+        vector<future<bool>> pending;
+        for(size_t i = 0; i < stripes.size(); ++i) {
+            auto* stripe = &stripes[i];
+            auto const* dictionary = i ? &stripes[i - 1].filtered : nullptr;
+            bool isLast = i + 1 == stripes.size();
+            pending.push_back(writeProps.pool->submit([&writeProps, stripe, dictionary, isLast]() {
+                return compressPngStripe(writeProps, *stripe, dictionary, isLast);
+            }));
+        }
+        
+        bool isOk = true;
+        for(auto& res : pending) {
+            isOk = res.get() && isOk;
+        }
+        if(!isOk)
+            return false;
+        
+        shared_ptr<FILE> fp(fopen(filename.c_str(), "wb"), [](FILE* fp){ if(fp) fclose(fp); });
         if(!fp) {
             CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for write";
             return false;
         }
         
-        png_structp pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-        png_infop pngInfo = png_create_info_struct(pngStruct);
+        isOk = writePngStripedHeader(fp.get(), image.size, image.fmt, writeProps);
         
-        shared_ptr<png_struct> pngGuard(pngStruct, [&](png_structp){
-            png_destroy_write_struct(&pngStruct, &pngInfo);
-        });
+        uLong adler = adler32(0L, Z_NULL, 0);
+        for(auto const& stripe : stripes) {
+            adler = adler32_combine(adler, stripe.adler, (z_off_t)stripe.filtered.size());
+            isOk = isOk && writePngChunk(fp.get(), "IDAT", stripe.deflated.data(), stripe.deflated.size());
+        }
         
-        shared_ptr<png_bytep> rowPtrsGuard;
-        atlas2d::raw_data_ptr pixelsGuard;
+        isOk = isOk && writePngStripedTrailer(fp.get(), adler);
         
-        if(!pngStruct || !pngInfo) {
-            CLOG(ERROR, MODULE_LOGGER) << "Error initializing png struct";
+        if(!isOk) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing " << filename;
+        }
+        
+        return isOk;
+    }
+    
+    /**
+     @brief Writes rows of the png file compressing its stripes in parallel as soon as they are filled.
+     The stripes are the same as writePngStriped makes, so is the file. At most kPendingPngStripes filled
+     stripes are filtered and compressed while the next one is filled, so the memory doesn't grow with the image.
+     */
+    class PngStripedRowsWriter: public image_rows_writer {
+    public:
+        ~PngStripedRowsWriter() {
+            // Don't leave unfinished compression behind
+            for(auto const& stripe : pending) {
+                if(stripe->compression.valid())
+                    stripe->compression.wait();
+                else
+                    stripe->filtering.wait();
+            }
+        }
+        
+        /// Opens the file and writes the header of the image
+        bool open(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+            props = writeProps;
+            bpp = pixel_format_details(image.fmt).bpp;
+            rowBytes = image.size.width * bpp;
+            height = image.size.height;
+            if(!height || !rowBytes)
+                return false;
+            
+            stripeRows = pngStripeRows(rowBytes, height, writeProps.pool->size());
+            
+            fp = shared_ptr<FILE>(fopen(filename.c_str(), "wb"), [](FILE* fp){ if(fp) fclose(fp); });
+            if(!fp) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for write";
+                return false;
+            }
+            
+            adler = adler32(0L, Z_NULL, 0);
+            return writePngStripedHeader(fp.get(), image.size, image.fmt, writeProps);
+        }
+        
+        bool write_rows(unsigned char const* rows, size_t stride, int count) override {
+            for(int i = 0; i < count; ++i) {
+                if(nextRow >= height)
+                    return false;
+                
+                if(!filling) {
+                    // The previous row goes first as the filters of the first row refer to it
+                    filling = make_shared<PendingStripe>();
+                    filling->stripe.firstRow = nextRow;
+                    filling->stripe.rowsCount = (std::min)(stripeRows, height - nextRow);
+                    filling->rows.reserve((filling->stripe.rowsCount + 1) * rowBytes);
+                    filling->rows.assign(lastRow.begin(), lastRow.end());
+                }
+                
+                unsigned char const* row = rows + i * stride;
+                filling->rows.insert(filling->rows.end(), row, row + rowBytes);
+                ++nextRow;
+                
+                if(nextRow == filling->stripe.firstRow + filling->stripe.rowsCount) {
+                    lastRow.assign(row, row + rowBytes);
+                    if(!submitFilling())
+                        return false;
+                }
+            }
+            return true;
+        }
+        
+        bool finish() override {
+            if(nextRow != height)
+                return false;
+            
+            while(!pending.empty()) {
+                if(!writeFront())
+                    return false;
+            }
+            
+            if(!writePngStripedTrailer(fp.get(), adler)) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error writing the png file";
+                return false;
+            }
+            return true;
+        }
+        
+    private:
+        /// The stripe waiting for its compression
+        struct PendingStripe {
+            PngStripe stripe;
+            vector<unsigned char> rows;     ///< The previous row and rows of the stripe until they are filtered
+            future<void> filtering;
+            future<bool> compression;
+        };
+        using pending_stripe_ptr = shared_ptr<PendingStripe>;
+        
+        // Filters the filled stripe on the pool and compresses the previous ones, which are filtered by now
+        bool submitFilling() {
+            auto stripe = move(filling);
+            const size_t rowBytes = this->rowBytes;
+            const size_t bpp = this->bpp;
+            const auto filter = props.filter;
+            stripe->filtering = props.pool->submit([stripe, rowBytes, bpp, filter]() {
+                const bool hasPrevRow = stripe->stripe.firstRow > 0;
+                unsigned char const* rows = stripe->rows.data();
+                filterPngStripe(hasPrevRow ? rows + rowBytes : rows, hasPrevRow ? rows : nullptr,
+                                rowBytes, bpp, filter, stripe->stripe);
+                vector<unsigned char>().swap(stripe->rows);
+            });
+            
+            for(auto const& prev : pending) {
+                if(!prev->compression.valid())
+                    compress(prev);
+            }
+            pending.push_back(stripe);
+            
+            while(pending.size() > kPendingPngStripes) {
+                if(!writeFront())
+                    return false;
+            }
+            return true;
+        }
+        
+        // Compresses the stripe on the pool with the previous one as the dictionary. Stripes are compressed in order
+        void compress(pending_stripe_ptr const& stripe) {
+            stripe->filtering.get();
+            
+            // Tasks get settings of the compressor only, as they must not hold the pool
+            auto dictionary = lastCompressed;
+            auto writeProps = image_write_props()
+            .set_compression_level(props.compression_level)
+            .set_png_filter(props.filter);
+            const bool isLast = stripe->stripe.firstRow + stripe->stripe.rowsCount == height;
+            stripe->compression = props.pool->submit([stripe, dictionary, writeProps, isLast]() {
+                return compressPngStripe(writeProps, stripe->stripe,
+                                         dictionary ? &dictionary->stripe.filtered : nullptr, isLast);
+            });
+            lastCompressed = stripe;
+        }
+        
+        // Writes the first pending stripe once it's compressed
+        bool writeFront() {
+            auto stripe = pending.front();
+            if(!stripe->compression.valid())
+                compress(stripe);
+            
+            pending.pop_front();
+            if(!stripe->compression.get())
+                return false;
+            
+            adler = adler32_combine(adler, stripe->stripe.adler, (z_off_t)stripe->stripe.filtered.size());
+            if(!writePngChunk(fp.get(), "IDAT", stripe->stripe.deflated.data(), stripe->stripe.deflated.size())) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error writing the png file";
+                return false;
+            }
+            
+            // The deflated data isn't needed anymore, the filtered rows are kept as the dictionary of the next stripe
+            vector<unsigned char>().swap(stripe->stripe.deflated);
+            return true;
+        }
+        
+        static const size_t kPendingPngStripes = 2;
+        
+        image_write_props props;
+        shared_ptr<FILE> fp;
+        size_t bpp = 0;
+        size_t rowBytes = 0;
+        uint32_t height = 0;
+        uint32_t stripeRows = 0;
+        uint32_t nextRow = 0;               ///< The next row to write
+        vector<unsigned char> lastRow;      ///< The last row of the last filled stripe
+        pending_stripe_ptr filling;         ///< The stripe being filled
+        pending_stripe_ptr lastCompressed;  ///< The last stripe submitted for compression
+        deque<pending_stripe_ptr> pending;  ///< Filled stripes in the order of rows
+        uLong adler = 0;                    ///< Adler-32 of the written stripes
+    };
+    
+    /// Opens the png file to write by rows. Stripes are compressed in parallel like writePng does
+    image_rows_writer_ptr openPngRows(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+        if(image.fmt != pixel_format::rgba8 &&
+           image.fmt != pixel_format::rgb8) {
+            return nullptr;
+        }
+        
+        if(writeProps.pool && writeProps.pool->size() > 1) {
+            auto writer = make_shared<PngStripedRowsWriter>();
+            return writer->open(filename, image, writeProps) ? writer : nullptr;
+        }
+        
+        auto writer = make_shared<PngRowsWriter>();
+        return writer->open(filename, image, writeProps) ? writer : nullptr;
+    }
+    
+    /// Writes the image to the filename png file.
+    bool writePng(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+        if(image.fmt != pixel_format::rgba8 &&
+           image.fmt != pixel_format::rgb8) {
             return false;
         }
         
-        if(setjmp(png_jmpbuf(pngStruct))) {
+        if(writeProps.pool && writeProps.pool->size() > 1)
+            return writePngStriped(filename, image, writeProps);
+        
+        return writePngSingleThreaded(filename, image, writeProps);
+    }
+    
+    /// Appends the value in little-endian byte order
+    void putKtxU32(vector<unsigned char>& out, uint32_t value) {
+        out.push_back((unsigned char)(value & 0xff));
+        out.push_back((unsigned char)((value >> 8) & 0xff));
+        out.push_back((unsigned char)((value >> 16) & 0xff));
+        out.push_back((unsigned char)((value >> 24) & 0xff));
+    }
+    
+    /**
+     @brief Writes the levels of the image to the filename KTX 1.1 file compressed into ETC2.
+     rgb8 images are stored as GL_COMPRESSED_RGB8_ETC2 and rgba8 ones as GL_COMPRESSED_RGBA8_ETC2_EAC.
+     The first level is the base one and the rest are its mipmaps. The first row of each level is the top one,
+     as the KTXorientation key tells.
+     */
+    bool writeKtxLevels(std::string const& filename, std::vector<image_props> const& levels, image_write_props const& writeProps) {
+        const uint32_t glCompressedRgb8Etc2 = 0x9274;
+        const uint32_t glCompressedRgba8Etc2Eac = 0x9278;
+        const uint32_t glRgb = 0x1907;
+        const uint32_t glRgba = 0x1908;
+        
+        if(levels.empty())
             return false;
+        
+        auto const& image = levels.front();
+        const auto startTime = chrono::steady_clock::now();
+        vector<vector<unsigned char>> blocks(levels.size());
+        for(size_t i = 0; i < levels.size(); ++i) {
+            if(levels[i].fmt != image.fmt || !encode_etc2(levels[i], writeProps.pool, blocks[i])) {
+                CLOG(ERROR, MODULE_LOGGER) << "Unsupported pixel format of " << filename;
+                return false;
+            }
         }
         
-        png_set_error_fn(pngStruct, nullptr, &png_error, &png_warning);
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+        CLOG(INFO, MODULE_LOGGER) << "Encoded ETC2 blocks of " << filename << " in " << elapsed.count() << "s";
         
-        png_init_io(pngStruct, fp.get());
+        static const unsigned char identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+        static const char orientationKey[] = "KTXorientation";
+        static const char orientationValue[] = "S=r,T=d";
         
-        png_set_IHDR(pngStruct,
-                     pngInfo,
-                     image.size.width,
-                     image.size.height,
-                     8,
-                     image.fmt == pixel_format::rgba8 ? PNG_COLOR_TYPE_RGB_ALPHA : PNG_COLOR_TYPE_RGB,
-                     PNG_INTERLACE_NONE,
-                     PNG_COMPRESSION_TYPE_BASE,
-                     PNG_FILTER_TYPE_BASE);
+        // Key and value are zero terminated and the pair is padded to 4 bytes
+        const uint32_t keyValueSize = (uint32_t)(sizeof(orientationKey) + sizeof(orientationValue));
+        const uint32_t keyValuePadding = (4 - keyValueSize % 4) % 4;
         
-        rowPtrsGuard = shared_ptr<png_bytep>(new png_bytep[image.size.height], [](png_bytepp ptr){
-            delete [] ptr;
-        });
+        const bool hasAlpha = image.fmt == pixel_format::rgba8;
+        vector<unsigned char> header(identifier, identifier + sizeof(identifier));
+        putKtxU32(header, 0x04030201);    // endianness
+        putKtxU32(header, 0);             // glType of compressed textures
+        putKtxU32(header, 1);             // glTypeSize
+        putKtxU32(header, 0);             // glFormat of compressed textures
+        putKtxU32(header, hasAlpha ? glCompressedRgba8Etc2Eac : glCompressedRgb8Etc2);
+        putKtxU32(header, hasAlpha ? glRgba : glRgb);
+        putKtxU32(header, (uint32_t)image.size.width);
+        putKtxU32(header, (uint32_t)image.size.height);
+        putKtxU32(header, 0);             // pixelDepth
+        putKtxU32(header, 0);             // numberOfArrayElements
+        putKtxU32(header, 1);             // numberOfFaces
+        putKtxU32(header, (uint32_t)levels.size()); // numberOfMipmapLevels
+        putKtxU32(header, 4 + keyValueSize + keyValuePadding);
         
-        png_bytepp rowPtrs = rowPtrsGuard.get();
-        unsigned char* pixels = image.pixels.get();
-        uint32_t bpp = pixel_format_details(image.fmt).bpp;
-        uint32_t bytesInRow = image.size.width * bpp;
+        putKtxU32(header, keyValueSize);
+        header.insert(header.end(), orientationKey, orientationKey + sizeof(orientationKey));
+        header.insert(header.end(), orientationValue, orientationValue + sizeof(orientationValue));
+        header.insert(header.end(), keyValuePadding, 0);
         
-        for (uint32_t i = 0; i < image.size.height; i++) {
-            rowPtrs[i] = (png_bytep)(&pixels[i * bytesInRow]);
+        shared_ptr<FILE> fp(fopen(filename.c_str(), "wb"), [](FILE* fp){ if(fp) fclose(fp); });
+        if(!fp) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error openening " << filename << " for write";
+            return false;
         }
         
-        png_set_rows(pngStruct, pngInfo, rowPtrs);
-        
-        png_write_png(pngStruct, pngInfo, PNG_TRANSFORM_IDENTITY, NULL);
+        // Blocks are multiples of 4 bytes, so levels need no padding
+        bool isOk = fwrite(header.data(), 1, header.size(), fp.get()) == header.size();
+        for(auto const& levelBlocks : blocks) {
+            vector<unsigned char> imageSize;
+            putKtxU32(imageSize, (uint32_t)levelBlocks.size());
+            isOk = isOk &&
+                fwrite(imageSize.data(), 1, imageSize.size(), fp.get()) == imageSize.size() &&
+                fwrite(levelBlocks.data(), 1, levelBlocks.size(), fp.get()) == levelBlocks.size();
+        }
+        if(!isOk) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing " << filename;
+        }
         
-        return true;
+        return isOk;
+    }
+    
+    /// Writes the image to the filename KTX 1.1 file compressed into ETC2 as a single level
+    bool writeKtx(std::string const& filename, image_props const& image, image_write_props const& writeProps) {
+        return writeKtxLevels(filename, vector<image_props>(1, image), writeProps);
     }
     
     /// Describes specific image format and acts as an item of a "set" container
@@ -216,6 +954,9 @@ namespace {
         string ext;
         img_reader reader;
         img_writer writer;
+        img_levels_writer levels_writer;
+        img_rows_opener rows_opener;
+        int block_dim = 1;
         
         image_ext() { ;; }
         explicit image_ext(string _ext): ext(move(_ext)) { ;; }
@@ -223,6 +964,9 @@ namespace {
         Self& set_ext(string arg) { ext = move(arg); return *this; }
         Self& set_reader(img_reader arg) { reader = move(arg); return *this; }
         Self& set_writer(img_writer arg) { writer = move(arg); return *this; }
+        Self& set_levels_writer(img_levels_writer arg) { levels_writer = move(arg); return *this; }
+        Self& set_rows_opener(img_rows_opener arg) { rows_opener = move(arg); return *this; }
+        Self& set_block_dim(int arg) { block_dim = arg; return *this; }
 
         bool operator<(image_ext const& tbl) const {
             return ext < tbl.ext;
@@ -232,7 +976,8 @@ namespace {
     /// Returns table of supported formats to load or save
     std::set<image_ext> const& ext_table() {
         static std::set<image_ext> table = {
-            image_ext(".png").set_reader(&readPng).set_writer(&writePng)
+            image_ext(".png").set_reader(&readPng).set_writer(&writePng).set_rows_opener(&openPngRows),
+            image_ext(".ktx").set_writer(&writeKtx).set_levels_writer(&writeKtxLevels).set_block_dim(etc2_block_dim)
         };
         
         return table;
@@ -260,20 +1005,103 @@ image_ext const* find_image_ext(string const& filename) {
 
 bool read_image(std::string const& filename, image_props& props, bool load_pixels) {
     auto processor = find_image_ext(filename);
-    if(!processor) {
+    if(!processor || !processor->reader) {
         CLOG(ERROR, MODULE_LOGGER) << "Unknown format of the file " << filename;
         return false;
     }
 
-    return processor->reader(filename, props, load_pixels);
+    return processor->reader(filename, props, load_pixels, nullptr);
 }
 
-bool write_image(std::string const& filename, image_props const& props) {
+bool read_image_into(std::string const& filename, image_props& props, pixel_buffer const& dst) {
     auto processor = find_image_ext(filename);
-    if(!processor) {
+    if(!processor || !processor->reader) {
         CLOG(ERROR, MODULE_LOGGER) << "Unknown format of the file " << filename;
         return false;
     }
+    
+    return processor->reader(filename, props, true, &dst);
+}
 
-    return processor->writer(filename, props);
+bool is_image_writable(std::string const& filename) {
+    auto processor = find_image_ext(filename);
+    return processor && processor->writer;
+}
+
+bool is_image_rows_writable(std::string const& filename) {
+    auto processor = find_image_ext(filename);
+    return processor && processor->rows_opener;
+}
+
+int image_block_dim(std::string const& filename) {
+    auto processor = find_image_ext(filename);
+    return processor ? processor->block_dim : 1;
+}
+
+bool write_image(std::string const& filename, image_props const& props, image_write_props const& write_props) {
+    auto processor = find_image_ext(filename);
+    if(!processor || !processor->writer) {
+        CLOG(ERROR, MODULE_LOGGER) << "Unknown format of the file " << filename;
+        return false;
+    }
+    
+    const auto startTime = chrono::steady_clock::now();
+    if(!processor->writer(filename, props, write_props))
+        return false;
+    
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    boost::system::error_code ec;
+    CLOG(INFO, MODULE_LOGGER) << "Encoded " << filename << " in "
+    << elapsed.count() << "s, "
+    << fs::file_size(filename, ec) << " bytes";
+    
+    return true;
+}
+
+image_rows_writer_ptr open_image_rows(std::string const& filename, image_props const& props,
+                                      image_write_props const& write_props) {
+    auto processor = find_image_ext(filename);
+    if(!processor || !processor->rows_opener) {
+        CLOG(ERROR, MODULE_LOGGER) << "The file " << filename << " can't be written by rows";
+        return nullptr;
+    }
+    
+    return processor->rows_opener(filename, props, write_props);
+}
+
+bool write_image_levels(std::string const& filename, std::vector<image_props> const& levels,
+                        image_write_props const& write_props) {
+    if(levels.empty())
+        return false;
+    
+    auto processor = find_image_ext(filename);
+    if(!processor || !processor->writer) {
+        CLOG(ERROR, MODULE_LOGGER) << "Unknown format of the file " << filename;
+        return false;
+    }
+    
+    if(processor->levels_writer) {
+        const auto startTime = chrono::steady_clock::now();
+        if(!processor->levels_writer(filename, levels, write_props))
+            return false;
+        
+        const chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+        boost::system::error_code ec;
+        CLOG(INFO, MODULE_LOGGER) << "Encoded " << levels.size() << " levels of " << filename << " in "
+        << elapsed.count() << "s, "
+        << fs::file_size(filename, ec) << " bytes";
+        return true;
+    }
+    
+    // Formats without mip levels get a file per level
+    if(!write_image(filename, levels.front(), write_props))
+        return false;
+    
+    const fs::path path(filename);
+    for(size_t i = 1; i < levels.size(); ++i) {
+        auto levelFile = path.parent_path() / (path.stem().string() + "_mip" + to_string(i) + path.extension().string());
+        if(!write_image(levelFile.generic_string(), levels[i], write_props))
+            return false;
+    }
+    return true;
 }
@@ -1,9 +1,81 @@
 #pragma once
 
 #include "forwards.hpp"
+#include <vector>
+
+/// Image encoding settings
+struct image_write_props {
+    using props = image_write_props;
+    
+    /// Row filters of the PNG encoder
+    enum png_filter {
+        png_filter_default = 0, ///< Let the encoder choose
+        png_filter_none,        ///< No filtering
+        png_filter_sub,         ///< Difference with the left pixel
+        png_filter_up,          ///< Difference with the upper pixel
+        png_filter_average,     ///< Difference with the average of the left and upper pixels
+        png_filter_paeth,       ///< Paeth predictor
+        png_filter_adaptive,    ///< Choose the best filter for each row
+    };
+    
+    int compression_level = -1;                 ///< Zlib compression level in [0,9] range (-1 - default level)
+    png_filter filter = png_filter_default;     ///< PNG row filter
+    thread_pool_ptr pool;                       ///< Worker threads to compress image stripes on
+    
+    /// Sets zlib compression level
+    props& set_compression_level(int arg) {compression_level=arg; return *this;}
+    /// Sets PNG row filter
+    props& set_png_filter(png_filter arg) {filter=arg; return *this;}
+    /// Sets worker threads to compress image stripes on. The image is compressed on the calling thread by default
+    props& set_thread_pool(thread_pool_ptr arg) {pool=std::move(arg); return *this;}
+};
+
+/// Writer of an image by rows going from the top one to the bottom one
+class image_rows_writer {
+public:
+    virtual ~image_rows_writer() { ;; }
+    
+    /// Writes the next rows of pixels, which are stride bytes apart
+    virtual bool write_rows(unsigned char const* rows, size_t stride, int count) = 0;
+    
+    /// Finishes the file once all rows of the image are written
+    virtual bool finish() = 0;
+};
 
 /// Reads image from file
 bool read_image(std::string const& filename, image_props& props, bool load_pixels=false);
 
+/**
+ @brief Reads image pixels straight into the destination buffer.
+ Falls back to loading pixels as read_image does if the image doesn't match dimensions
+ or pixel format of the destination. props.pixels stays empty if the pixels were decoded into the destination.
+ */
+bool read_image_into(std::string const& filename, image_props& props, pixel_buffer const& dst);
+
+/// Checks whether images can be written to files of the filename's extension
+bool is_image_writable(std::string const& filename);
+
+/// Checks whether images can be written to files of the filename's extension by rows
+bool is_image_rows_writable(std::string const& filename);
+
+/// Returns the side of pixel blocks images of the filename's extension are compressed by (1 - not compressed by blocks)
+int image_block_dim(std::string const& filename);
+
 /// Writes image to file
-bool write_image(std::string const& filename, image_props const& props);
+bool write_image(std::string const& filename, image_props const& props,
+                 image_write_props const& write_props = image_write_props());
+
+/**
+ @brief Opens the file to write the image of the props' size and pixel format by rows. Pixels of the props are ignored.
+ The file is the same as write_image makes of the whole image. Returns null if the format can't be written by rows (only .png can).
+ */
+image_rows_writer_ptr open_image_rows(std::string const& filename, image_props const& props,
+                                      image_write_props const& write_props = image_write_props());
+
+/**
+ @brief Writes the image followed by its mip levels.
+ Formats with mipmaps (.ktx) keep all levels in the file. Others get a file per level
+ named after the image with the level number: atlas.png, atlas_mip1.png, atlas_mip2.png...
+ */
+bool write_image_levels(std::string const& filename, std::vector<image_props> const& levels,
+                        image_write_props const& write_props = image_write_props());
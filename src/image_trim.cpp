@@ -0,0 +1,130 @@
+#include "image_trim.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_TRIM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    const int kRgbaBpp = 4;
+    const int kAlphaChannel = 3;
+    
+#ifdef IMAGE_TRIM_SSE2
+    // Returns true if any of four rgba pixels has non-zero alpha
+    bool hasAlpha4(unsigned char const* pixels) {
+        const __m128i alphaMask = _mm_set1_epi32((int)0xFF000000);
+        __m128i alpha = _mm_and_si128(_mm_loadu_si128((__m128i const*)pixels), alphaMask);
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xFFFF;
+    }
+#endif
+    
+    // Returns the first pixel of the rgba row in [from, to) with non-zero alpha or `to` if there is none
+    int findFirstAlpha(unsigned char const* row, int from, int to) {
+        int x = from;
+#ifdef IMAGE_TRIM_SSE2
+        // skip transparent pixels by four, the found block is refined below
+        for(; x + 4 <= to && !hasAlpha4(row + x * kRgbaBpp); x += 4) {
+            ;;
+        }
+#endif
+        for(; x < to; ++x) {
+            if(row[x * kRgbaBpp + kAlphaChannel])
+                return x;
+        }
+        return to;
+    }
+    
+    // Returns the last pixel of the rgba row in [from, to) with non-zero alpha or `from - 1` if there is none
+    int findLastAlpha(unsigned char const* row, int from, int to) {
+        int x = to;
+#ifdef IMAGE_TRIM_SSE2
+        for(; x - 4 >= from && !hasAlpha4(row + (x - 4) * kRgbaBpp); x -= 4) {
+            ;;
+        }
+#endif
+        for(; x > from; --x) {
+            if(row[(x - 1) * kRgbaBpp + kAlphaChannel])
+                return x - 1;
+        }
+        return from - 1;
+    }
+    
+} // anonymous
+
+void find_alpha_bounds(image_props const& image, rect& bounds) {
+    const int width = image.size.width;
+    const int height = image.size.height;
+    bounds = rect(0, 0, width, height);
+    if(!image.pixels || image.fmt != pixel_format::rgba8 || width <= 0 || height <= 0)
+        return;
+    
+    unsigned char const* pixels = image.pixels.get();
+    const size_t stride = (size_t)width * kRgbaBpp;
+    auto rowAt = [pixels, stride](int y) {
+        return pixels + y * stride;
+    };
+    
+    // The top and the bottom rows are found by whole rows
+    int top = 0;
+    while(top < height && findFirstAlpha(rowAt(top), 0, width) == width)
+        ++top;
+    
+    if(top == height) {
+        bounds = rect();
+        return;
+    }
+    
+    int bottom = height - 1;
+    while(bottom > top && findFirstAlpha(rowAt(bottom), 0, width) == width)
+        --bottom;
+    
+    // Then each row is scanned only outside of the found columns
+    int left = width;
+    int right = -1;
+    for(int y = top; y <= bottom; ++y) {
+        auto row = rowAt(y);
+        left = findFirstAlpha(row, 0, left);
+        right = (std::max)(right, findLastAlpha(row, right + 1, width));
+    }
+    
+    bounds = rect(left, top, right - left + 1, bottom - top + 1);
+}
+
+void copy_image_area(image_props const& image, rect const& area, unsigned char* dst) {
+    const size_t bpp = pixel_format_details(image.fmt).bpp;
+    const size_t srcStride = image.size.width * bpp;
+    const size_t dstStride = area.width * bpp;
+    
+    unsigned char const* src = image.pixels.get() + area.y * srcStride + area.x * bpp;
+    for(int y = 0; y < area.height; ++y) {
+        // rows of the cropped image never overtake the source ones
+        memmove(dst + y * dstStride, src + y * srcStride, dstStride);
+    }
+}
+
+bool trim_image(atlas_item& item) {
+    if(!item.pixels)
+        return false;
+    
+    rect bounds;
+    find_alpha_bounds(item, bounds);
+    if(bounds.width <= 0 || bounds.height <= 0)
+        bounds = rect(0, 0, 1, 1);
+    
+    if(bounds.width == item.size.width && bounds.height == item.size.height)
+        return true;
+    
+    copy_image_area(item, bounds, item.pixels.get());
+    item.source_size = item.size;
+    item.trim_offset = offset(bounds.x, bounds.y);
+    item.size = size(bounds.width, bounds.height);
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "forwards.hpp"
+
+/**
+ @brief Finds the bounding box of the image pixels with non-zero alpha.
+ Images without alpha channel or loaded pixels are bounded by their size.
+ The box of a fully transparent image is empty.
+ */
+void find_alpha_bounds(image_props const& image, rect& bounds);
+
+/**
+ @brief Copies the area of the image into the contiguous destination buffer.
+ The destination can be the image pixels themselves, so the image is cropped in place.
+ */
+void copy_image_area(image_props const& image, rect const& area, unsigned char* dst);
+
+/**
+ @brief Trims transparent borders of the item's image in place.
+ Pixels of the item have to be loaded. The item's size becomes the trimmed one,
+ the source size and the trim offset are set if anything was trimmed.
+ A fully transparent image is trimmed to its top left pixel.
+ */
+bool trim_image(atlas_item& item);
@@ -1,9 +1,12 @@
 #include "image_writer_node.hpp"
 #include "helpers.hpp"
+#include "image_blit.hpp"
 #include "image_io.hpp"
+#include "image_trim.hpp"
 #include <atlas2d/pixel_format.hpp>
 #include <atlas2d/raw_image.hpp>
 #include <png.h>
+#include <vector>
 #include <easylogging++.h>
 
 #define MODULE_LOGGER "image_writer"
@@ -14,6 +17,171 @@ using namespace ::std;
 struct image_writer_node::Pimpl: image_writer_props {
     raw_image rawImage;             ///< Raw image to map atlas items into
     bool premultipleAlpha = false;  ///< Alpha premultiple flag
+    int padding = 0;                ///< Padding between atlas items
+    vector<unsigned char> trimmed;  ///< Pixels of the trimmed rect of the last source image
+    vector<rect> cells;             ///< Cells of the atlas items with their paddings
+    vector<vector<unsigned char>> mipPixels; ///< Pixels of the mip levels
+    atlas_props atlas;              ///< Properties of the active atlas
+    image_rows_writer_ptr rowsWriter; ///< Writer of finished rows of the atlas drawn by stripes
+    vector<unsigned char> window;   ///< Unfinished rows of the atlas drawn by stripes
+    int windowTop = 0;              ///< The first row of the window
+    
+    /**
+     Crops the source image of the trimmed item to its trimmed rect.
+     Images which are already trimmed are drawn as is.
+     */
+    bool cropTrimmed(atlas_item const& item, image_props& image) {
+        image = item;
+        if(item.source_size.width <= 0 ||
+           item.size.width != item.source_size.width ||
+           item.size.height != item.source_size.height)
+            return true;
+        
+        rect area(item.trim_offset.x, item.trim_offset.y,
+                  item.rotated ? item.box.height : item.box.width,
+                  item.rotated ? item.box.width : item.box.height);
+        if(area.x < 0 || area.y < 0 ||
+           area.x + area.width > item.size.width ||
+           area.y + area.height > item.size.height) {
+            CLOG(ERROR, MODULE_LOGGER) << "The trimmed rect is out of the image " << item.image_path;
+            return false;
+        }
+        
+        trimmed.resize((size_t)area.width * area.height * pixel_format_details(item.fmt).bpp);
+        copy_image_area(item, area, trimmed.data());
+        image.size = size(area.width, area.height);
+        image.pixels = details::unowned_ptr(trimmed.data());
+        return true;
+    }
+    
+    // Returns the whole atlas image as the pixel buffer
+    pixel_buffer atlasBuffer() {
+        auto const& imageProps = rawImage.props();
+        pixel_buffer buffer;
+        buffer.stride = imageProps.dimensions.width * pixel_format_details(imageProps.format).bpp;
+        buffer.data = rawImage.get_raw_pixels();
+        buffer.dims = imageProps.dimensions;
+        buffer.fmt = imageProps.format;
+        buffer.premultiplied = premultipleAlpha;
+        return buffer;
+    }
+    
+    /**
+     Draws the image of the item into the target, which starts from the row of the atlas, by the blit kernels
+     and mirrors its padding. Returns false if the image needs the generic filling of the raw_image.
+     */
+    bool blitImage(atlas_item const& item, image_props const& image, pixel_buffer const& target, int targetTop) {
+        offset at(item.box.x + padding, item.box.y + padding - targetTop);
+        if(!blit_image(image, item.rotated, target, at))
+            return false;
+        
+        if(padding > 0) {
+            mirror_padding(target, rect(at.x, at.y,
+                                        item.rotated ? image.size.height : image.size.width,
+                                        item.rotated ? image.size.width : image.size.height),
+                           padding);
+        }
+        return true;
+    }
+    
+    /// Checks whether the atlas is drawn by stripes
+    bool isStriped() const {
+        return stripe_height > 0 && rows_opener;
+    }
+    
+    /// Size of a row of the atlas in bytes
+    size_t rowBytes() const {
+        return atlas.size.width * pixel_format_details(atlas.fmt).bpp;
+    }
+    
+    /// Returns the window of unfinished rows as the pixel buffer
+    pixel_buffer windowBuffer() {
+        pixel_buffer buffer;
+        buffer.stride = rowBytes();
+        buffer.data = window.data();
+        buffer.dims = size(atlas.size.width, (int)(window.size() / buffer.stride));
+        buffer.fmt = atlas.fmt;
+        buffer.premultiplied = premultipleAlpha;
+        return buffer;
+    }
+    
+    /// Passes rows of the window above the row to the writer and drops them
+    bool flushRows(int row) {
+        const size_t stride = rowBytes();
+        const int count = row - windowTop;
+        const int drawn = (std::min)(count, (int)(window.size() / stride));
+        if(drawn > 0 && !rowsWriter->write_rows(window.data(), stride, drawn))
+            return false;
+        
+        // Nothing was drawn below the window
+        if(count > drawn) {
+            vector<unsigned char> emptyRow(stride, 0);
+            if(!rowsWriter->write_rows(emptyRow.data(), 0, count - drawn))
+                return false;
+        }
+        
+        window.erase(window.begin(), window.begin() + (std::max)(drawn, 0) * stride);
+        windowTop = row;
+        return true;
+    }
+    
+    /// Draws the image of the item into the window, finishing rows above the item's cell by whole stripes
+    bool blitStriped(atlas_item const& item, image_props const& image) {
+        if(item.box.y < windowTop) {
+            CLOG(ERROR, MODULE_LOGGER) << "Items of the atlas drawn by stripes aren't sorted by rows at " << item.image_path;
+            return false;
+        }
+        
+        const int top = (std::min)(item.box.y, atlas.size.height);
+        if(top - windowTop >= stripe_height && !flushRows(top)) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing rows of the atlas";
+            return false;
+        }
+        
+        // The window covers the item with its padding
+        const int bottom = (std::min)(atlas.size.height,
+                                      item.box.y + (item.rotated ? image.size.width : image.size.height) + 2 * padding);
+        const size_t windowSize = (bottom - windowTop) * rowBytes();
+        if(window.size() < windowSize)
+            window.resize(windowSize, 0);
+        
+        return blitImage(item, image, windowBuffer(), windowTop);
+    }
+    
+    /// Keeps the cell of the item for downsampling of mip levels
+    void addCell(atlas_item const& item) {
+        if(mip_levels > 0)
+            cells.emplace_back(item.box.x, item.box.y, item.box.width + 2 * padding, item.box.height + 2 * padding);
+    }
+    
+    /// Downsamples the atlas image into mip levels which follow it
+    bool buildMipLevels(image_props const& image, vector<image_props>& levels) {
+        levels.assign(1, image);
+        
+        auto regions = cells;
+        pixel_buffer src = atlasBuffer();
+        const size_t bpp = pixel_format_details(src.fmt).bpp;
+        mipPixels.resize(mip_levels);
+        for(int level = 0; level < mip_levels && (src.dims.width > 1 || src.dims.height > 1); ++level) {
+            pixel_buffer dst = src;
+            dst.dims = size((std::max)(1, src.dims.width / 2), (std::max)(1, src.dims.height / 2));
+            dst.stride = dst.dims.width * bpp;
+            mipPixels[level].resize(dst.stride * dst.dims.height);
+            dst.data = mipPixels[level].data();
+            if(!downsample_image(src, dst, regions)) {
+                CLOG(ERROR, MODULE_LOGGER) << "Mip levels of the pixel format aren't supported";
+                return false;
+            }
+            
+            image_props mip;
+            mip.size = dst.dims;
+            mip.fmt = dst.fmt;
+            mip.pixels = details::unowned_ptr(dst.data);
+            levels.push_back(mip);
+            src = dst;
+        }
+        return true;
+    }
 };
 
 image_writer_node::image_writer_node(image_writer_props const& props): _pimpl(new Pimpl) {
@@ -27,30 +195,121 @@ image_writer_node::~image_writer_node() {
 
 void image_writer_node::reset() {
     _pimpl->premultipleAlpha = false;
+    _pimpl->padding = 0;
+    _pimpl->rowsWriter.reset();
+    vector<unsigned char>().swap(_pimpl->window);
 }
 
 
 bool image_writer_node::begin_atlas(atlas_props const& atlas) {
-    // Init the rawImage with the atlas properties
-    auto& rawImage = _pimpl->rawImage;
-    rawImage.init(raw_image::init_props()
-                  .set_dims(atlas.size)
-                  .set_pixel_format(atlas.fmt)
-                  .set_sprites_padding(atlas.padding)
-                  .wipe_allocated_data());
+    // Sprites of misaligned cells share compressed blocks with their neighbours and bleed into them
+    if(atlas.block_align % _pimpl->block_dim != 0) {
+        CLOG(WARNING, MODULE_LOGGER) << "Cells of the atlas are aligned to " << atlas.block_align
+        << " px, so sprites share " << _pimpl->block_dim << "x" << _pimpl->block_dim
+        << " blocks of the image. Map the atlas with the block alignment of " << _pimpl->block_dim;
+    }
+    
+    if(_pimpl->isStriped()) {
+        // Only the unfinished rows are kept, so the atlas is drawn by the blit kernels
+        if(atlas.fmt != pixel_format::rgba8 &&
+           atlas.fmt != pixel_format::rgb8) {
+            CLOG(ERROR, MODULE_LOGGER) << "Only rgba8 and rgb8 atlases can be drawn by stripes";
+            return false;
+        }
+        
+        image_props image;
+        image.size = atlas.size;
+        image.fmt = atlas.fmt;
+        _pimpl->rowsWriter = _pimpl->rows_opener(image);
+        if(!_pimpl->rowsWriter)
+            return false;
+        
+        _pimpl->window.clear();
+        _pimpl->windowTop = 0;
+    } else {
+        // Init the rawImage with the atlas properties
+        auto& rawImage = _pimpl->rawImage;
+        rawImage.init(raw_image::init_props()
+                      .set_dims(atlas.size)
+                      .set_pixel_format(atlas.fmt)
+                      .set_sprites_padding(atlas.padding)
+                      .wipe_allocated_data());
+    }
     
     // ... and preserve alpha premultiple flag
+    _pimpl->atlas = atlas;
     _pimpl->premultipleAlpha = atlas.premultipled;
+    _pimpl->padding = atlas.padding;
+    _pimpl->cells.clear();
     return safe_fwd().begin_atlas(atlas);
 }
 
+bool image_writer_node::item_target(atlas_item const& item, pixel_buffer& target) {
+    if(item.rotated || _pimpl->padding > 0 || _pimpl->isStriped())
+        return false;
+    
+    // The source image of a trimmed item has to be cropped
+    if(item.source_size.width > 0)
+        return false;
+    
+    auto& rawImage = _pimpl->rawImage;
+    auto const& imageProps = rawImage.props();
+    if(imageProps.format != pixel_format::rgba8 &&
+       imageProps.format != pixel_format::rgb8) {
+        return false;
+    }
+    
+    // The item must be inside the atlas
+    auto const& dims = imageProps.dimensions;
+    if(item.box.x < 0 || item.box.y < 0 ||
+       item.box.x + item.box.width > dims.width ||
+       item.box.y + item.box.height > dims.height) {
+        return false;
+    }
+    
+    const size_t bpp = pixel_format_details(imageProps.format).bpp;
+    target = _pimpl->atlasBuffer();
+    target.data += item.box.y * target.stride + item.box.x * bpp;
+    target.dims = size(item.box.width, item.box.height);
+    
+    return true;
+}
+
 bool image_writer_node::add_atlas_item(atlas_item const& item) {
+    if(!item.pixels) {
+        // The image has to be already decoded into the atlas
+        pixel_buffer target;
+        if(!item_target(item, target))
+            return false;
+        
+        _pimpl->addCell(item);
+        return safe_fwd().add_atlas_item(item);
+    }
+    
+    // Only the trimmed rect of a trimmed item is drawn
+    image_props image;
+    if(!_pimpl->cropTrimmed(item, image))
+        return false;
+    
+    if(_pimpl->isStriped()) {
+        if(!_pimpl->blitStriped(item, image))
+            return false;
+        
+        return safe_fwd().add_atlas_item(item);
+    }
+    
+    // Straight and rotated copies of rgba8 and rgb8 images don't need the generic filling
+    if(_pimpl->blitImage(item, image, _pimpl->atlasBuffer(), 0)) {
+        _pimpl->addCell(item);
+        return safe_fwd().add_atlas_item(item);
+    }
+    
     // Init the pixel_area with item's properties
     raw_pixel_area area;
     area.init(raw_pixel_area::init_props()
-              .set_dims(item.size)
-              .set_pixel_format(item.fmt)
-              .set_raw_data(item.pixels));
+              .set_dims(image.size)
+              .set_pixel_format(image.fmt)
+              .set_raw_data(image.pixels));
     
     // set rotator according to item's rotation
     area.set_rotator(item.rotated ?
@@ -66,10 +325,24 @@ bool image_writer_node::add_atlas_item(atlas_item const& item) {
     if(!isOk)
         return false;
     
+    _pimpl->addCell(item);
     return safe_fwd().add_atlas_item(item);
 }
 
 bool image_writer_node::end_atlas(bool finalize) {
+    if(_pimpl->isStriped()) {
+        // The rest of rows are finished
+        bool isOk = _pimpl->flushRows(_pimpl->atlas.size.height) && _pimpl->rowsWriter->finish();
+        _pimpl->rowsWriter.reset();
+        vector<unsigned char>().swap(_pimpl->window);
+        if(!isOk) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing rows of the atlas";
+            return false;
+        }
+        
+        return safe_fwd().end_atlas(finalize);
+    }
+    
     auto& rawImage = _pimpl->rawImage;
 
     image_props image;
@@ -77,9 +350,14 @@ bool image_writer_node::end_atlas(bool finalize) {
     image.size = rawImage.props().dimensions;
     image.pixels = details::unowned_ptr(rawImage.get_raw_pixels());
 
-    // Write the final atlas image
-    if(!_pimpl->writer(image))
+    // Write the final atlas image with its mip levels if they are required
+    if(_pimpl->mip_levels > 0 && _pimpl->levels_writer) {
+        vector<image_props> levels;
+        if(!_pimpl->buildMipLevels(image, levels) || !_pimpl->levels_writer(levels))
+            return false;
+    } else if(!_pimpl->writer(image)) {
         return false;
+    }
     
     return safe_fwd().end_atlas(finalize);
 }
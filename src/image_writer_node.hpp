@@ -1,12 +1,20 @@
 #pragma once
 
 #include "chain_node.hpp"
+#include <vector>
 
 /// Image writer properties
 struct image_writer_props {
     using img_writer = std::function<bool(image_props const&)>;
+    using img_levels_writer = std::function<bool(std::vector<image_props> const&)>;
+    using img_rows_opener = std::function<image_rows_writer_ptr(image_props const&)>;
     
-    img_writer writer;  ///< Handler to write the final image
+    img_writer writer;                  ///< Handler to write the final image
+    img_levels_writer levels_writer;    ///< Handler to write the final image with its mip levels
+    int mip_levels = 0;                 ///< Number of mip levels generated below the final image
+    img_rows_opener rows_opener;        ///< Handler to open the writer of the final image by rows
+    int stripe_height = 0;              ///< Height of stripes the image is drawn by (0 - the whole image is drawn)
+    int block_dim = 1;                  ///< Side of pixel blocks the image is compressed by
 };
 
 /// The node to build the image of an atlas
@@ -17,6 +25,23 @@ public:
         
         /// Handler to write the final image
         props& set_writer(img_writer arg) {writer = std::move(arg); return *this;}
+        
+        /**
+         Sets the number of mip levels generated below the final image and the handler to write them.
+         Each level halves the previous one, the chain stops at 1x1. Sprites are downsampled within their cells,
+         so they don't bleed into each other unless the cells are misaligned to the level.
+         */
+        props& set_mip_levels(int levels, img_levels_writer arg) {mip_levels = levels; levels_writer = std::move(arg); return *this;}
+        
+        /**
+         Draws the image by stripes of the height and passes finished rows to the writer the handler opens,
+         instead of keeping the whole image. Rows above the cell of an item are finished, so items must come
+         sorted by the tops of their cells. Only rgba8 and rgb8 atlases can be drawn by stripes, without mip levels.
+         */
+        props& set_stripes(int height, img_rows_opener arg) {stripe_height = height; rows_opener = std::move(arg); return *this;}
+        
+        /// Sets the side of pixel blocks the image is compressed by. Atlases with cells misaligned to blocks are reported
+        props& set_block_dim(int arg) {block_dim = arg; return *this;}
     };
     
     explicit image_writer_node(image_writer_props const& props);
@@ -27,6 +52,15 @@ public:
     bool end_atlas(bool finalize) override;
     void reset() override;
     
+    /**
+     @brief Returns the area of the active atlas the item's image can be decoded into directly.
+     It's possible only if the image doesn't need rotation or padding on drawing and the atlas isn't drawn by stripes.
+     The decoder premultiplies alpha if the target requires it. An item without pixels passed
+     to add_atlas_item is considered to be already decoded into its area.
+     The method is safe to call from several threads.
+     */
+    bool item_target(atlas_item const& item, pixel_buffer& target);
+    
 private:
     struct Pimpl;
     std::unique_ptr<Pimpl> _pimpl;
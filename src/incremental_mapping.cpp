@@ -0,0 +1,293 @@
+#include "incremental_mapping.hpp"
+#include "json_atlas_parser.hpp"
+#include "bin_packer.hpp"
+#include <unordered_map>
+#include <algorithm>
+#include <tuple>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "incremental_mapping"
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+
+    // Returns original size of the mapped item
+    size mappedSize(atlas_item const& item) {
+        return item.rotated ? size(item.box.height, item.box.width) : size(item.box.width, item.box.height);
+    }
+
+    // Sorting items by square
+    bool sortBySquare(atlas_item const& a, atlas_item const& b) {
+        return a.size.width * a.size.height > b.size.width * b.size.height;
+    }
+
+    // Checks whether both items have the same aliases in any order
+    bool isSameAliases(atlas_item const& a, atlas_item const& b) {
+        if(a.aliases.size() != b.aliases.size())
+            return false;
+        
+        auto keysOf = [](atlas_item const& item) {
+            vector<tuple<string, int, int, int, int>> keys;
+            for(auto const& alias : item.aliases) {
+                keys.push_back(make_tuple(alias.image_path,
+                                          alias.source_size.width, alias.source_size.height,
+                                          alias.trim_offset.x, alias.trim_offset.y));
+            }
+            sort(keys.begin(), keys.end());
+            return keys;
+        };
+        return keysOf(a) == keysOf(b);
+    }
+
+    // Checks whether the previous atlas can be kept with the actual atlas settings
+    bool isCompatible(atlas_props const& previous, atlas_props const& actual) {
+        return previous.fmt == actual.fmt &&
+        previous.padding == actual.padding &&
+        previous.block_align == actual.block_align &&
+        previous.premultipled == actual.premultipled &&
+        previous.size.width <= actual.size.width &&
+        previous.size.height <= actual.size.height;
+    }
+
+    // The state of the incremental mapping
+    struct Mapping {
+        incremental_mapping_props const& props;
+        vector<atlas_item> const& sprites;      ///< Actual sprites
+        vector<bool> placed;                    ///< Sprites which are placed into atlases
+        unordered_map<string, size_t> index;    ///< Sprite index by image path
+        int itemExtraPixels = 0;                ///< Extra paddings for each item
+        int blockAlign = 1;                     ///< Size of blocks cells of items are aligned to
+
+        Mapping(atlas_mapping const& actual, incremental_mapping_props const& _props)
+        : props(_props)
+        , sprites(actual.items)
+        , placed(actual.items.size(), false)
+        , itemExtraPixels(actual.atlas.padding * 2)
+        , blockAlign((std::max)(1, _props.block_align))
+        {
+            for(size_t i = 0; i < sprites.size(); ++i) {
+                index[sprites[i].image_path] = i;
+            }
+        }
+
+        // Returns the length of the item's cell including the padding
+        int cellLength(int itemLength) const {
+            return (itemLength + itemExtraPixels + blockAlign - 1) / blockAlign * blockAlign;
+        }
+        
+        // Inserts an item taking into account the extra padding
+        bool insertItem(bin_packer& packer, atlas_item& item) const {
+            if(!packer.insert_square(cellLength(item.size.width),
+                                     cellLength(item.size.height),
+                                     item))
+                return false;
+
+            // restore original item size
+            item.box.width = item.rotated ? item.size.height : item.size.width;
+            item.box.height = item.rotated ? item.size.width : item.size.height;
+            return true;
+        }
+
+        /**
+         Repacks items of the atlas into the bin of the same size and inserts as many candidates as fit.
+         The atlas is left untouched if none of the candidates fit.
+         Returns the number of inserted candidates.
+         */
+        size_t repackAtlas(incremental_atlas& atlas, vector<size_t> const& candidates) {
+            auto packer = props.create_bin(atlas.atlas.size.width, atlas.atlas.size.height);
+
+            // Insert the biggest items first as the mapper does
+            auto items = atlas.items;
+            sort(items.begin(), items.end(), &sortBySquare);
+            for(auto& item : items) {
+                if(!insertItem(*packer, item))
+                    return 0;
+            }
+
+            vector<size_t> inserted;
+            for(auto i : candidates) {
+                if(placed[i])
+                    continue;
+
+                atlas_item item = sprites[i];
+                if(!insertItem(*packer, item))
+                    continue;
+
+                items.push_back(move(item));
+                inserted.push_back(i);
+            }
+
+            if(inserted.empty())
+                return 0;
+
+            for(auto i : inserted) {
+                placed[i] = true;
+            }
+            atlas.items = move(items);
+            atlas.atlas.occupancy = packer->occupancy();
+            atlas.state = atlas_state::dirty;
+            return inserted.size();
+        }
+
+        // Keeps unchanged items of the previous atlas in place
+        void updateAtlas(atlas_mapping const& previous, incremental_atlas& atlas) {
+            (atlas_mapping&)atlas = previous;
+            atlas.items.clear();
+            atlas.state = atlas_state::clean;
+
+            vector<size_t> resized;
+            for(auto const& prevItem : previous.items) {
+                auto pos = index.find(prevItem.image_path);
+                if(pos == index.end() || placed[pos->second]) {
+                    // the sprite was removed
+                    atlas.state = atlas_state::dirty;
+                    continue;
+                }
+
+                auto const& sprite = sprites[pos->second];
+                auto prevSize = mappedSize(prevItem);
+                if(prevSize.width != sprite.size.width || prevSize.height != sprite.size.height) {
+                    // the sprite has to be placed again
+                    atlas.state = atlas_state::dirty;
+                    resized.push_back(pos->second);
+                    continue;
+                }
+
+                atlas_item item = sprite;
+                item.box = prevItem.box;
+                item.rotated = prevItem.rotated;
+                atlas.items.push_back(move(item));
+                placed[pos->second] = true;
+
+                if(!props.is_changed || props.is_changed(sprite) || !isSameAliases(prevItem, sprite))
+                    atlas.state = atlas_state::dirty;
+            }
+
+            if(!resized.empty())
+                repackAtlas(atlas, resized);
+        }
+
+        // Returns the group of the item
+        string groupOf(atlas_item const& item) const {
+            return props.get_group ? props.get_group(item) : string();
+        }
+    };
+
+} // anonymous
+
+bool atlas_collector::begin_atlas(atlas_props const& atlas) {
+    _atlases.push_back(atlas_mapping());
+    _atlases.back().atlas = atlas;
+    return true;
+}
+
+bool atlas_collector::add_atlas_item(atlas_item const& item) {
+    if(_atlases.empty())
+        return false;
+
+    _atlases.back().items.push_back(item);
+    return true;
+}
+
+bool atlas_collector::end_atlas(bool /*finalize*/) {
+    return true;
+}
+
+void atlas_collector::reset() {
+    _atlases.clear();
+}
+
+bool load_atlas_mapping(std::string const& atlasFile, sprites_index const& sprites, atlas_mapping& mapping) {
+    auto collector = make_shared<atlas_collector>();
+    auto skipImage = [](atlas_item& item) {
+        // restore the original item size by its mapping
+        item.size = mappedSize(item);
+        return true;
+    };
+
+    if(!parse_json_atlas(atlasFile, sprites, json_parser_props()
+                         .set_atlas_builder(collector)
+                         .set_image_reader(skipImage)))
+        return false;
+
+    if(collector->atlases().size() != 1)
+        return false;
+
+    auto name = move(mapping.name);
+    mapping = move(collector->atlases().front());
+    mapping.name = move(name);
+    return true;
+}
+
+void map_incrementally(std::vector<atlas_mapping> const& previous,
+                       atlas_mapping const& actual,
+                       incremental_mapping_props const& props,
+                       incremental_mapping_result& result) {
+    Mapping mapping(actual, props);
+
+    // Keep sprites of previous atlases in place
+    result.atlases.clear();
+    result.atlases.resize(previous.size());
+    vector<string> groups(previous.size());
+    for(size_t i = 0; i < previous.size(); ++i) {
+        auto& atlas = result.atlases[i];
+        if(!isCompatible(previous[i].atlas, actual.atlas)) {
+            CLOG(INFO, MODULE_LOGGER) << "The atlas " << previous[i].name << " doesn't match the atlas settings";
+            (atlas_mapping&)atlas = previous[i];
+            atlas.items.clear();
+            atlas.state = atlas_state::removed;
+            continue;
+        }
+
+        mapping.updateAtlas(previous[i], atlas);
+        if(!previous[i].items.empty())
+            groups[i] = mapping.groupOf(previous[i].items.front());
+    }
+
+    // Try to insert new sprites into previous atlases.
+    // Atlases which are rebuilt anyway go first to keep the clean ones untouched
+    vector<size_t> newSprites;
+    for(size_t i = 0; i < actual.items.size(); ++i) {
+        if(!mapping.placed[i])
+            newSprites.push_back(i);
+    }
+    sort(newSprites.begin(), newSprites.end(), [&actual](size_t a, size_t b) {
+        return sortBySquare(actual.items[a], actual.items[b]);
+    });
+
+    vector<size_t> order;
+    for(size_t i = 0; i < result.atlases.size(); ++i) {
+        if(result.atlases[i].state == atlas_state::dirty)
+            order.push_back(i);
+    }
+    for(size_t i = 0; i < result.atlases.size(); ++i) {
+        if(result.atlases[i].state == atlas_state::clean)
+            order.push_back(i);
+    }
+
+    for(auto i : order) {
+        vector<size_t> candidates;
+        for(auto spriteIndex : newSprites) {
+            if(!mapping.placed[spriteIndex] && mapping.groupOf(actual.items[spriteIndex]) == groups[i])
+                candidates.push_back(spriteIndex);
+        }
+
+        if(!candidates.empty())
+            mapping.repackAtlas(result.atlases[i], candidates);
+    }
+
+    // Atlases without sprites are removed
+    for(auto& atlas : result.atlases) {
+        if(atlas.items.empty())
+            atlas.state = atlas_state::removed;
+    }
+
+    // The rest sprites need new atlases
+    result.leftovers.clear();
+    for(size_t i = 0; i < actual.items.size(); ++i) {
+        if(!mapping.placed[i])
+            result.leftovers.push_back(actual.items[i]);
+    }
+}
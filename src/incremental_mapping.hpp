@@ -0,0 +1,87 @@
+#pragma once
+
+#include "atlas_builder.hpp"
+#include "atlas_mapper_node.hpp"
+#include "helpers.hpp"
+#include "sprites_index.hpp"
+#include <vector>
+
+/// Atlas properties with its mapped items
+struct atlas_mapping {
+    std::string name;                   ///< Atlas name
+    atlas_props atlas;                  ///< Atlas properties
+    std::vector<atlas_item> items;      ///< Mapped items of the atlas
+};
+
+/// The builder collects atlases and items passed to it
+class atlas_collector: public atlas_builder {
+public:
+    virtual bool begin_atlas(atlas_props const& atlas) override;
+    virtual bool add_atlas_item(atlas_item const& item) override;
+    virtual bool end_atlas(bool finalize) override;
+    virtual void reset() override;
+
+    /// Returns collected atlases
+    std::vector<atlas_mapping>& atlases() { return _atlases; }
+
+private:
+    std::vector<atlas_mapping> _atlases;
+};
+
+/**
+ @brief Loads the atlas mapping from json.
+ Only the mapping is loaded, images of the items aren't read.
+ */
+bool load_atlas_mapping(std::string const& atlas_file, sprites_index const& sprites, atlas_mapping& mapping);
+
+/// State of a previously mapped atlas
+enum class atlas_state {
+    clean,      ///< The atlas is left as is
+    dirty,      ///< Sprites of the atlas were changed, added or removed
+    removed,    ///< The atlas has no sprites anymore
+};
+
+/// Previously mapped atlas updated by the incremental mapping
+struct incremental_atlas: atlas_mapping {
+    atlas_state state = atlas_state::clean; ///< State of the atlas
+};
+
+/// Incremental mapping properties
+struct incremental_mapping_props {
+    using props = incremental_mapping_props;
+    using bin_factory = atlas_mapper_props::bin_factory;
+    using change_checker = std::function<bool(atlas_item const&)>;
+    using group_extractor = std::function<std::string(atlas_item const&)>;
+
+    bin_factory create_bin;         ///< Bin factory
+    change_checker is_changed;      ///< Checks whether content of the item's image was changed
+    group_extractor get_group;      ///< Returns the group of the item. Only items of the same group share an atlas
+    int block_align = 1;            ///< Size of blocks cells of items are aligned to
+
+    /// Sets bin factory
+    props& set_bin_factory(bin_factory arg) {create_bin=std::move(arg); return *this;}
+    /// Sets content change checker. Images are treated as changed if the checker isn't set
+    props& set_change_checker(change_checker arg) {is_changed=std::move(arg); return *this;}
+    /// Sets group extractor. All items belong to the same group if the extractor isn't set
+    props& set_group_extractor(group_extractor arg) {get_group=std::move(arg); return *this;}
+    /// Aligns cells of items to blocks of the size as the mapper does
+    props& set_block_align(int arg) {block_align=arg; return *this;}
+};
+
+/// Result of the incremental mapping
+struct incremental_mapping_result {
+    std::vector<incremental_atlas> atlases; ///< Previously mapped atlases
+    std::vector<atlas_item> leftovers;      ///< Sprites which have to be mapped into new atlases
+};
+
+/**
+ @brief Updates previously mapped atlases with the actual sprites.
+ Atlases whose sprites weren't changed are kept as is. Sprites of a changed size
+ and new sprites are inserted into previous atlases by repacking them at the same size,
+ the ones which don't fit are returned as leftovers.
+ Atlases of other format, padding, block alignment or larger than the sprites atlas are removed.
+ */
+void map_incrementally(std::vector<atlas_mapping> const& previous,
+                       atlas_mapping const& sprites,
+                       incremental_mapping_props const& props,
+                       incremental_mapping_result& result);
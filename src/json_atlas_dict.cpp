@@ -1,11 +1,15 @@
 #include "json_atlas_dict.hpp"
 
 const char* json_atlas_dict::padding            = "padding";
+const char* json_atlas_dict::block_align        = "block_align";
 const char* json_atlas_dict::size               = "size";
 const char* json_atlas_dict::regions            = "regions";
 const char* json_atlas_dict::region_rect        = "rect";
 const char* json_atlas_dict::region_rotated     = "rotated";
 const char* json_atlas_dict::region_sprite_name = "sprite_name";
+const char* json_atlas_dict::region_source_size = "source_size";
+const char* json_atlas_dict::region_trim_offset = "trim_offset";
+const char* json_atlas_dict::region_alias_of    = "alias_of";
 const char* json_atlas_dict::premiltipled       = "premultipled";
 const char* json_atlas_dict::pixel_format       = "pixel_format";
 const char* json_atlas_dict::sprites_file       = "sprites_file";
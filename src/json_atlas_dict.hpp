@@ -5,10 +5,14 @@ struct json_atlas_dict {
     static const char* premiltipled;
     static const char* pixel_format;
     static const char* padding;
+    static const char* block_align;
     static const char* size;
     static const char* sprites_file;
     static const char* regions;
     static const char* region_rect;
     static const char* region_rotated;
     static const char* region_sprite_name;
+    static const char* region_source_size;
+    static const char* region_trim_offset;
+    static const char* region_alias_of;
 };
@@ -2,10 +2,13 @@
 #include "atlas_builder.hpp"
 #include "helpers.hpp"
 #include "json_atlas_dict.hpp"
+#include "atlas_regions.hpp"
+#include "mapped_file.hpp"
 #include <atlas2d/pixel_format.hpp>
+#include <boost/filesystem.hpp>
 #include <rapidjson/rapidjson.h>
 #include <rapidjson/document.h>
-#include <rapidjson/istreamwrapper.h>
+#include <vector>
 #include <easylogging++.h>
 
 #define MODULE_LOGGER "json_parser"
@@ -18,85 +21,30 @@ using namespace ::std;
 #undef GetObject
 #endif
 
+namespace fs = boost::filesystem;
+
 namespace {
     using Dict = json_atlas_dict;
-
-    bool parseSpritesMap(std::istream& stream, map<string, string>& dict) {
-        if(!stream)
-            return false;
-        
-        IStreamWrapper rjStream(stream);
-        Document doc;
-        doc.ParseStream(rjStream);
-
-        for(auto const& m : doc.GetObject()) {
-            dict[m.name.GetString()] = m.value.GetString();
-        }
-        
-        return true;
-    }
-    
-} // anonymous
-
-bool parse_json_atlas(std::istream& atlasStream, std::istream& spritesStream, json_parser_props const& props) {
-    IStreamWrapper rjStream(atlasStream);
-    Document doc;
-    doc.ParseStream(rjStream);
-    
-    if(!doc.IsObject()) {
-        // Invalid JSON stream
-        return false;
-    }
     
-    // Parse sprites map
-    map<string, string> spritesMap;
-    if(!parseSpritesMap(spritesStream, spritesMap))
-        return false;
-
-    // Parse atlas info
-    atlas_props atlas;
+    // Returns the sprites map of the atlas by its sprites_file field
+    using SpritesGetter = function<sprites_index_ptr(Document const& doc)>;
     
-    atlas.fmt = atlas2d::pixel_format_details(doc[Dict::pixel_format].GetString()).format;
-    if(atlas.fmt == atlas2d::pixel_format::unknown) {
-        // Unknown pixel format
-        CLOG(ERROR, MODULE_LOGGER) << "Unknown pixel format";
-        return false;
+    // Returns the getter of the sprites map which is already loaded
+    SpritesGetter knownSprites(sprites_index const& sprites) {
+        // The index isn't owned, so the pointer only aliases it
+        sprites_index_ptr spritesPtr(sprites_index_ptr(), &sprites);
+        return [spritesPtr](Document const&) {
+            return spritesPtr;
+        };
     }
     
-    Value const& jPadding = doc[Dict::padding];
-    if(!jPadding.IsInt())
-        return false;
-    atlas.padding = jPadding.GetInt();
-    
-    Value const& jSize = doc[Dict::size];
-    if(!jSize.IsArray())
-        return false;
-    atlas.size = atlas2d::size(jSize[0].GetInt(), jSize[1].GetInt());
-
-    Value const& jPremultipled = doc[Dict::premiltipled];
-    if(!jPremultipled.IsBool())
-        return false;
-    atlas.premultipled = jPremultipled.GetBool();
-
-
-    Value const& jRegions = doc[Dict::regions];
-    if(!jRegions.IsArray())
-        return false;
-
-    auto& writer = *(props.atlas_builder);
-    if(!writer.begin_atlas(atlas))
-        return false;
-
-    // Parse atlas regions
-    bool hasError = false;
-    for(auto& jRegion : jRegions.GetArray()) {
-        // Parse each region
-        atlas_item item;
+    // Parses the region of an atlas
+    bool parseRegion(Value const& jRegion, sprites_index const& sprites, atlas_region& region) {
+        auto& item = region.item;
         
         Value const& jRegionRect = jRegion[Dict::region_rect];
-        hasError = !jRegionRect.IsArray();
-        if(hasError)
-            break;
+        if(!jRegionRect.IsArray())
+            return false;
         item.box = rect(
             jRegionRect[0].GetInt(),
             jRegionRect[1].GetInt(),
@@ -105,46 +53,187 @@ bool parse_json_atlas(std::istream& atlasStream, std::istream& spritesStream, js
         );
         
         Value const& jRegionSpriteName = jRegion[Dict::region_sprite_name];
-        hasError = !jRegionSpriteName.IsString();
-        if(hasError)
-            break;
-        string spriteName = jRegionSpriteName.GetString();
-        auto spriteMapPos = spritesMap.find(spriteName);
-        item.image_path = spriteMapPos != spritesMap.end() ? spriteMapPos->second : "";
+        if(!jRegionSpriteName.IsString())
+            return false;
+        region.sprite_name.assign(jRegionSpriteName.GetString(), jRegionSpriteName.GetStringLength());
+        item.image_path = sprites.find(region.sprite_name).to_string();
         
         Value const& jRegionRotated = jRegion[Dict::region_rotated];
-        hasError = !jRegionRotated.IsBool();
-        if(hasError)
-            break;
+        if(!jRegionRotated.IsBool())
+            return false;
         item.rotated = jRegionRotated.GetBool();
         
-        hasError = !props.read_image(item);
-        if(hasError) {
-            CLOG(ERROR, MODULE_LOGGER)\
-            << "Error reading the image "\
-            << item.image_path
-            << " of the sprite "
-            << spriteName;
-            break;
+        // The trim is optional
+        auto sourceSizePos = jRegion.FindMember(Dict::region_source_size);
+        auto trimOffsetPos = jRegion.FindMember(Dict::region_trim_offset);
+        if(sourceSizePos != jRegion.MemberEnd() && trimOffsetPos != jRegion.MemberEnd()) {
+            Value const& jSourceSize = sourceSizePos->value;
+            Value const& jTrimOffset = trimOffsetPos->value;
+            if(!jSourceSize.IsArray() || jSourceSize.Size() != 2 ||
+               !jTrimOffset.IsArray() || jTrimOffset.Size() != 2)
+                return false;
+            item.source_size = atlas2d::size(jSourceSize[0].GetInt(), jSourceSize[1].GetInt());
+            item.trim_offset = atlas2d::offset(jTrimOffset[0].GetInt(), jTrimOffset[1].GetInt());
         }
         
-        hasError = !writer.add_atlas_item(item);
+        auto aliasOfPos = jRegion.FindMember(Dict::region_alias_of);
+        if(aliasOfPos != jRegion.MemberEnd()) {
+            if(!aliasOfPos->value.IsString())
+                return false;
+            region.alias_of = aliasOfPos->value.GetString();
+        }
+        
+        return true;
+    }
+    
+    // Parses the atlas json in situ, so strings of the document refer to the text
+    bool parseAtlasText(char* text, SpritesGetter const& getSprites, json_parser_props const& props) {
+        Document doc;
+        doc.ParseInsitu(text);
+        
+        if(doc.HasParseError() || !doc.IsObject()) {
+            // Invalid JSON stream
+            return false;
+        }
+        
+        auto spritesPtr = getSprites(doc);
+        if(!spritesPtr)
+            return false;
+        auto const& sprites = *spritesPtr;
+
+        // Parse atlas info
+        atlas_props atlas;
+        
+        atlas.fmt = atlas2d::pixel_format_details(doc[Dict::pixel_format].GetString()).format;
+        if(atlas.fmt == atlas2d::pixel_format::unknown) {
+            // Unknown pixel format
+            CLOG(ERROR, MODULE_LOGGER) << "Unknown pixel format";
+            return false;
+        }
+        
+        Value const& jPadding = doc[Dict::padding];
+        if(!jPadding.IsInt())
+            return false;
+        atlas.padding = jPadding.GetInt();
+        
+        // Atlases mapped before the alignment was recorded aren't aligned
+        auto blockAlignPos = doc.FindMember(Dict::block_align);
+        if(blockAlignPos != doc.MemberEnd()) {
+            if(!blockAlignPos->value.IsInt() || blockAlignPos->value.GetInt() < 1)
+                return false;
+            atlas.block_align = blockAlignPos->value.GetInt();
+        }
+        
+        Value const& jSize = doc[Dict::size];
+        if(!jSize.IsArray())
+            return false;
+        atlas.size = atlas2d::size(jSize[0].GetInt(), jSize[1].GetInt());
+
+        Value const& jPremultipled = doc[Dict::premiltipled];
+        if(!jPremultipled.IsBool())
+            return false;
+        atlas.premultipled = jPremultipled.GetBool();
+
+
+        Value const& jRegions = doc[Dict::regions];
+        if(!jRegions.IsArray())
+            return false;
+
+        auto& writer = *(props.atlas_builder);
+        if(!writer.begin_atlas(atlas))
+            return false;
+
+        // Parse atlas regions
+        vector<atlas_region> regions;
+        regions.reserve(jRegions.Size());
+        bool hasError = false;
+        for(auto& jRegion : jRegions.GetArray()) {
+            regions.push_back(atlas_region());
+            hasError = !parseRegion(jRegion, sprites, regions.back());
+            if(hasError)
+                break;
+        }
+        
+        // Draw regions
+        hasError = hasError || !fold_aliases(regions) || !build_regions(regions, writer, props);
+        
         if(hasError) {
-            CLOG(ERROR, MODULE_LOGGER)\
-            << "Error processing the image "\
-            << item.image_path
-            << " of the sprite "
-            << spriteName;
-            break;
+            writer.reset();
+            return false;
         }
+        
+        return writer.end_atlas(true);
     }
     
-    if(hasError) {
-        writer.reset();
+} // anonymous
+
+bool parse_sprites_map(std::istream& stream, sprites_map& dict) {
+    sprites_index sprites;
+    if(!sprites.load(stream))
         return false;
+    
+    for(size_t i = 0; i < sprites.size(); ++i) {
+        auto sprite = sprites[i];
+        dict[sprite.first.to_string()] = sprite.second.to_string();
     }
     
-    return writer.end_atlas(true);
+    return true;
+}
+
+bool parse_json_atlas(std::istream& atlasStream, std::istream& spritesStream, json_parser_props const& props) {
+    // Parse sprites map
+    sprites_index sprites;
+    if(!sprites.load(spritesStream))
+        return false;
+    
+    return parse_json_atlas(atlasStream, sprites, props);
+}
+
+bool parse_json_atlas(std::istream& atlasStream, sprites_map const& spritesMap, json_parser_props const& props) {
+    sprites_index sprites;
+    sprites.assign(spritesMap);
+    return parse_json_atlas(atlasStream, sprites, props);
 }
 
+bool parse_json_atlas(std::istream& atlasStream, sprites_index const& sprites, json_parser_props const& props) {
+    mapped_text text;
+    if(!text.read(atlasStream))
+        return false;
+    
+    return parseAtlasText(text.data(), knownSprites(sprites), props);
+}
 
+bool parse_json_atlas(std::string const& atlasFile, sprites_index const& sprites, json_parser_props const& props) {
+    mapped_text text;
+    if(!text.open(atlasFile))
+        return false;
+    
+    return parseAtlasText(text.data(), knownSprites(sprites), props);
+}
+
+bool parse_json_atlas(std::string const& atlasFile, json_parser_props const& props) {
+    mapped_text text;
+    if(!text.open(atlasFile))
+        return false;
+    
+    auto spritesIndices = props.sprites_indices ? props.sprites_indices : make_shared<sprites_index_cache>();
+    auto getSprites = [&atlasFile, spritesIndices](Document const& doc) {
+        auto spritesFilePos = doc.FindMember(Dict::sprites_file);
+        if(spritesFilePos == doc.MemberEnd() || !spritesFilePos->value.IsString()) {
+            CLOG(ERROR, MODULE_LOGGER) << "No sprites map of the atlas " << atlasFile;
+            return sprites_index_ptr();
+        }
+        
+        // The sprites map is recorded relative to the atlas
+        fs::path spritesFile(spritesFilePos->value.GetString());
+        if(spritesFile.is_relative())
+            spritesFile = fs::path(atlasFile).parent_path() / spritesFile;
+        
+        auto sprites = spritesIndices->get(spritesFile.string());
+        if(!sprites)
+            CLOG(ERROR, MODULE_LOGGER) << "An error during loading the sprites map " << spritesFile;
+        return sprites;
+    };
+    
+    return parseAtlasText(text.data(), getSprites, props);
+}
@@ -2,6 +2,7 @@
 
 #include "forwards.hpp"
 #include "helpers.hpp"
+#include "sprites_index.hpp"
 #include <istream>
 
 /// Atlas parser properties
@@ -11,16 +12,59 @@ struct json_parser_props {
     
     atlas_builder_ptr atlas_builder;    ///< Atlas builder
     image_reader read_image;            ///< Atlas item reader
+    thread_pool_ptr pool;               ///< Worker threads to read images on
+    unsigned prefetch = 0;              ///< Max number of images read ahead (0 - two per worker)
+    sprites_index_cache_ptr sprites_indices; ///< Sprites maps shared between atlases
+    bool sort_regions = false;          ///< Pass regions to the builder sorted by their tops
     
     /// Sets atlas builder
     props& set_atlas_builder(atlas_builder_ptr arg) {atlas_builder=std::move(arg); return *this;}
     /// Sets image reader
     props& set_image_reader(image_reader arg) {read_image=std::move(arg); return *this;}
+    /// Sets worker threads to read images on. Images are read on the calling thread by default
+    props& set_thread_pool(thread_pool_ptr arg) {pool=std::move(arg); return *this;}
+    /// Sets max number of images read ahead
+    props& set_prefetch(unsigned arg) {prefetch=arg; return *this;}
+    /// Sets the cache of sprites maps shared between atlases. Each atlas loads its sprites map otherwise
+    props& set_sprites_indices(sprites_index_cache_ptr arg) {sprites_indices=std::move(arg); return *this;}
+    /// Passes regions to the builder sorted by the tops of their cells, as builders drawing atlases by stripes need
+    props& set_sort_regions(bool arg) {sort_regions=arg; return *this;}
 };
 
+/**
+ @brief Parses sprites map from json.
+ The map can be parsed once and shared between several atlases.
+ */
+bool parse_sprites_map(std::istream& sprites_stream, sprites_map& sprites);
+
 /**
  @brief Parses the whole atlas from json mapping.
  The atlas_stream provides json stream of atlas mapping.
  The strites_map provides json stream of sprites map.
  */
 bool parse_json_atlas(std::istream& atlas_stream, std::istream& sprites_stream, json_parser_props const& props);
+
+/**
+ @brief Parses the whole atlas from json mapping using already parsed sprites map.
+ */
+bool parse_json_atlas(std::istream& atlas_stream, sprites_map const& sprites, json_parser_props const& props);
+
+/**
+ @brief Parses the whole atlas from json mapping using the sprites index.
+ The json is parsed in situ, so its strings aren't copied.
+ */
+bool parse_json_atlas(std::istream& atlas_stream, sprites_index const& sprites, json_parser_props const& props);
+
+/**
+ @brief Parses the whole atlas from the json mapping file using the sprites index.
+ The file is memory mapped and parsed in situ, see mapped_text.
+ The sprites index can be loaded once and shared between atlases of the same sprites map.
+ */
+bool parse_json_atlas(std::string const& atlas_file, sprites_index const& sprites, json_parser_props const& props);
+
+/**
+ @brief Parses the whole atlas from the json mapping file.
+ The sprites map is the one recorded in the sprites_file field, relative to the atlas file.
+ It's taken from the sprites_indices cache of the props, so atlases sharing the cache load it once.
+ */
+bool parse_json_atlas(std::string const& atlas_file, json_parser_props const& props);
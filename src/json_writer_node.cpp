@@ -1,16 +1,17 @@
 #include "json_writer_node.hpp"
 #include "json_atlas_dict.hpp"
 #include "helpers.hpp"
+#include "sprites_index.hpp"
 #include <atlas2d/pixel_format.hpp>
-#include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/ostreamwrapper.h>
-#include <rapidjson/writer.h>
 #include <rapidjson/prettywriter.h>
 #include <easylogging++.h>
 
-#include <sstream>
-#include <fstream>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <stdexcept>
 
 #define MODULE_LOGGER "json_writer"
 
@@ -22,74 +23,223 @@ namespace rj = ::rapidjson;
 namespace {
     std::runtime_error atlas_write_error("Error writing JSON atlas");
     std::runtime_error sprites_map_write_error("Error writing sprites map");
-
+    
     using Dict = json_atlas_dict;
     
-    string extractSpriteName(string const& imageName) {
-        string name = imageName.substr(0, imageName.find_last_of("."));
-        auto basenamePos = name.find_last_of("/");
-        if(basenamePos != string::npos) {
-            name = name.substr(basenamePos+1);
+    // Writes atlas properties and opens the regions array
+    template<typename WriterT>
+    void writeAtlasHeader(WriterT& writer, atlas_props const& atlas, string const& spritesMapFilename) {
+        writer.StartObject();
+        writer.Key(Dict::padding);
+        writer.Int(atlas.padding);
+        writer.Key(Dict::block_align);
+        writer.Int(atlas.block_align);
+        
+        writer.Key(Dict::size);
+        writer.StartArray();
+        writer.Int(atlas.size.width);
+        writer.Int(atlas.size.height);
+        writer.EndArray();
+        
+        writer.Key(Dict::premiltipled);
+        writer.Bool(atlas.premultipled);
+        writer.Key(Dict::pixel_format);
+        writer.String(atlas2d::pixel_format_details(atlas.fmt).formatName.c_str());
+        writer.Key(Dict::sprites_file);
+        writer.String(spritesMapFilename.c_str());
+        
+        writer.Key(Dict::regions);
+        writer.StartArray();
+    }
+    
+    // Writes the region of the item. Regions of aliases refer to the sprite they share the image with
+    template<typename WriterT>
+    void writeRegion(WriterT& writer, atlas_item const& item, string const& spriteName,
+                     atlas2d::size const& sourceSize, atlas2d::offset const& trimOffset,
+                     string const* aliasOf) {
+        writer.StartObject();
+        writer.Key(Dict::region_rect);
+        writer.StartArray();
+        writer.Int(item.box.x);
+        writer.Int(item.box.y);
+        writer.Int(item.box.width);
+        writer.Int(item.box.height);
+        writer.EndArray();
+        
+        writer.Key(Dict::region_rotated);
+        writer.Bool(item.rotated);
+        writer.Key(Dict::region_sprite_name);
+        writer.String(spriteName.c_str(), (SizeType)spriteName.size());
+        
+        // Trimmed items keep their source size and the offset of the trimmed rect
+        if(sourceSize.width > 0) {
+            writer.Key(Dict::region_source_size);
+            writer.StartArray();
+            writer.Int(sourceSize.width);
+            writer.Int(sourceSize.height);
+            writer.EndArray();
+            
+            writer.Key(Dict::region_trim_offset);
+            writer.StartArray();
+            writer.Int(trimOffset.x);
+            writer.Int(trimOffset.y);
+            writer.EndArray();
+        }
+        
+        if(aliasOf) {
+            writer.Key(Dict::region_alias_of);
+            writer.String(aliasOf->c_str(), (SizeType)aliasOf->size());
         }
         
-        return name;
+        writer.EndObject();
+    }
+    
+    // Closes the regions array and the atlas object
+    template<typename WriterT>
+    bool writeAtlasFooter(WriterT& writer) {
+        writer.EndArray();
+        writer.EndObject();
+        return writer.IsComplete();
     }
+    
+    // Writes the sprites map in the order sprites were registered
+    template<typename WriterT>
+    bool writeSprites(WriterT& writer, vector<pair<string, string>> const& sprites) {
+        writer.StartObject();
+        for(auto const& sprite : sprites) {
+            writer.Key(sprite.first.c_str(), (SizeType)sprite.first.size());
+            writer.String(sprite.second.c_str(), (SizeType)sprite.second.size());
+        }
+        writer.EndObject();
+        return writer.IsComplete();
+    }
+    
+    /**
+     Streams the atlas json to the output stream. Pretty and compact writers of rapidjson
+     don't share virtual methods, so the stream is typed by the writer.
+     */
+    class AtlasStream {
+    public:
+        virtual ~AtlasStream() { ;; }
+        
+        virtual void writeHeader(atlas_props const& atlas, string const& spritesMapFilename) = 0;
+        virtual void writeRegion(atlas_item const& item, string const& spriteName,
+                                 atlas2d::size const& sourceSize, atlas2d::offset const& trimOffset,
+                                 string const* aliasOf) = 0;
+        virtual bool writeFooter() = 0;
+    };
+    
+    template<typename WriterT>
+    class AtlasStreamImpl: public AtlasStream {
+    public:
+        explicit AtlasStreamImpl(shared_ptr<ostream> outs)
+        : _outs(move(outs)), _rjStream(*_outs), _writer(_rjStream)
+        { ;; }
+        
+        void writeHeader(atlas_props const& atlas, string const& spritesMapFilename) override {
+            writeAtlasHeader(_writer, atlas, spritesMapFilename);
+        }
+        
+        void writeRegion(atlas_item const& item, string const& spriteName,
+                         atlas2d::size const& sourceSize, atlas2d::offset const& trimOffset,
+                         string const* aliasOf) override {
+            ::writeRegion(_writer, item, spriteName, sourceSize, trimOffset, aliasOf);
+        }
+        
+        bool writeFooter() override {
+            // The trailing newline lets parsers terminate the mapped text in place
+            bool isOk = writeAtlasFooter(_writer);
+            return isOk && _outs->put('\n').flush().good();
+        }
+    
+    private:
+        shared_ptr<ostream> _outs;
+        OStreamWrapper _rjStream;
+        WriterT _writer;
+    };
+}
+
+std::string extract_sprite_name(std::string const& imageName) {
+    string name = imageName.substr(0, imageName.find_last_of("."));
+    auto basenamePos = name.find_last_of("/");
+    if(basenamePos != string::npos) {
+        name = name.substr(basenamePos+1);
+    }
+    
+    return name;
 }
 
 struct json_writer_node::Pimpl: json_writer_props {
-    rj::Document spritesDoc;    ///< The document for sprites map
-    rj::Document doc;           ///< The document for atlas map
-    rj::Value itemsArray;       ///< Atlas items array
+    atlas_props atlas;                      ///< Properties of the active atlas
+    unique_ptr<AtlasStream> atlasStream;    ///< Json stream of the active atlas. Opened on the first item
+    vector<pair<string, string>> sprites;   ///< Sprite names and image paths of the sprites map
+    unordered_set<string> spriteNames;      ///< Names registered in the sprites map
     
     void reset() {
-        resetJsonContent();
-        spritesDoc = Document(kObjectType);
+        discardAtlasStream();
+        sprites.clear();
+        spriteNames.clear();
+        
+        // Sprites of the atlases written before are kept in the sprites map
+        for(auto const& sprite : known_sprites) {
+            sprites.push_back(sprite);
+            spriteNames.insert(sprite.first);
+        }
     }
     
-    void resetJsonContent() {
-        doc = Document(kObjectType);
-        itemsArray = Value(kArrayType);
+    // Opens the stream provided by the gen_atlas_stream and writes atlas properties into it
+    void openAtlasStream() {
+        auto outs = this->gen_atlas_stream();
+        if(!outs || !*outs) {
+            CLOG(ERROR, MODULE_LOGGER) << "Invalid JSON stream!";
+            throw atlas_write_error;
+        }
+        
+        if(pretty)
+            atlasStream.reset(new AtlasStreamImpl<PrettyWriter<OStreamWrapper>>(move(outs)));
+        else
+            atlasStream.reset(new AtlasStreamImpl<rj::Writer<OStreamWrapper>>(move(outs)));
+        atlasStream->writeHeader(atlas, sprites_map_filename);
     }
     
-    // Writes content of the document to a stream provided by the gen_atlas_stream
-    void onNextAtlas(bool writeJson=true) {
-        if(writeJson) {
-            // Write the document to the stream
-            auto outs = this->gen_atlas_stream();
-            if(!outs) {
-                CLOG(ERROR, MODULE_LOGGER) << "Invalid JSON stream!";
-                throw atlas_write_error;
-            }
-            OStreamWrapper rjStream(*outs);
-            
-            PrettyWriter<OStreamWrapper> writer(rjStream);
-            if(!doc.Accept(writer)) {
-                CLOG(ERROR, MODULE_LOGGER) << "Error writing JSON atlas";
-                throw atlas_write_error;
-            }
+    // Finishes the atlas json if any region was written
+    void closeAtlasStream() {
+        if(!atlasStream)
+            return;
+        
+        bool isOk = atlasStream->writeFooter();
+        if(!isOk) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error writing JSON atlas";
+            discardAtlasStream();
+            throw atlas_write_error;
         }
-        // Prepare the node for a next atlas
-        resetJsonContent();
+        atlasStream.reset();
+    }
+    
+    // Closes the unfinished atlas json and removes what was written
+    void discardAtlasStream() {
+        if(!atlasStream)
+            return;
+        
+        atlasStream.reset();
+        if(discard_atlas_stream)
+            discard_atlas_stream();
     }
     
     // Registers the image name in the sprites map. Also extracts sprite name to the spriteName variable.
     bool addToSpriteMap(std::string const& imageFile, string& spriteName) {
-        spriteName = extractSpriteName(imageFile);
-
-        if(spritesDoc.FindMember(spriteName.c_str()) != spritesDoc.MemberEnd())
-            return false;
+        spriteName = extract_sprite_name(imageFile);
         
-        auto& allocator = spritesDoc.GetAllocator();
-        spritesDoc.AddMember(rj::Value(spriteName.c_str(), allocator).Move(),
-                             rj::Value(imageFile.c_str(), allocator).Move(),
-                             allocator);
+        if(!spriteNames.insert(spriteName).second)
+            return false;
         
+        sprites.push_back(make_pair(spriteName, imageFile));
         return true;
     }
     
     // Writes sprites map to a stream provided by the gen_spritesmap_stream
     void writeSpritesMap() {
-        if(!spritesDoc.MemberCount())
+        if(sprites.empty())
             return;
         
         auto outs = this->gen_spritesmap_stream();
@@ -99,11 +249,28 @@ struct json_writer_node::Pimpl: json_writer_props {
         }
         
         OStreamWrapper rjStream(*outs);
-        PrettyWriter<OStreamWrapper> writer(rjStream);
-        if(!spritesDoc.Accept(writer)) {
+        bool isOk = false;
+        if(pretty) {
+            PrettyWriter<OStreamWrapper> writer(rjStream);
+            isOk = writeSprites(writer, sprites);
+        } else {
+            rj::Writer<OStreamWrapper> writer(rjStream);
+            isOk = writeSprites(writer, sprites);
+        }
+        
+        if(!isOk || !outs->put('\n').flush()) {
             CLOG(ERROR, MODULE_LOGGER) << "Error writing sprites map";
             throw sprites_map_write_error;
         }
+        
+        // The compiled index is written after the sprites map, so it isn't older than the map
+        if(gen_spritesindex_stream) {
+            auto indexOuts = this->gen_spritesindex_stream();
+            if(!indexOuts || !write_sprites_index(*indexOuts, sprites)) {
+                CLOG(ERROR, MODULE_LOGGER) << "Error writing the sprites index";
+                throw sprites_map_write_error;
+            }
+        }
     }
 };
 
@@ -119,8 +286,6 @@ json_writer_node::~json_writer_node() {
 }
 
 bool json_writer_node::add_atlas_item(atlas_item const& item) {
-    auto& allocator = _pimpl->doc.GetAllocator();
-
     // Register item in the sprites map
     string spriteName;
     if(!_pimpl->addToSpriteMap(item.image_path, spriteName)) {
@@ -129,60 +294,51 @@ bool json_writer_node::add_atlas_item(atlas_item const& item) {
             << "Sprite name "
             << spriteName
             << " already exists";
+        _pimpl->discardAtlasStream();
         return false;
     }
     
-    // Fill the items array with item's properties
-    rj::Value rectEntry(rj::kArrayType);
-    rectEntry.PushBack(rj::Value(item.box.x), allocator);
-    rectEntry.PushBack(rj::Value(item.box.y), allocator);
-    rectEntry.PushBack(rj::Value(item.box.width), allocator);
-    rectEntry.PushBack(rj::Value(item.box.height), allocator);
-
-    rj::Value itemEntry(rj::kObjectType);
-    itemEntry.AddMember(StringRef(Dict::region_rect), rectEntry, allocator);
-    itemEntry.AddMember(StringRef(Dict::region_rotated), rj::Value(item.rotated).Move(), allocator);
-    itemEntry.AddMember(StringRef(Dict::region_sprite_name), rj::Value(spriteName.c_str(), allocator).Move(),
-                        allocator);
-
-    _pimpl->itemsArray.PushBack(itemEntry, allocator);
+    if(!_pimpl->atlasStream)
+        _pimpl->openAtlasStream();
+    
+    auto& atlasStream = *_pimpl->atlasStream;
+    atlasStream.writeRegion(item, spriteName, item.source_size, item.trim_offset, nullptr);
+    
+    // Aliases share the item's rect, but keep their own names and trims
+    for(auto const& alias : item.aliases) {
+        string aliasName;
+        if(!_pimpl->addToSpriteMap(alias.image_path, aliasName)) {
+            CLOG(ERROR, MODULE_LOGGER)
+                << "Sprite name "
+                << aliasName
+                << " already exists";
+            _pimpl->discardAtlasStream();
+            return false;
+        }
+        
+        atlasStream.writeRegion(item, aliasName, alias.source_size, alias.trim_offset, &spriteName);
+    }
     
-    return safe_fwd().add_atlas_item(item);
+    if(!safe_fwd().add_atlas_item(item)) {
+        _pimpl->discardAtlasStream();
+        return false;
+    }
+    return true;
 }
 
 bool json_writer_node::begin_atlas(atlas_props const& atlas) {
-    auto& allocator = _pimpl->doc.GetAllocator();
-    auto& body = _pimpl->doc;
-    
-    // Fill the document with atlas properties
-    body.AddMember(StringRef(Dict::padding), rj::Value(atlas.padding).Move(), allocator);
-    
-    rj::Value size(rj::kArrayType);
-    size.PushBack(rj::Value(atlas.size.width).Move(), allocator);
-    size.PushBack(rj::Value(atlas.size.height).Move(), allocator);
-    body.AddMember(StringRef(Dict::size), size, allocator);
-    body.AddMember(StringRef(Dict::premiltipled), rj::Value(atlas.premultipled).Move(), allocator);
-    body.AddMember(StringRef(Dict::pixel_format), StringRef(atlas2d::pixel_format_details(atlas.fmt).formatName.c_str()), allocator);
-    
-    auto spritesMapFilename = _pimpl->sprites_map_filename;
-    if(spritesMapFilename.empty())
+    if(_pimpl->sprites_map_filename.empty())
         return false;
     
-    body.AddMember(StringRef(Dict::sprites_file), Value(spritesMapFilename.c_str(), allocator).Move(), allocator);
-
+    // Atlas properties are written with the first item
+    _pimpl->discardAtlasStream();
+    _pimpl->atlas = atlas;
     return safe_fwd().begin_atlas(atlas);
 }
 
 bool json_writer_node::end_atlas(bool finalize) {
-    auto& allocator = _pimpl->doc.GetAllocator();
-    auto& body = _pimpl->doc;
-
-    // Add the items array to the document
-    body.AddMember(StringRef(Dict::regions), _pimpl->itemsArray, allocator);
-    
-    // Write atlas' content to a stream
-    auto isAtlasEmpty = _pimpl->itemsArray.Empty();
-    _pimpl->onNextAtlas(!isAtlasEmpty);
+    // Write the rest of atlas' content to the stream
+    _pimpl->closeAtlasStream();
     
     if(finalize) {
         // Write sprites map on final stage
@@ -196,4 +352,3 @@ void json_writer_node::reset() {
     _pimpl->reset();
     safe_fwd().reset();
 }
-
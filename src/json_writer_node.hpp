@@ -1,18 +1,32 @@
 #pragma once
 
 #include "chain_node.hpp"
+#include "helpers.hpp"
+
+/// Returns the sprite name of the image, which is the file name without extension
+std::string extract_sprite_name(std::string const& image_path);
 
 /// Json writer properties
 struct json_writer_props {
     using ostream_ptr = std::shared_ptr<std::ostream>;
     using ostream_generator = std::function<ostream_ptr()>;
+    using stream_discarder = std::function<void()>;
 
     ostream_generator gen_atlas_stream;         ///< Stream factory for storing atlas content
+    stream_discarder discard_atlas_stream;      ///< Removes the content of the last atlas stream after it's closed
     ostream_generator gen_spritesmap_stream;    ///< Stream factory for storing atlas sprites map
+    ostream_generator gen_spritesindex_stream;  ///< Stream factory for storing the compiled index of the sprites map
     std::string sprites_map_filename;           ///< Atlas sprites map filename
+    sprites_map known_sprites;                  ///< Sprites of atlases which were written before
+    bool pretty = true;                         ///< Write indented json
 };
 
-/// The node dumps atlas mapping to Json format
+/**
+ @brief The node dumps atlas mapping to Json format.
+ Regions are streamed to the atlas stream as items arrive, so the node doesn't keep the atlas in memory.
+ The atlas stream is requested on the first item, so empty atlases aren't written.
+ An atlas which isn't finished because of an error or reset is discarded, so no truncated json is left.
+ */
 class json_writer_node: public chain_node {
 public:
     struct init_props: json_writer_props {
@@ -20,10 +34,18 @@ public:
         
         /// Sets stream factory for storing atlas content
         props& set_atlas_stream_generator(ostream_generator arg) {gen_atlas_stream=std::move(arg); return *this;}
+        /// Sets the remover of a partially written atlas, which is called if the atlas fails or the node is reset
+        props& set_atlas_stream_discarder(stream_discarder arg) {discard_atlas_stream=std::move(arg); return *this;}
         /// Sets stream factory for storing atlas sprites map
         props& set_spritesmap_generator(ostream_generator arg) {gen_spritesmap_stream=std::move(arg); return *this;}
+        /// Sets stream factory for storing the compiled index of the sprites map. The index isn't written by default
+        props& set_spritesindex_generator(ostream_generator arg) {gen_spritesindex_stream=std::move(arg); return *this;}
         /// Sets atlas sprites map filename
         props& set_spritesmap_filename(std::string arg) {sprites_map_filename=std::move(arg); return *this;}
+        /// Sets sprites of atlases which aren't passed to the node, but belong to the sprites map
+        props& set_known_sprites(sprites_map arg) {known_sprites=std::move(arg); return *this;}
+        /// Enables indented json. Compact json is smaller and faster to write and parse
+        props& enable_pretty(bool arg=true) {pretty=arg; return *this;}
     };
     
     explicit json_writer_node(json_writer_props const& props);
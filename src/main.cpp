@@ -1,21 +1,32 @@
 #include "forwards.hpp"
 #include "helpers.hpp"
 #include "image_io.hpp"
+#include "image_trim.hpp"
+#include "sprite_dedup.hpp"
 #include "json_writer_node.hpp"
 #include "image_writer_node.hpp"
 #include "rbp_wrappers.hpp"
+#include "max_rects_packer.hpp"
 #include "json_atlas_parser.hpp"
+#include "binary_writer_node.hpp"
+#include "binary_atlas_parser.hpp"
 #include "atlas_naming_node.hpp"
 #include "atlas_mapper_node.hpp"
+#include "sprite_scanner.hpp"
+#include "atlas_batch_builder.hpp"
+#include "thread_pool.hpp"
+#include "sprite_cache.hpp"
+#include "version.hpp"
+#include "incremental_mapping.hpp"
 #include <atlas2d/pixel_format.hpp>
 #include <rbp/MaxRectsBinPack.h>
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/range/adaptor/filtered.hpp>
 #include <iostream>
 #include <fstream>
-#include <regex>
 #include <algorithm>
+#include <regex>
+#include <set>
 #include <easylogging++.h>
 
 using namespace std;
@@ -23,31 +34,128 @@ using namespace atlas2d;
 
 namespace fs = boost::filesystem;
 namespace po = boost::program_options;
-namespace ba = boost::adaptors;
 
 INITIALIZE_EASYLOGGINGPP
 
 namespace {
 
     using atlas_naming_node_ptr = std::shared_ptr<atlas_naming_node>;
+    
+    const std::string defaultSpritesMapFilename = "sprites_map.json";
+    const std::string defaultCacheFilename = ".sprites_cache.json";
 
-    // Creates a bin with specific dimensions
-    bin_packer_ptr createBinPacker(int atlasWidth, int atlasHeight) {
-        // Create packer
-        auto binPacker = make_shared<max_rects_bin::packer>();
-        binPacker->prefs()
-        .set_bin_width(atlasWidth)
-        .set_bin_height(atlasHeight);
-        binPacker->clean_bin();
+    // Creates the factory of bins with specific preferences
+    template<typename BinT>
+    atlas_mapper_props::bin_factory createBinFactory(typename BinT::prefs prefs) {
+        return [prefs](int atlasWidth, int atlasHeight) {
+            auto binPacker = make_shared<typename BinT::packer>();
+            binPacker->prefs() = prefs;
+            binPacker->prefs()
+            .set_bin_width(atlasWidth)
+            .set_bin_height(atlasHeight);
+            binPacker->clean_bin();
+            
+            return bin_packer_ptr(binPacker);
+        };
+    }
+    
+    // Creates the factory of MaxRects bins. The native packer is used unless the rbp one is selected
+    atlas_mapper_props::bin_factory createMaxRectsFactory(po::variables_map const& vars,
+                                                          native_max_rects_bin::prefs const& prefs) {
+        if(vars["maxrects"].as<string>() != "rbp")
+            return createBinFactory<native_max_rects_bin>(prefs);
         
-        return binPacker;
+        // Both packers enumerate heuristics in the same order
+        return createBinFactory<max_rects_bin>(max_rects_bin::prefs()
+                                               .set_insert_heuristic((max_rects_bin::prefs::rbp_insert_heuristic)prefs.insert_heuristic)
+                                               .enable_global_order(prefs.global_order));
+    }
+    
+    // Creates the factory of default bins
+    atlas_mapper_props::bin_factory createBinPacker(po::variables_map const& vars) {
+        return createMaxRectsFactory(vars, native_max_rects_bin::prefs());
+    }
+    
+    // Creates strategies of the portfolio packing. The default packer goes first
+    vector<atlas_mapper_props::packing_strategy> createPortfolio(po::variables_map const& vars) {
+        using maxrects = native_max_rects_bin;
+        using skyline = rbp::SkylineBinPack;
+        using guillotine = rbp::GuillotineBinPack;
+        
+        const vector<pair<string, atlas_mapper_props::bin_factory>> packers = {
+            {"maxrects-bl", createBinPacker(vars)},
+            {"maxrects-bssf", createMaxRectsFactory(vars, maxrects::prefs().set_insert_heuristic(maxrects::best_short_side_fit))},
+            {"maxrects-blsf", createMaxRectsFactory(vars, maxrects::prefs().set_insert_heuristic(maxrects::best_long_side_fit))},
+            {"maxrects-baf", createMaxRectsFactory(vars, maxrects::prefs().set_insert_heuristic(maxrects::best_area_fit))},
+            {"maxrects-cp", createMaxRectsFactory(vars, maxrects::prefs().set_insert_heuristic(maxrects::contact_point_rule))},
+            {"skyline-bl", createBinFactory<skyline_bin>(skyline_bin::prefs().set_insert_heuristic(skyline::LevelBottomLeft))},
+            {"skyline-mw", createBinFactory<skyline_bin>(skyline_bin::prefs().set_insert_heuristic(skyline::LevelMinWasteFit))},
+            {"guillotine-baf-sla", createBinFactory<guillotine_bin>(guillotine_bin::prefs()
+                                                                   .set_insert_heuristic(guillotine::RectBestAreaFit)
+                                                                   .set_split_heuristic(guillotine::SplitShorterLeftoverAxis))},
+            {"guillotine-baf-ma", createBinFactory<guillotine_bin>(guillotine_bin::prefs()
+                                                                  .set_insert_heuristic(guillotine::RectBestAreaFit)
+                                                                  .set_split_heuristic(guillotine::SplitMinimizeArea))},
+            {"guillotine-bssf-sla", createBinFactory<guillotine_bin>(guillotine_bin::prefs()
+                                                                    .set_insert_heuristic(guillotine::RectBestShortSideFit)
+                                                                    .set_split_heuristic(guillotine::SplitShorterLeftoverAxis))},
+            {"guillotine-bssf-ma", createBinFactory<guillotine_bin>(guillotine_bin::prefs()
+                                                                   .set_insert_heuristic(guillotine::RectBestShortSideFit)
+                                                                   .set_split_heuristic(guillotine::SplitMinimizeArea))},
+        };
+        
+        const vector<pair<string, atlas_mapper_props::item_order>> orders = {
+            {"square", atlas_mapper_props::by_square},
+            {"edge", atlas_mapper_props::by_max_edge},
+            {"perimeter", atlas_mapper_props::by_perimeter},
+            {"width", atlas_mapper_props::by_width},
+            {"height", atlas_mapper_props::by_height},
+        };
+        
+        // Cheap orders of all packers go before expensive packers of other orders
+        vector<atlas_mapper_props::packing_strategy> portfolio;
+        for(auto const& order : orders) {
+            for(auto const& packer : packers) {
+                atlas_mapper_props::packing_strategy strategy;
+                strategy.name = packer.first + "/" + order.first;
+                strategy.create_bin = packer.second;
+                strategy.order = order.second;
+                portfolio.push_back(move(strategy));
+            }
+        }
+        
+        // Packers choosing the best next item themselves don't depend on the order,
+        // but score all the rest items on each insert, so they go last
+        const vector<pair<string, atlas_mapper_props::bin_factory>> globalPackers = {
+            {"maxrects-bl-global", createMaxRectsFactory(vars, maxrects::prefs().enable_global_order())},
+            {"maxrects-bssf-global", createMaxRectsFactory(vars, maxrects::prefs()
+                                                           .set_insert_heuristic(maxrects::best_short_side_fit)
+                                                           .enable_global_order())},
+            {"maxrects-baf-global", createMaxRectsFactory(vars, maxrects::prefs()
+                                                          .set_insert_heuristic(maxrects::best_area_fit)
+                                                          .enable_global_order())},
+            {"skyline-mw-global", createBinFactory<skyline_bin>(skyline_bin::prefs()
+                                                                .set_insert_heuristic(skyline::LevelMinWasteFit)
+                                                                .enable_global_order())},
+        };
+        for(auto const& packer : globalPackers) {
+            atlas_mapper_props::packing_strategy strategy;
+            strategy.name = packer.first;
+            strategy.create_bin = packer.second;
+            strategy.order = atlas_mapper_props::by_square;
+            portfolio.push_back(move(strategy));
+        }
+        
+        return portfolio;
     }
     
     // Creates atlas names generator node
-    atlas_naming_node_ptr createAtlasNamingNode(po::variables_map const& vars) {
+    atlas_naming_node_ptr createAtlasNamingNode(po::variables_map const& vars,
+                                                set<string> reservedNames = set<string>()) {
         const bool dirNaming = vars["dir-naming"].as<bool>();
         return make_shared<atlas_naming_node>(atlas_naming_node::init_props()
-                                              .enable_naming_after_dir(dirNaming));
+                                              .enable_naming_after_dir(dirNaming)
+                                              .set_reserved_names(move(reservedNames)));
     }
     
     bool extractPackingAlgo(po::variables_map const& vars, atlas_mapper_props::atlas_sizing& algo) {
@@ -57,6 +165,9 @@ namespace {
             {"bestfit", atlas_mapper_props::best_size},
             {"constant", atlas_mapper_props::constant_size},
             {"sqpow2", atlas_mapper_props::squared_pow2_size},
+            {"bestrect", atlas_mapper_props::best_rect_size},
+            {"rectpow2", atlas_mapper_props::rect_pow2_size},
+            {"portfolio", atlas_mapper_props::best_size},
         };
         
         auto pos = packingAlgos.find(packingMode);
@@ -69,11 +180,188 @@ namespace {
         return true;
     }
     
-    // Creates default atlas mapper
-    chain_node_ptr createAtlasMapper(po::variables_map const& vars) {
-        const std::string defaultSpritesMapFilename = "sprites_map.json";
+    bool extractImageWriteProps(po::variables_map const& vars, image_write_props& props) {
+        const int level = vars["png-level"].as<int>();
+        if(level < -1 || level > 9) {
+            return false;
+        }
+        
+        static const map<string, image_write_props::png_filter> pngFilters = {
+            {"default", image_write_props::png_filter_default},
+            {"none", image_write_props::png_filter_none},
+            {"sub", image_write_props::png_filter_sub},
+            {"up", image_write_props::png_filter_up},
+            {"avg", image_write_props::png_filter_average},
+            {"paeth", image_write_props::png_filter_paeth},
+            {"adaptive", image_write_props::png_filter_adaptive},
+        };
+        
+        auto pos = pngFilters.find(vars["png-filter"].as<string>());
+        if(pos == pngFilters.end()) {
+            return false;
+        }
+        
+        props.set_compression_level(level)
+        .set_png_filter(pos->second);
+        
+        return true;
+    }
+    
+    // Checks whether atlases are written to json
+    bool isJsonOutput(po::variables_map const& vars) {
+        return vars["format"].as<string>() != "binary";
+    }
+    
+    // Checks whether atlases are written to the binary format
+    bool isBinaryOutput(po::variables_map const& vars) {
+        return vars["format"].as<string>() != "json";
+    }
+    
+    // Returns the padding between sprites. Mip levels grow it to keep a texel of padding on the smallest level
+    int mappingPadding(po::variables_map const& vars) {
+        const int mipLevels = vars["mip-levels"].as<int>();
+        return (std::max)(vars["padding"].as<int>(), mipLevels > 0 ? 1 << mipLevels : 0);
+    }
+    
+    // Returns the alignment of sprite cells. Mip levels grow it, so cells are split evenly on each level
+    int mappingBlockAlign(po::variables_map const& vars) {
+        const int blockAlign = vars["block-align"].as<int>();
+        const int mipAlign = 1 << vars["mip-levels"].as<int>();
+        
+        // The least common multiple of both alignments
+        int divisor = blockAlign;
+        for(int rest = mipAlign; rest != 0;) {
+            const int next = divisor % rest;
+            divisor = rest;
+            rest = next;
+        }
+        return blockAlign / divisor * mipAlign;
+    }
+    
+    /**
+     Creates properties of the node drawing an atlas into the file, followed by mip levels if they are required.
+     The atlas is drawn by stripes of the height, if it's set, and its rows are written as soon as they are finished.
+     */
+    image_writer_node::init_props createAtlasImageProps(string const& dstFile, int mipLevels, int stripeHeight,
+                                                        image_write_props const& writeProps) {
+        auto props = image_writer_node::init_props()
+        .set_writer([dstFile, writeProps](image_props const& img) {
+            return write_image(dstFile, img, writeProps);
+        })
+        .set_block_dim(image_block_dim(dstFile));
+        
+        if(stripeHeight > 0) {
+            props.set_stripes(stripeHeight, [dstFile, writeProps](image_props const& img) {
+                return open_image_rows(dstFile, img, writeProps);
+            });
+        } else if(mipLevels > 0) {
+            props.set_mip_levels(mipLevels, [dstFile, writeProps](vector<image_props> const& levels) {
+                return write_image_levels(dstFile, levels, writeProps);
+            });
+        }
+        return props;
+    }
+    
+    // Creates the chain writing atlases to the output directory
+    chain_node_ptr createAtlasWriter(po::variables_map const& vars,
+                                     image_write_props const& writeProps,
+                                     function<string()> genAtlasName,
+                                     sprites_map const& knownSprites = sprites_map()) {
         std::string const outDir(vars["dst"].as<string>());
         
+        // The first node is in charge of writing results to JSON files
+        auto atlasFile = make_shared<string>();
+        json_writer_props::ostream_generator atlasStreamGen = [outDir, genAtlasName, atlasFile]() {
+            string atlasName = genAtlasName() + ".json";
+            *atlasFile = (fs::path(outDir) / atlasName).generic_string();
+            return make_shared<ofstream>(*atlasFile, ios_base::binary);
+        };
+        json_writer_props::stream_discarder atlasStreamDiscarder = [atlasFile]() {
+            boost::system::error_code ec;
+            fs::remove(*atlasFile, ec);
+        };
+        json_writer_props::ostream_generator spritesMapStreamGen = [outDir]() {
+            auto file = fs::path(outDir) / defaultSpritesMapFilename;
+            return make_shared<ofstream>(file.generic_string(), ios_base::binary);
+        };
+        
+        json_writer_props::ostream_generator spritesIndexStreamGen;
+        if(vars["sprites-index"].as<bool>()) {
+            spritesIndexStreamGen = [outDir]() {
+                auto file = compiled_sprites_index_filename((fs::path(outDir) / defaultSpritesMapFilename).generic_string());
+                return make_shared<ofstream>(file, ios_base::binary);
+            };
+        }
+        
+        chain_node_ptr writer, lastWriter;
+        if(isJsonOutput(vars)) {
+            writer = lastWriter = make_shared<json_writer_node>(json_writer_node::init_props()
+                                                                .set_spritesmap_filename(defaultSpritesMapFilename)
+                                                                .set_spritesmap_generator(spritesMapStreamGen)
+                                                                .set_spritesindex_generator(spritesIndexStreamGen)
+                                                                .set_atlas_stream_generator(atlasStreamGen)
+                                                                .set_atlas_stream_discarder(atlasStreamDiscarder)
+                                                                .set_known_sprites(knownSprites)
+                                                                .enable_pretty(!vars["compact-json"].as<bool>()));
+        }
+        
+        if(isBinaryOutput(vars)) {
+            // The binary mapping is written next to the json one
+            json_writer_props::ostream_generator binaryStreamGen = [outDir, genAtlasName]() {
+                string atlasName = genAtlasName() + binary_atlas_extension;
+                auto file = fs::path(outDir) / atlasName;
+                return make_shared<ofstream>(file.generic_string(), ios_base::binary);
+            };
+            auto binaryWriter = make_shared<binary_writer_node>(binary_writer_node::init_props()
+                                                                .set_atlas_stream_generator(binaryStreamGen));
+            if(lastWriter)
+                lastWriter->set_child(binaryWriter);
+            else
+                writer = binaryWriter;
+            lastWriter = binaryWriter;
+        }
+        
+        if(vars["debug-mapping"].as<bool>()) {
+            // In case of debug we attach extra drawing node to visualize
+            // packed atlases
+            image_writer_props::img_writer imgWriter = [genAtlasName, outDir, writeProps](image_props const& img) {
+                string name = genAtlasName() + ".png";
+                auto filename = fs::path(outDir) / name;
+                return write_image(filename.generic_string(), img, writeProps);
+            };
+            lastWriter->set_child(make_shared<image_writer_node>(image_writer_node::init_props()
+                                                                 .set_writer(imgWriter)));
+        }
+        
+        return writer;
+    }
+    
+    // Creates the loader of sprite pixels to compare possible duplicates, they are trimmed as the hashed ones
+    pixels_loader createPixelsLoader(po::variables_map const& vars) {
+        fs::path const srcDir(vars["src"].as<string>());
+        const bool trim = vars["trim"].as<bool>();
+        return [srcDir, trim](atlas_item& item) {
+            fs::path filename = srcDir / item.image_path;
+            filename.make_preferred();
+            
+            atlas_item loaded;
+            if(!read_image(filename.string(), loaded, true))
+                return false;
+            if(trim && !trim_image(loaded))
+                return false;
+            
+            item.size = loaded.size;
+            item.fmt = loaded.fmt;
+            item.pixels = loaded.pixels;
+            return true;
+        };
+    }
+    
+    // Creates the chain mapping sprites into atlases named by the naming node
+    chain_node_ptr createMappingChain(po::variables_map const& vars,
+                                      atlas_naming_node_ptr namingNode,
+                                      chain_node_ptr writer,
+                                      thread_pool_ptr pool) {
         auto packingAlgo = atlas_mapper_props::best_size;
         if(!extractPackingAlgo(vars, packingAlgo)) {
             LOG(ERROR) << "Invalid packing algo was selected!";
@@ -86,91 +374,100 @@ namespace {
         chain_node_ptr nextNode = chain;
         
         // Bin packer packs input images into the banch of atlases
-        auto binPackerNode = make_shared<atlas_mapper_node>(atlas_mapper_node::init_props()
-                                                          .set_algo(packingAlgo)
-                                                          .set_bin_factory(&createBinPacker));
+        auto mapperProps = atlas_mapper_node::init_props()
+        .set_algo(packingAlgo)
+        .set_bin_factory(createBinPacker(vars))
+        .allow_non_square(vars["non-square"].as<bool>())
+        .set_max_aspect_ratio(vars["max-aspect"].as<float>())
+        .set_block_align(mappingBlockAlign(vars))
+        .set_thread_pool(pool);
+        
+        if(vars["bin-type"].as<string>() == "portfolio") {
+            mapperProps
+            .set_portfolio(createPortfolio(vars))
+            .set_portfolio_budget(vars["portfolio-budget"].as<unsigned>());
+        }
+        // Identical sprites of each atlas are packed once
+        if(vars["dedup"].as<bool>())
+            nextNode = nextNode->set_child(make_shared<sprite_dedup_node>(createPixelsLoader(vars)));
+        
+        auto binPackerNode = make_shared<atlas_mapper_node>(mapperProps);
         nextNode = nextNode->set_child(binPackerNode);
 
         
         // Extra naming node following bin packer in order to avoid atlas naming issues
-        atlas_naming_node_ptr namingNode = createAtlasNamingNode(vars);
         nextNode = nextNode->set_child(namingNode);
-
         
-        // The next node is in charge of writing results to JSON files
+        // The last nodes write the results
+        nextNode->set_child(writer);
+
+        // Return builded chain
+        return chain;
+    }
+    
+    // Creates default atlas mapper
+    chain_node_ptr createAtlasMapper(po::variables_map const& vars, image_write_props const& writeProps, thread_pool_ptr pool) {
+        atlas_naming_node_ptr namingNode = createAtlasNamingNode(vars);
         weak_ptr<atlas_naming_node> weakNameingNode = namingNode;
-        json_writer_props::ostream_generator atlasStreamGen = [outDir,weakNameingNode]() {
+        auto genAtlasName = [weakNameingNode]() {
             auto nameGen = weakNameingNode.lock();
             assert(nameGen);
-            
-            string atlasName = nameGen->get_atlas_name() + ".json";
-            auto file = fs::path(outDir) / atlasName;
-            return make_shared<ofstream>(file.generic_string(), ios_base::binary);
-        };
-        json_writer_props::ostream_generator spritesMapStreamGen = [outDir, defaultSpritesMapFilename]() {
-            auto file = fs::path(outDir) / defaultSpritesMapFilename;
-            return make_shared<ofstream>(file.generic_string(), ios_base::binary);
+            return nameGen->get_atlas_name();
         };
         
-        auto jsonWriter = make_shared<json_writer_node>(json_writer_node::init_props()
-                                                         .set_spritesmap_filename(defaultSpritesMapFilename)
-                                                         .set_spritesmap_generator(spritesMapStreamGen)
-                                                         .set_atlas_stream_generator(atlasStreamGen));
-        nextNode = nextNode->set_child(jsonWriter);
-        
-        if(vars["debug-mapping"].as<bool>()) {
-            // In case of debug we attach extra drawing node to visualize
-            // packed atlases
-            image_writer_props::img_writer imgWriter = [weakNameingNode, outDir](image_props const& img) {
-                auto nameGen = weakNameingNode.lock();
-                assert(nameGen);
-                
-                string name = nameGen->get_atlas_name() + ".png";
-                auto filename = fs::path(outDir) / name;
-                return write_image(filename.generic_string(), img);
-            };
-            nextNode = nextNode->set_child(make_shared<image_writer_node>(image_writer_node::init_props()
-                                                                          .set_writer(imgWriter)));
-        }
-
-        // Return builded chain
-        return chain;
+        return createMappingChain(vars, namingNode, createAtlasWriter(vars, writeProps, genAtlasName), pool);
+    }
+    
+    // Creates the image reader which decodes images straight into the atlas whenever it's possible
+    json_parser_props::image_reader createImageReader(fs::path const& srcDir, shared_ptr<image_writer_node> builder) {
+        return [srcDir, builder](atlas_item& item) {
+            fs::path filename = srcDir / item.image_path;
+            filename.make_preferred();
+            
+            pixel_buffer target;
+            if(builder->item_target(item, target))
+                return read_image_into(filename.string(), item, target);
+            
+            return read_image(filename.string(), item, true);
+        };
     }
     
     // Build the image of an atlas map file
-    int performBuildAtlas(po::variables_map const& vars) {
+    int performBuildAtlas(po::variables_map const& vars, thread_pool_ptr pool, image_write_props const& writeProps) {
         fs::path const atlasMapFile(vars["build-atlas"].as<string>());
         fs::path const srcDir(vars["src"].as<string>());
         string const dstFile(vars["dst"].as<string>());
 
         // Create atlas builder to draw a mapped atlas
-        auto writeImageFn = [dstFile](image_props const& img) {
-            return write_image(dstFile, img);
-        };
-        auto atlas_builder = make_shared<image_writer_node>(image_writer_node::init_props()
-                                                            .set_writer(writeImageFn));
+        const int stripeHeight = vars["stripe-height"].as<int>();
+        auto atlas_builder = make_shared<image_writer_node>(createAtlasImageProps(dstFile, vars["mip-levels"].as<int>(),
+                                                                                  stripeHeight, writeProps));
         
         // Create image reader
-        auto readImageFn = [srcDir](atlas_item& item) {
-            fs::path filename = fs::path(srcDir) / item.image_path;
-            filename.make_preferred();
-            return read_image(filename.string(), item, true);
-        };
+        auto readImageFn = createImageReader(srcDir, atlas_builder);
         
-
-        // Open necessary streams
-        ifstream atlasStream(atlasMapFile.c_str(), std::ios_base::in | std::ios_base::binary);
+        if(is_binary_atlas_file(atlasMapFile.string())) {
+            // The binary mapping is mapped into memory and keeps image paths itself
+            bool res = parse_binary_atlas(atlasMapFile.string(),
+                                          json_parser_props()
+                                          .set_atlas_builder(atlas_builder)
+                                          .set_image_reader(readImageFn)
+                                          .set_sort_regions(stripeHeight > 0)
+                                          .set_thread_pool(pool));
+            if(!res) {
+                LOG(ERROR) << "An error during parsing mapped atlas " << atlasMapFile;
+                return 1;
+            }
+            return 0;
+        }
         
-        // TODO: fix using of default sprites file name
-        auto spritesMapFile = atlasMapFile.parent_path() / "sprites_map.json";
-        ifstream spritesStream(spritesMapFile.c_str(), std::ios_base::in | std::ios_base::binary);
-
-        // Parse mapped atlas
-        bool res = parse_json_atlas(atlasStream,
-                                    spritesStream,
+        // Parse mapped atlas with the sprites map recorded in it
+        bool res = parse_json_atlas(atlasMapFile.string(),
                                     json_parser_props()
                                     .set_atlas_builder(atlas_builder)
-                                    .set_image_reader(readImageFn));
+                                    .set_image_reader(readImageFn)
+                                    .set_sort_regions(stripeHeight > 0)
+                                    .set_thread_pool(pool));
         
         if(!res) {
             LOG(ERROR) << "An error during parsing mapped atlas " << atlasMapFile;
@@ -180,6 +477,325 @@ namespace {
         return 0;
     }
 
+    // Converts the wildcard pattern (* and ?) to the regular expression
+    regex wildcardToRegex(string const& pattern) {
+        static const string specialChars = "\\^$.|+()[]{}";
+        
+        string expr;
+        for(char c : pattern) {
+            if(c == '*')
+                expr += ".*";
+            else if(c == '?')
+                expr += ".";
+            else if(specialChars.find(c) != string::npos)
+                expr += string("\\") + c;
+            else
+                expr += c;
+        }
+        
+        return regex(expr);
+    }
+    
+    // Collects atlas mappings of the directory or the ones matching the wildcard pattern
+    vector<string> collectAtlasFiles(fs::path const& atlasesPath) {
+        fs::path dir = atlasesPath;
+        regex matchPattern(".*\\.(json|bin)$");
+        if(!fs::is_directory(atlasesPath)) {
+            dir = atlasesPath.parent_path();
+            matchPattern = wildcardToRegex(atlasesPath.filename().string());
+        }
+        
+        if(dir.empty())
+            dir = ".";
+        
+        vector<string> files;
+        if(!fs::is_directory(dir))
+            return files;
+        
+        for(auto const& dirEntry : fs::directory_iterator(dir)) {
+            auto const& filename = dirEntry.path().filename();
+            if(!fs::is_regular_file(dirEntry.status()) ||
+               filename == defaultSpritesMapFilename ||
+               filename == defaultCacheFilename ||
+               !regex_match(filename.string(), matchPattern))
+                continue;
+            
+            files.push_back(dirEntry.path().string());
+        }
+        
+        // Keep the output independent of the directory enumeration order
+        sort(files.begin(), files.end());
+        
+        // Atlases written in both formats are built once from their binary mappings
+        set<string> binaryStems;
+        for(auto const& file : files) {
+            if(is_binary_atlas_file(file))
+                binaryStems.insert(fs::path(file).replace_extension().string());
+        }
+        files.erase(remove_if(files.begin(), files.end(), [&binaryStems](string const& file) {
+            return !is_binary_atlas_file(file) && binaryStems.count(fs::path(file).replace_extension().string());
+        }), files.end());
+        return files;
+    }
+    
+    // Build images of the bunch of atlas map files
+    int performBuildAtlasBatch(po::variables_map const& vars, thread_pool_ptr pool, image_write_props const& writeProps) {
+        fs::path const atlasesPath(vars["build-atlas"].as<string>());
+        fs::path const srcDir(vars["src"].as<string>());
+        fs::path const dstDir(vars["dst"].as<string>());
+        
+        auto atlasFiles = collectAtlasFiles(atlasesPath);
+        if(atlasFiles.empty()) {
+            LOG(ERROR) << "No atlases found by " << atlasesPath;
+            return 1;
+        }
+        
+        boost::system::error_code ec;
+        fs::create_directories(dstDir, ec);
+        
+        // Each atlas is drawn to the image named after its mapping file
+        const string imageExt = vars["image-ext"].as<string>();
+        const int mipLevels = vars["mip-levels"].as<int>();
+        const int stripeHeight = vars["stripe-height"].as<int>();
+        auto prepareAtlasFn = [srcDir, dstDir, imageExt, mipLevels, stripeHeight, writeProps](string const& atlasFile,
+                                                                                             json_parser_props& props) {
+            auto dstFile = dstDir / (fs::path(atlasFile).stem().string() + imageExt);
+            auto builder = make_shared<image_writer_node>(createAtlasImageProps(dstFile.generic_string(), mipLevels,
+                                                                                stripeHeight, writeProps));
+            props.set_atlas_builder(builder)
+            .set_image_reader(createImageReader(srcDir, builder))
+            .set_sort_regions(stripeHeight > 0);
+            return true;
+        };
+        
+        // Sprites maps are loaded once and shared by all json atlases
+        auto results = build_atlas_batch(atlasFiles, atlas_batch_props()
+                                         .set_atlas_preparer(prepareAtlasFn)
+                                         .set_thread_pool(pool)
+                                         .set_max_in_flight(vars["max-atlases"].as<unsigned>()));
+        
+        // Summarize the batch
+        size_t builtCount = 0;
+        for(auto const& result : results) {
+            if(result.success) {
+                ++builtCount;
+                LOG(INFO) << "Built " << result.atlas_file;
+            } else {
+                LOG(ERROR) << "Failed " << result.atlas_file;
+            }
+        }
+        LOG(INFO) << "Built " << builtCount << " of " << results.size() << " atlases";
+        
+        return builtCount == results.size() ? 0 : 1;
+    }
+
+    // Creates the sprite reader which skips images unchanged since the cached run
+    sprite_scan_props::image_reader createSpriteReader(shared_ptr<sprite_cache> cache, bool loadPixels, bool trim, bool dedup) {
+        return [cache, loadPixels, trim, dedup](string const& filename, atlas_item& item) {
+            // Unchanged images don't need to be read unless their pixels are required
+            if(cache && !loadPixels && cache->lookup(item.image_path, filename, item))
+                return true;
+            
+            // Trimming and deduplication need pixels
+            if(!read_image(filename, item, loadPixels || trim || dedup))
+                return false;
+            
+            if(trim)
+                trim_image(item);
+            
+            // Duplicates are found by the trimmed images
+            if(dedup)
+                item.pixels_hash = hash_pixels(item);
+            
+            if(!loadPixels)
+                item.pixels.reset();
+            
+            if(cache)
+                cache->store(item.image_path, filename, item);
+            return true;
+        };
+    }
+    
+    // Loads atlases mapped into the output directory by the previous run
+    bool loadPreviousMapping(fs::path const& outDir, vector<atlas_mapping>& atlases, sprites_index& sprites) {
+        auto spritesMapFile = outDir / defaultSpritesMapFilename;
+        if(!fs::exists(spritesMapFile))
+            return true;
+        
+        if(!sprites.load(spritesMapFile.string())) {
+            LOG(ERROR) << "An error during parsing sprites map " << spritesMapFile;
+            return false;
+        }
+        
+        // Binary mappings are written next to json ones, the latter are enough to restore atlases
+        for(auto const& atlasFile : collectAtlasFiles(outDir / "*.json")) {
+            atlas_mapping atlas;
+            atlas.name = fs::path(atlasFile).stem().string();
+            
+            if(!load_atlas_mapping(atlasFile, sprites, atlas)) {
+                LOG(ERROR) << "An error during parsing mapped atlas " << atlasFile;
+                return false;
+            }
+            atlases.push_back(move(atlas));
+        }
+        
+        return true;
+    }
+    
+    /**
+     Maps sprites keeping atlases of the previous run whenever it's possible.
+     Paths of written atlases are printed to the standard output, so only these ones need to be built.
+     */
+    int performIncrementalMapping(po::variables_map const& vars,
+                                  image_write_props const& writeProps,
+                                  atlas_props const& atlas,
+                                  sprite_scan_props const& scanProps,
+                                  shared_ptr<sprite_cache> cache) {
+        fs::path const outDir(vars["dst"].as<string>());
+        
+        vector<atlas_mapping> previous;
+        sprites_index previousSprites;
+        if(!loadPreviousMapping(outDir, previous, previousSprites))
+            return 1;
+        
+        // Collect actual sprites
+        atlas_collector collector;
+        collector.begin_atlas(atlas);
+        if(!scan_sprites(collector, scanProps))
+            return 1;
+        
+        // Keep as much of the previous mapping as possible
+        auto groupNaming = createAtlasNamingNode(vars);
+        if(vars["dedup"].as<bool>()) {
+            merge_duplicates(collector.atlases().front().items, [groupNaming](atlas_item const& item) {
+                return groupNaming->get_item_atlas_name(item);
+            }, createPixelsLoader(vars));
+        }
+        // Cache hits keep the previous hash, stored files are hashed in the incremental mode,
+        // so the unknown hash of a non incremental run never matches a changed file
+        auto isImageChanged = [cache](atlas_item const& item) {
+            sprite_cache_entry previousEntry, actualEntry;
+            return !cache ||
+            !cache->find_previous(item.image_path, previousEntry) ||
+            !cache->find(item.image_path, actualEntry) ||
+            previousEntry.content_hash != actualEntry.content_hash;
+        };
+        
+        incremental_mapping_result result;
+        map_incrementally(previous, collector.atlases().front(), incremental_mapping_props()
+                          .set_bin_factory(createBinPacker(vars))
+                          .set_block_align(mappingBlockAlign(vars))
+                          .set_change_checker(isImageChanged)
+                          .set_group_extractor([groupNaming](atlas_item const& item) {
+                              return groupNaming->get_item_atlas_name(item);
+                          }),
+                          result);
+        
+        // Names of kept atlases are taken, sprites of clean ones go to the sprites map as is
+        set<string> reservedNames;
+        set<string> cleanImages;
+        for(auto const& prevAtlas : result.atlases) {
+            if(prevAtlas.state == atlas_state::removed)
+                continue;
+            
+            reservedNames.insert(prevAtlas.name);
+            if(prevAtlas.state != atlas_state::clean)
+                continue;
+            
+            for(auto const& item : prevAtlas.items) {
+                cleanImages.insert(item.image_path);
+                for(auto const& alias : item.aliases)
+                    cleanImages.insert(alias.image_path);
+            }
+        }
+        
+        sprites_map knownSprites;
+        for(size_t i = 0; i < previousSprites.size(); ++i) {
+            auto sprite = previousSprites[i];
+            auto imagePath = sprite.second.to_string();
+            if(cleanImages.count(imagePath))
+                knownSprites.insert(make_pair(sprite.first.to_string(), move(imagePath)));
+        }
+        
+        // Previous atlases are written under their own names, the new ones are named by the naming node
+        auto namingNode = createAtlasNamingNode(vars, reservedNames);
+        weak_ptr<atlas_naming_node> weakNameingNode = namingNode;
+        auto fixedName = make_shared<string>();
+        auto writtenNames = make_shared<set<string>>();
+        auto genAtlasName = [weakNameingNode, fixedName, writtenNames]() {
+            string name = *fixedName;
+            if(name.empty()) {
+                auto nameGen = weakNameingNode.lock();
+                assert(nameGen);
+                name = nameGen->get_atlas_name();
+            }
+            
+            writtenNames->insert(name);
+            return name;
+        };
+        
+        auto writer = createAtlasWriter(vars, writeProps, genAtlasName, knownSprites);
+        auto mappingChain = createMappingChain(vars, namingNode, writer, scanProps.pool);
+        if(!mappingChain) {
+            LOG(ERROR) << "Error during creating the default writer";
+            return 1;
+        }
+        mappingChain->reset();
+        
+        for(auto const& prevAtlas : result.atlases) {
+            auto atlasFile = outDir / (prevAtlas.name + ".json");
+            if(prevAtlas.state == atlas_state::removed) {
+                LOG(INFO) << "Removing the atlas " << atlasFile;
+                boost::system::error_code ec;
+                fs::remove(atlasFile, ec);
+                fs::remove(outDir / (prevAtlas.name + binary_atlas_extension), ec);
+                fs::remove(outDir / (prevAtlas.name + ".png"), ec);
+                continue;
+            }
+            
+            if(prevAtlas.state == atlas_state::clean)
+                continue;
+            
+            *fixedName = prevAtlas.name;
+            bool res = writer->begin_atlas(prevAtlas.atlas);
+            for(auto const& item : prevAtlas.items) {
+                res = res && writer->add_atlas_item(item);
+            }
+            res = res && writer->end_atlas(false);
+            if(!res) {
+                LOG(ERROR) << "Error during writing the atlas " << atlasFile;
+                return 1;
+            }
+        }
+        fixedName->clear();
+        
+        // Map the rest sprites into new atlases
+        if(!result.leftovers.empty()) {
+            bool res = mappingChain->begin_atlas(atlas);
+            for(auto const& item : result.leftovers) {
+                res = res && mappingChain->add_atlas_item(item);
+            }
+            res = res && mappingChain->end_atlas(false);
+            if(!res) {
+                LOG(ERROR) << "Error during mapping new sprites";
+                return 1;
+            }
+        }
+        
+        // Write the sprites map of all atlases
+        writer->set_child(nullptr);
+        if(!writer->begin_atlas(atlas) || !writer->end_atlas(true)) {
+            LOG(ERROR) << "Error during finalizing";
+            return 1;
+        }
+        
+        for(auto const& name : *writtenNames) {
+            cout << (outDir / (name + ".json")).generic_string() << endl;
+        }
+        
+        return 0;
+    }
+
     // Setup logging
     void initLogging(po::variables_map const& vars) {
         el::Loggers::addFlag(el::LoggingFlag::CreateLoggerAutomatically);
@@ -208,15 +824,34 @@ int main(int argc, const char * argv[]) {
         ("width,w", po::value<int>(), "Atlas width")
         ("height,h", po::value<int>(), "Atlas height")
         ("padding,p", po::value<int>()->default_value(0), "Padding between sprites")
+        ("block-align", po::value<int>()->default_value(1), "Align sprites with their paddings to blocks of the size (4 for ETC2 textures)")
         ("pixel-format", po::value<string>()->default_value("rgba8"), "Set preffered pixel format")
-        ("bin-type", po::value<string>()->default_value("bestfit"), "Atlas packing algorithm [constant, bestfit, sqpow2]")
+        ("bin-type", po::value<string>()->default_value("bestfit"), "Atlas packing algorithm [constant, bestfit, sqpow2, bestrect, rectpow2, portfolio]")
+        ("maxrects", po::value<string>()->default_value("native"), "MaxRects packer implementation [native, rbp]. Both give identical placements")
+        ("portfolio-budget", po::value<unsigned>()->default_value(0), "Time budget of the portfolio packing per atlas in ms (0 - unlimited)")
+        ("non-square", po::bool_switch()->default_value(false), "Allow non-square atlases for the bestfit packing algorithm")
+        ("max-aspect", po::value<float>()->default_value(0.0f), "Max aspect ratio of non-square atlases (0 - unlimited)")
+        ("format", po::value<string>()->default_value("json"), "Atlas mapping format [json, binary, both]")
+        ("compact-json", po::bool_switch()->default_value(false), "Write json atlases without indentation")
+        ("sprites-index", po::bool_switch()->default_value(false), "Write the compiled index of the sprites map to speed up building of atlases")
         ("debug-mapping", po::bool_switch()->default_value(false), "Draw the image of each atlas during builing of jsons")
-        ("build-atlas", po::value<string>(), "Json atlas to build")
+        ("build-atlas", po::value<string>(), "Json or binary atlas to build. A directory or a wildcard pattern builds the bunch of atlases into the output directory")
+        ("image-ext", po::value<string>()->default_value(".png"), "Image format of atlases built from a directory or a pattern [.png, .ktx]")
+        ("mip-levels", po::value<int>()->default_value(0), "Number of mip levels built below atlas images. Mapping grows padding and alignment of sprites to 2^levels")
+        ("stripe-height", po::value<int>()->default_value(0), "Build PNG atlases by stripes of the height and write their rows as soon as they are drawn (0 - draw whole atlases)")
+        ("max-atlases", po::value<unsigned>()->default_value(0), "Max number of atlases built simultaneously (0 - number of hardware threads)")
+        ("trim", po::bool_switch()->default_value(false), "Trim transparent borders of sprites before packing")
+        ("dedup", po::bool_switch()->default_value(false), "Pack sprites with identical images once and write the rest as aliases")
         ("premultiple-alpha", po::bool_switch()->default_value(false), "Premultiple alpha channel")
         ("dir-naming", po::bool_switch()->default_value(false), "Name json files after their parent directories")
         ("src", po::value<string>()->required(), "Source directory")
         ("dst", po::value<string>()->required(), "Output directory")
         ("filter,f", po::value<string>()->default_value(".*\\.png$"), "Image file filter")
+        ("incremental", po::bool_switch()->default_value(false), "Keep atlases of the output directory which weren't changed and print paths of written ones")
+        ("no-cache", po::bool_switch()->default_value(false), "Don't use the sprites metadata cache of the output directory")
+        ("jobs,j", po::value<unsigned>()->default_value(0), "Number of worker threads (0 - use all hardware threads)")
+        ("png-level", po::value<int>()->default_value(-1), "PNG compression level [0-9] (-1 - default level)")
+        ("png-filter", po::value<string>()->default_value("default"), "PNG row filter [default, none, sub, up, avg, paeth, adaptive]")
     ;
     
     po::positional_options_description pos;
@@ -240,36 +875,85 @@ int main(int argc, const char * argv[]) {
     }
 
     initLogging(vars);
+    
+    // Worker threads shared by all stages
+    auto pool = make_shared<thread_pool>(vars["jobs"].as<unsigned>());
+    
+    image_write_props writeProps;
+    if(!extractImageWriteProps(vars, writeProps)) {
+        LOG(ERROR) << "Invalid PNG encoding options";
+        return 1;
+    }
+    writeProps.set_thread_pool(pool);
 
-    if(vars.count("build-atlas")) {
-        // Build an atlas by json map
-        LOG(INFO) << "Perform atlas building";
-        return performBuildAtlas(vars);
+    const string mappingFormat = vars["format"].as<string>();
+    if(mappingFormat != "json" && mappingFormat != "binary" && mappingFormat != "both") {
+        LOG(ERROR) << "Unknown atlas mapping format " << mappingFormat;
+        return 1;
     }
 
-    // Performing atlas mapping mode
-    
-    auto is_file = [](fs::directory_entry const& e){
-        return fs::is_regular_file(e.status());
-    };
+    const string maxRectsPacker = vars["maxrects"].as<string>();
+    if(maxRectsPacker != "native" && maxRectsPacker != "rbp") {
+        LOG(ERROR) << "Unknown MaxRects packer " << maxRectsPacker;
+        return 1;
+    }
 
-    const regex matchPattern(vars["filter"].as<string>(), regex_constants::grep);
-    auto matched_pattern = [&matchPattern](fs::directory_entry const& e) {
-        return regex_match(e.path().string(), matchPattern);
-    };
+    if(vars["block-align"].as<int>() < 1) {
+        LOG(ERROR) << "Invalid block alignment";
+        return 1;
+    }
     
-    // create and set up the Atlas Mapper
-    auto atlasMapper = createAtlasMapper(vars);
-    if(!atlasMapper) {
-        LOG(ERROR) << "Error during creating the default writer";
+    if(vars["mip-levels"].as<int>() < 0 || vars["mip-levels"].as<int>() > 15) {
+        LOG(ERROR) << "Invalid number of mip levels";
         return 1;
     }
     
+    if(vars["stripe-height"].as<int>() < 0) {
+        LOG(ERROR) << "Invalid stripe height";
+        return 1;
+    }
+    
+    if(vars["stripe-height"].as<int>() > 0 && vars["mip-levels"].as<int>() > 0) {
+        LOG(ERROR) << "Mip levels can't be built by stripes";
+        return 1;
+    }
+    
+    if(!is_image_writable("atlas" + vars["image-ext"].as<string>())) {
+        LOG(ERROR) << "Unsupported image format " << vars["image-ext"].as<string>();
+        return 1;
+    }
+    
+    if(vars["stripe-height"].as<int>() > 0) {
+        // A single atlas is built into the dst file, atlases of a directory or a pattern get the image extension
+        const bool singleAtlas = vars.count("build-atlas") && fs::is_regular_file(fs::path(vars["build-atlas"].as<string>()));
+        const string atlasFile = singleAtlas ? vars["dst"].as<string>() : "atlas" + vars["image-ext"].as<string>();
+        if(!is_image_rows_writable(atlasFile)) {
+            LOG(ERROR) << "Atlas " << atlasFile << " can't be built by stripes, only PNG atlases can";
+            return 1;
+        }
+    }
+    
+    if(vars.count("build-atlas")) {
+        // Build an atlas by json map
+        fs::path const atlasesPath(vars["build-atlas"].as<string>());
+        if(!fs::is_regular_file(atlasesPath)) {
+            LOG(INFO) << "Perform batch atlas building";
+            return performBuildAtlasBatch(vars, pool, writeProps);
+        }
+        
+        LOG(INFO) << "Perform atlas building";
+        return performBuildAtlas(vars, pool, writeProps);
+    }
+
+    // Performing atlas mapping mode
+    
     const string srcDir(vars["src"].as<string>());
     const int atlasWidth = vars["width"].as<int>();
     const int atlasHeight = vars["height"].as<int>();
-    const int padding = vars["padding"].as<int>();
+    const int padding = mappingPadding(vars);
     const bool debugMapping = vars["debug-mapping"].as<bool>();
+    const bool trimSprites = vars["trim"].as<bool>();
+    const bool dedupSprites = vars["dedup"].as<bool>();
     const bool premultipled = vars["premultiple-alpha"].as<bool>();
     const pixel_format pixelFormat = pixel_format_details(vars["pixel-format"].as<string>()).format;
 
@@ -281,9 +965,60 @@ int main(int argc, const char * argv[]) {
     atlas_props atlas;
     atlas.size = size(atlasWidth, atlasHeight);
     atlas.padding = padding;
+    atlas.block_align = mappingBlockAlign(vars);
     atlas.fmt = pixelFormat;
     atlas.premultipled = premultipled;
     
+    // The compiled index of a previous run could be taken for the index of the rewritten sprites map
+    if(!vars["sprites-index"].as<bool>()) {
+        boost::system::error_code ec;
+        auto spritesMapFile = fs::path(vars["dst"].as<string>()) / defaultSpritesMapFilename;
+        fs::remove(compiled_sprites_index_filename(spritesMapFile.generic_string()), ec);
+    }
+    
+    // Load metadata of images processed by the previous run
+    shared_ptr<sprite_cache> cache;
+    const auto cacheFile = fs::path(vars["dst"].as<string>()) / defaultCacheFilename;
+    if(!vars["no-cache"].as<bool>()) {
+        cache = make_shared<sprite_cache>(sprite_cache::init_props()
+                                          .set_tool_version(ATLAS2D_MAPPER_VERSION)
+                                          .set_options("filter=" + vars["filter"].as<string>() +
+                                                       ";trim=" + (trimSprites ? "1" : "0") +
+                                                       ";dedup=" + (dedupSprites ? "1" : "0") +
+                                                       ";pixels_hash=" + to_string(pixels_hash_version))
+                                          .enable_content_hash(vars["incremental"].as<bool>()));
+        cache->load(cacheFile.string());
+    }
+    
+    // Process each image
+    auto scanProps = sprite_scan_props()
+    .set_src_dir(srcDir)
+    .set_filter(vars["filter"].as<string>())
+    .set_image_reader(createSpriteReader(cache, debugMapping, trimSprites, dedupSprites))
+    .set_thread_pool(pool);
+    
+    if(vars["incremental"].as<bool>()) {
+        if(!isJsonOutput(vars)) {
+            // The previous mapping is loaded from json atlases
+            LOG(ERROR) << "The incremental mode requires the json mapping format";
+            return 1;
+        }
+        
+        LOG(INFO) << "Perform updating JSON atlases";
+        int res = performIncrementalMapping(vars, writeProps, atlas, scanProps, cache);
+        if(res == 0 && cache && !cache->save(cacheFile.string())) {
+            LOG(WARNING) << "Error saving the sprites cache";
+        }
+        return res;
+    }
+    
+    // create and set up the Atlas Mapper
+    auto atlasMapper = createAtlasMapper(vars, writeProps, pool);
+    if(!atlasMapper) {
+        LOG(ERROR) << "Error during creating the default writer";
+        return 1;
+    }
+    
     // data processing...
     LOG(INFO) << "Perform creating JSON atlases";
     atlasMapper->reset();
@@ -292,28 +1027,9 @@ int main(int argc, const char * argv[]) {
         return 1;
     }
     
-    // Process each image
-    for(auto const& dirEntry : fs::recursive_directory_iterator(srcDir)
-        | ba::filtered(is_file) | ba::filtered(matched_pattern))
-    {
-        auto imageFile = fs::relative(dirEntry.path(), srcDir);
-        LOG(INFO) << "Processing " << imageFile;
-        
-        atlas_item item;
-        item.image_path = imageFile.generic_string();
-        
-        fs::path filename = srcDir / imageFile;
-        if(!read_image(filename.generic_string(), item, debugMapping)) {
-            LOG(ERROR) << "Error reading the " << filename << " file";
-            return 1;
-        }
-        
-        if(!atlasMapper->add_atlas_item(item)) {
-            LOG(ERROR)  << "Error during adding the sprite "
-            << filename
-            << " to the atlas";
-            return 1;
-        }
+    bool res = scan_sprites(*atlasMapper, scanProps);
+    if(!res) {
+        return 1;
     }
     
     // Finalize atlas
@@ -322,6 +1038,9 @@ int main(int argc, const char * argv[]) {
         return 1;
     }
     
+    if(cache && !cache->save(cacheFile.string())) {
+        LOG(WARNING) << "Error saving the sprites cache";
+    }
+    
     return 0;
 }
-
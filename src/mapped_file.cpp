@@ -0,0 +1,121 @@
+#include "mapped_file.hpp"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <istream>
+#include <iterator>
+#include <vector>
+#include <cctype>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "mapped_file"
+
+using namespace ::std;
+
+namespace bip = boost::interprocess;
+
+struct mapped_file::Pimpl {
+    bip::file_mapping mapping;  ///< Mapped file
+    bip::mapped_region region;  ///< Mapped content of the file
+};
+
+mapped_file::mapped_file(): _pimpl(new Pimpl) {
+    ;;
+}
+
+mapped_file::~mapped_file() {
+    ;;
+}
+
+bool mapped_file::open(std::string const& filename, bool copy_on_write) {
+    close();
+    
+    try {
+        bip::file_mapping mapping(filename.c_str(), bip::read_only);
+        bip::mapped_region region(mapping, copy_on_write ? bip::copy_on_write : bip::read_only);
+        
+        _pimpl->mapping.swap(mapping);
+        _pimpl->region.swap(region);
+    } catch(bip::interprocess_exception const& e) {
+        CLOG(ERROR, MODULE_LOGGER) << "Error mapping " << filename << ": " << e.what();
+        return false;
+    }
+    
+    return true;
+}
+
+void mapped_file::close() {
+    _pimpl.reset(new Pimpl);
+}
+
+unsigned char* mapped_file::data() const {
+    return static_cast<unsigned char*>(_pimpl->region.get_address());
+}
+
+size_t mapped_file::size() const {
+    return _pimpl->region.get_size();
+}
+
+struct mapped_text::Pimpl {
+    mapped_file file;   ///< Mapped file ending with a whitespace
+    vector<char> copy;  ///< Copied text of other files
+    char* text = nullptr;
+    size_t size = 0;
+    
+    // Terminates the mapped text in place of its trailing whitespace
+    bool terminateMapped() {
+        if(!file.size() || !isspace(file.data()[file.size() - 1]))
+            return false;
+        
+        text = reinterpret_cast<char*>(file.data());
+        size = file.size() - 1;
+        text[size] = '\0';
+        return true;
+    }
+    
+    void terminateCopy() {
+        size = copy.size();
+        copy.push_back('\0');
+        text = copy.data();
+    }
+};
+
+mapped_text::mapped_text(): _pimpl(new Pimpl) {
+    ;;
+}
+
+mapped_text::~mapped_text() {
+    ;;
+}
+
+bool mapped_text::open(std::string const& filename) {
+    _pimpl.reset(new Pimpl);
+    if(!_pimpl->file.open(filename, true))
+        return false;
+    
+    if(_pimpl->terminateMapped())
+        return true;
+    
+    auto const* data = _pimpl->file.data();
+    _pimpl->copy.assign(data, data + _pimpl->file.size());
+    _pimpl->file.close();
+    _pimpl->terminateCopy();
+    return true;
+}
+
+bool mapped_text::read(std::istream& stream) {
+    _pimpl.reset(new Pimpl);
+    if(!stream)
+        return false;
+    
+    _pimpl->copy.assign(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+    _pimpl->terminateCopy();
+    return true;
+}
+
+char* mapped_text::data() {
+    return _pimpl->text;
+}
+
+size_t mapped_text::size() const {
+    return _pimpl->size;
+}
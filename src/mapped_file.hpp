@@ -0,0 +1,57 @@
+#pragma once
+
+#include "forwards.hpp"
+#include <iosfwd>
+
+/**
+ @brief Memory mapped file.
+ Copy-on-write mapping allows to modify the content without touching the file itself.
+ */
+class mapped_file {
+public:
+    mapped_file();
+    ~mapped_file();
+    
+    /// Maps the whole file into memory
+    bool open(std::string const& filename, bool copy_on_write = false);
+    
+    /// Unmaps the file
+    void close();
+    
+    /// Returns the mapped content
+    unsigned char* data() const;
+    
+    /// Returns the size of the mapped content
+    size_t size() const;
+    
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
+
+/**
+ @brief Zero terminated text of the file for in-situ parsing.
+ A file ending with a whitespace is mapped copy-on-write and the whitespace is replaced by the terminator,
+ so the text is parsed right in the mapped memory. The content of other files is copied.
+ */
+class mapped_text {
+public:
+    mapped_text();
+    ~mapped_text();
+    
+    /// Loads the text of the file
+    bool open(std::string const& filename);
+    
+    /// Reads the rest of the stream
+    bool read(std::istream& stream);
+    
+    /// Returns the zero terminated text. It can be modified by the in-situ parsing
+    char* data();
+    
+    /// Returns the size of the text without the terminator
+    size_t size() const;
+    
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
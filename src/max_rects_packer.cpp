@@ -0,0 +1,470 @@
+#include "max_rects_packer.hpp"
+#include "helpers.hpp"
+#include <vector>
+#include <unordered_map>
+#include <limits>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace ::std;
+
+namespace {
+
+    using IndexList = vector<size_t>;
+    using EdgeIndex = unordered_map<int, IndexList>;
+
+    const IndexList emptyIndexList;
+
+    bool isContainedIn(rect const& a, rect const& b) {
+        return a.x >= b.x && a.y >= b.y
+        && a.x + a.width <= b.x + b.width
+        && a.y + a.height <= b.y + b.height;
+    }
+
+    // Returns the length of the common part of two intervals
+    int commonIntervalLength(int i1start, int i1end, int i2start, int i2end) {
+        if(i1end < i2start || i2end < i1start)
+            return 0;
+        return (std::min)(i1end, i2end) - (std::max)(i1start, i2start);
+    }
+
+    // Returns rects having an edge at the coordinate
+    IndexList const& findEdges(EdgeIndex const& index, int coord) {
+        auto pos = index.find(coord);
+        return pos != index.end() ? pos->second : emptyIndexList;
+    }
+
+} // anonymous
+
+struct native_max_rects_bin::packer::Pimpl {
+    vector<rect> freeRects;     ///< Free rects in the order of rbp::MaxRectsBinPack
+    vector<rect> newRects;      ///< Free rects created by the current insert
+    vector<rect> usedRects;     ///< Placed rects
+    EdgeIndex usedByX;          ///< Placed rects by their left and right edges
+    EdgeIndex usedByY;          ///< Placed rects by their top and bottom edges
+    unsigned long usedArea = 0; ///< Square of placed rects
+
+    void reset(int width, int height) {
+        freeRects.clear();
+        newRects.clear();
+        usedRects.clear();
+        usedByX.clear();
+        usedByY.clear();
+        usedArea = 0;
+
+        freeRects.push_back(rect(0, 0, width, height));
+    }
+
+    rect findBottomLeft(int width, int height, bool allowFlip, int& bestY, int& bestX) const {
+        rect bestNode;
+        bestY = numeric_limits<int>::max();
+        bestX = numeric_limits<int>::max();
+
+        for(auto const& freeRect : freeRects) {
+            // Try to place the rectangle in upright (non-flipped) orientation.
+            if(freeRect.width >= width && freeRect.height >= height) {
+                int topSideY = freeRect.y + height;
+                if(topSideY < bestY || (topSideY == bestY && freeRect.x < bestX)) {
+                    bestNode = rect(freeRect.x, freeRect.y, width, height);
+                    bestY = topSideY;
+                    bestX = freeRect.x;
+                }
+            }
+            if(allowFlip && freeRect.width >= height && freeRect.height >= width) {
+                int topSideY = freeRect.y + width;
+                if(topSideY < bestY || (topSideY == bestY && freeRect.x < bestX)) {
+                    bestNode = rect(freeRect.x, freeRect.y, height, width);
+                    bestY = topSideY;
+                    bestX = freeRect.x;
+                }
+            }
+        }
+
+        return bestNode;
+    }
+
+    rect findBestShortSideFit(int width, int height, bool allowFlip, int& bestShortSideFit, int& bestLongSideFit) const {
+        rect bestNode;
+        bestShortSideFit = numeric_limits<int>::max();
+        bestLongSideFit = numeric_limits<int>::max();
+
+        for(auto const& freeRect : freeRects) {
+            if(freeRect.width >= width && freeRect.height >= height) {
+                int leftoverHoriz = abs(freeRect.width - width);
+                int leftoverVert = abs(freeRect.height - height);
+                int shortSideFit = (std::min)(leftoverHoriz, leftoverVert);
+                int longSideFit = (std::max)(leftoverHoriz, leftoverVert);
+
+                if(shortSideFit < bestShortSideFit || (shortSideFit == bestShortSideFit && longSideFit < bestLongSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, width, height);
+                    bestShortSideFit = shortSideFit;
+                    bestLongSideFit = longSideFit;
+                }
+            }
+            if(allowFlip && freeRect.width >= height && freeRect.height >= width) {
+                int flippedLeftoverHoriz = abs(freeRect.width - height);
+                int flippedLeftoverVert = abs(freeRect.height - width);
+                int flippedShortSideFit = (std::min)(flippedLeftoverHoriz, flippedLeftoverVert);
+                int flippedLongSideFit = (std::max)(flippedLeftoverHoriz, flippedLeftoverVert);
+
+                if(flippedShortSideFit < bestShortSideFit || (flippedShortSideFit == bestShortSideFit && flippedLongSideFit < bestLongSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, height, width);
+                    bestShortSideFit = flippedShortSideFit;
+                    bestLongSideFit = flippedLongSideFit;
+                }
+            }
+        }
+
+        return bestNode;
+    }
+
+    rect findBestLongSideFit(int width, int height, bool allowFlip, int& bestShortSideFit, int& bestLongSideFit) const {
+        rect bestNode;
+        bestShortSideFit = numeric_limits<int>::max();
+        bestLongSideFit = numeric_limits<int>::max();
+
+        for(auto const& freeRect : freeRects) {
+            if(freeRect.width >= width && freeRect.height >= height) {
+                int leftoverHoriz = abs(freeRect.width - width);
+                int leftoverVert = abs(freeRect.height - height);
+                int shortSideFit = (std::min)(leftoverHoriz, leftoverVert);
+                int longSideFit = (std::max)(leftoverHoriz, leftoverVert);
+
+                if(longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, width, height);
+                    bestShortSideFit = shortSideFit;
+                    bestLongSideFit = longSideFit;
+                }
+            }
+            if(allowFlip && freeRect.width >= height && freeRect.height >= width) {
+                int leftoverHoriz = abs(freeRect.width - height);
+                int leftoverVert = abs(freeRect.height - width);
+                int shortSideFit = (std::min)(leftoverHoriz, leftoverVert);
+                int longSideFit = (std::max)(leftoverHoriz, leftoverVert);
+
+                if(longSideFit < bestLongSideFit || (longSideFit == bestLongSideFit && shortSideFit < bestShortSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, height, width);
+                    bestShortSideFit = shortSideFit;
+                    bestLongSideFit = longSideFit;
+                }
+            }
+        }
+
+        return bestNode;
+    }
+
+    rect findBestAreaFit(int width, int height, bool allowFlip, int& bestAreaFit, int& bestShortSideFit) const {
+        rect bestNode;
+        bestAreaFit = numeric_limits<int>::max();
+        bestShortSideFit = numeric_limits<int>::max();
+
+        for(auto const& freeRect : freeRects) {
+            int areaFit = freeRect.width * freeRect.height - width * height;
+
+            // Try to place the rectangle in upright (non-flipped) orientation.
+            if(freeRect.width >= width && freeRect.height >= height) {
+                int leftoverHoriz = abs(freeRect.width - width);
+                int leftoverVert = abs(freeRect.height - height);
+                int shortSideFit = (std::min)(leftoverHoriz, leftoverVert);
+
+                if(areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, width, height);
+                    bestShortSideFit = shortSideFit;
+                    bestAreaFit = areaFit;
+                }
+            }
+            if(allowFlip && freeRect.width >= height && freeRect.height >= width) {
+                int leftoverHoriz = abs(freeRect.width - height);
+                int leftoverVert = abs(freeRect.height - width);
+                int shortSideFit = (std::min)(leftoverHoriz, leftoverVert);
+
+                if(areaFit < bestAreaFit || (areaFit == bestAreaFit && shortSideFit < bestShortSideFit)) {
+                    bestNode = rect(freeRect.x, freeRect.y, height, width);
+                    bestShortSideFit = shortSideFit;
+                    bestAreaFit = areaFit;
+                }
+            }
+        }
+
+        return bestNode;
+    }
+
+    // Scores the placement by the length of edges touching the bin and placed rects
+    int contactPointScore(int x, int y, int width, int height, int binWidth, int binHeight) const {
+        int score = 0;
+
+        if(x == 0 || x + width == binWidth)
+            score += height;
+        if(y == 0 || y + height == binHeight)
+            score += width;
+
+        // Only rects with an edge at the sides of the placement can touch it
+        for(int edgeX : {x + width, x}) {
+            for(auto i : findEdges(usedByX, edgeX)) {
+                auto const& used = usedRects[i];
+                if(used.x == x + width || used.x + used.width == x)
+                    score += commonIntervalLength(used.y, used.y + used.height, y, y + height);
+            }
+        }
+        for(int edgeY : {y + height, y}) {
+            for(auto i : findEdges(usedByY, edgeY)) {
+                auto const& used = usedRects[i];
+                if(used.y == y + height || used.y + used.height == y)
+                    score += commonIntervalLength(used.x, used.x + used.width, x, x + width);
+            }
+        }
+
+        return score;
+    }
+
+    rect findContactPoint(int width, int height, bool allowFlip, int binWidth, int binHeight, int& bestContactScore) const {
+        rect bestNode;
+        bestContactScore = -1;
+
+        for(auto const& freeRect : freeRects) {
+            // Try to place the rectangle in upright (non-flipped) orientation.
+            if(freeRect.width >= width && freeRect.height >= height) {
+                int score = contactPointScore(freeRect.x, freeRect.y, width, height, binWidth, binHeight);
+                if(score > bestContactScore) {
+                    bestNode = rect(freeRect.x, freeRect.y, width, height);
+                    bestContactScore = score;
+                }
+            }
+            if(allowFlip && freeRect.width >= height && freeRect.height >= width) {
+                int score = contactPointScore(freeRect.x, freeRect.y, height, width, binWidth, binHeight);
+                if(score > bestContactScore) {
+                    bestNode = rect(freeRect.x, freeRect.y, height, width);
+                    bestContactScore = score;
+                }
+            }
+        }
+
+        return bestNode;
+    }
+
+    /**
+     Finds the position of the rect by the heuristic and scores it as rbp::MaxRectsBinPack::ScoreRect does.
+     The lower scores are the better ones, a rect which doesn't fit gets the maximal scores.
+     */
+    rect scoreRect(int width, int height, native_max_rects_bin::prefs const& prefs, int& score1, int& score2) const {
+        rect node;
+        score1 = numeric_limits<int>::max();
+        score2 = numeric_limits<int>::max();
+        switch (prefs.insert_heuristic) {
+            case best_short_side_fit:
+                node = findBestShortSideFit(width, height, prefs.allow_flip, score1, score2);
+                break;
+            case best_long_side_fit:
+                node = findBestLongSideFit(width, height, prefs.allow_flip, score2, score1);
+                break;
+            case best_area_fit:
+                node = findBestAreaFit(width, height, prefs.allow_flip, score1, score2);
+                break;
+            case contact_point_rule:
+                node = findContactPoint(width, height, prefs.allow_flip, prefs.bin_width, prefs.bin_height, score1);
+                // the bigger contact is the better one
+                score1 = -score1;
+                break;
+            default:
+                node = findBottomLeft(width, height, prefs.allow_flip, score1, score2);
+                break;
+        }
+
+        if(node.width == 0 || node.height == 0) {
+            score1 = numeric_limits<int>::max();
+            score2 = numeric_limits<int>::max();
+        }
+        return node;
+    }
+
+    // Splits the free rect by the used one. Returns false if they don't intersect
+    bool splitFreeRect(rect const& freeRect, rect const& used) {
+        // Test with SAT if the rectangles even intersect.
+        if(used.x >= freeRect.x + freeRect.width || used.x + used.width <= freeRect.x ||
+           used.y >= freeRect.y + freeRect.height || used.y + used.height <= freeRect.y)
+            return false;
+
+        if(used.x < freeRect.x + freeRect.width && used.x + used.width > freeRect.x) {
+            // New rect at the top side of the used rect.
+            if(used.y > freeRect.y && used.y < freeRect.y + freeRect.height) {
+                rect newRect = freeRect;
+                newRect.height = used.y - newRect.y;
+                newRects.push_back(newRect);
+            }
+
+            // New rect at the bottom side of the used rect.
+            if(used.y + used.height < freeRect.y + freeRect.height) {
+                rect newRect = freeRect;
+                newRect.y = used.y + used.height;
+                newRect.height = freeRect.y + freeRect.height - (used.y + used.height);
+                newRects.push_back(newRect);
+            }
+        }
+
+        if(used.y < freeRect.y + freeRect.height && used.y + used.height > freeRect.y) {
+            // New rect at the left side of the used rect.
+            if(used.x > freeRect.x && used.x < freeRect.x + freeRect.width) {
+                rect newRect = freeRect;
+                newRect.width = used.x - newRect.x;
+                newRects.push_back(newRect);
+            }
+
+            // New rect at the right side of the used rect.
+            if(used.x + used.width < freeRect.x + freeRect.width) {
+                rect newRect = freeRect;
+                newRect.x = used.x + used.width;
+                newRect.width = freeRect.x + freeRect.width - (used.x + used.width);
+                newRects.push_back(newRect);
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     Removes new free rects which are contained in other ones.
+     The kept free rects aren't contained in each other and can't be contained in the new ones,
+     as the new ones are parts of the removed rects. So only the new rects need checking,
+     and the pairwise order of rbp::MaxRectsBinPack::PruneFreeList is repeated for them.
+     */
+    void pruneNewRects() {
+        auto isContainedInKept = [this](rect const& newRect) {
+            for(auto const& freeRect : freeRects) {
+                if(isContainedIn(newRect, freeRect))
+                    return true;
+            }
+            return false;
+        };
+        newRects.erase(remove_if(newRects.begin(), newRects.end(), isContainedInKept), newRects.end());
+
+        for(size_t i = 0; i < newRects.size(); ++i) {
+            for(size_t j = i + 1; j < newRects.size(); ++j) {
+                if(isContainedIn(newRects[i], newRects[j])) {
+                    newRects.erase(newRects.begin() + i);
+                    --i;
+                    break;
+                }
+                if(isContainedIn(newRects[j], newRects[i])) {
+                    newRects.erase(newRects.begin() + j);
+                    --j;
+                }
+            }
+        }
+    }
+
+    // Places the rect into the bin
+    void placeRect(rect const& node) {
+        // Split free rects in a single pass keeping the order of the rest ones
+        newRects.clear();
+        size_t keptCount = 0;
+        for(size_t i = 0; i < freeRects.size(); ++i) {
+            if(!splitFreeRect(freeRects[i], node))
+                freeRects[keptCount++] = freeRects[i];
+        }
+        freeRects.resize(keptCount);
+
+        pruneNewRects();
+        freeRects.insert(freeRects.end(), newRects.begin(), newRects.end());
+
+        // Register the used rect
+        const size_t index = usedRects.size();
+        usedRects.push_back(node);
+        usedByX[node.x].push_back(index);
+        usedByX[node.x + node.width].push_back(index);
+        usedByY[node.y].push_back(index);
+        usedByY[node.y + node.height].push_back(index);
+        usedArea += node.width * node.height;
+    }
+};
+
+native_max_rects_bin::packer::packer(): _pimpl(new Pimpl) {
+    ;;
+}
+
+native_max_rects_bin::packer::~packer() {
+    ;;
+}
+
+float native_max_rects_bin::packer::occupancy() const {
+    return (float)_pimpl->usedArea / (_prefs.bin_width * _prefs.bin_height);
+}
+
+std::array<int,2> native_max_rects_bin::packer::bin_dims() const {
+    std::array<int,2> a = {_prefs.bin_width, _prefs.bin_height};
+    return a;
+}
+
+bool native_max_rects_bin::packer::insert_square(int width, int height, atlas_item& item) {
+    int score1, score2;
+    rect node = _pimpl->scoreRect(width, height, _prefs, score1, score2);
+    if(node.width == 0 || node.height == 0)
+        return false;
+
+    _pimpl->placeRect(node);
+
+    item.box = node;
+    item.rotated = node.width != width;
+    return true;
+}
+
+size_t native_max_rects_bin::packer::insert_batch(std::vector<batch_item>& items) {
+    size_t placedCount = 0;
+    auto placeItem = [this, &placedCount](batch_item& item, rect const& node) {
+        _pimpl->placeRect(node);
+        item.x = node.x;
+        item.y = node.y;
+        item.rotated = node.width != item.width;
+        item.placed = true;
+        ++placedCount;
+    };
+
+    if(!_prefs.global_order) {
+        // Insert items in their order
+        int score1, score2;
+        for(auto& item : items) {
+            rect node = _pimpl->scoreRect(item.width, item.height, _prefs, score1, score2);
+            item.placed = false;
+            if(node.width != 0 && node.height != 0)
+                placeItem(item, node);
+        }
+        return placedCount;
+    }
+
+    // Place the best scored item first as rbp::MaxRectsBinPack does for a bunch of rects
+    vector<size_t> pending(items.size());
+    for(size_t i = 0; i < items.size(); ++i) {
+        items[i].placed = false;
+        pending[i] = i;
+    }
+
+    while(!pending.empty()) {
+        int bestScore1 = numeric_limits<int>::max();
+        int bestScore2 = numeric_limits<int>::max();
+        size_t bestIndex = pending.size();
+        rect bestNode;
+        for(size_t i = 0; i < pending.size(); ++i) {
+            auto const& item = items[pending[i]];
+            int score1, score2;
+            rect node = _pimpl->scoreRect(item.width, item.height, _prefs, score1, score2);
+            if(score1 < bestScore1 || (score1 == bestScore1 && score2 < bestScore2)) {
+                bestScore1 = score1;
+                bestScore2 = score2;
+                bestNode = node;
+                bestIndex = i;
+            }
+        }
+
+        // none of the rest items fit
+        if(bestIndex == pending.size())
+            break;
+
+        placeItem(items[pending[bestIndex]], bestNode);
+        pending.erase(pending.begin() + bestIndex);
+    }
+
+    return placedCount;
+}
+
+void native_max_rects_bin::packer::clean_bin() {
+    _pimpl->reset(_prefs.bin_width, _prefs.bin_height);
+}
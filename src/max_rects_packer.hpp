@@ -0,0 +1,73 @@
+#pragma once
+
+#include "bin_packer.hpp"
+#include <memory>
+
+/**
+ @brief In-tree implementation of the MaxRects algorithm.
+ The packer keeps free rects in the same order as rbp::MaxRectsBinPack does,
+ so it produces identical placements, but prunes only the rects created by the last insert
+ and looks up neighbours of the contact point rule by their edges.
+ */
+struct native_max_rects_bin {
+
+    /// Free rect choice heuristic
+    enum insert_heuristic_type {
+        best_short_side_fit = 0,    ///< Places the item against the short side of the best fitting free rect
+        best_long_side_fit,         ///< Places the item against the long side of the best fitting free rect
+        best_area_fit,              ///< Places the item into the smallest free rect it fits
+        bottom_left_rule,           ///< Places the item as low as possible, then as left as possible
+        contact_point_rule,         ///< Places the item where it touches other items as much as possible
+    };
+
+    /// Preferences of the packer
+    struct prefs {
+        int bin_width=0, bin_height=0;
+
+        /// Insert heuristic
+        insert_heuristic_type insert_heuristic = bottom_left_rule;
+
+        /// Items can be rotated
+        bool allow_flip = true;
+
+        /// The batch insert picks the best scored item first instead of inserting items in their order
+        bool global_order = false;
+
+        prefs& set_bin_width(int arg) { bin_width = arg; return *this; }
+        prefs& set_bin_height(int arg) { bin_height = arg; return *this; }
+
+        /// Sets a specific insert heuristic
+        prefs& set_insert_heuristic(insert_heuristic_type arg) { insert_heuristic = arg; return *this; }
+
+        /// Allows rotating of items
+        prefs& enable_flip(bool arg=true) { allow_flip = arg; return *this; }
+
+        /// Enables the global order of the batch insert. It scores all the rest items for each insert
+        prefs& enable_global_order(bool arg=true) { global_order = arg; return *this; }
+    };
+
+    /// The MaxRects packer
+    class packer: public bin_packer {
+    public:
+        packer();
+        virtual ~packer();
+
+        /// Returns packer's preferences
+        native_max_rects_bin::prefs& prefs() { return _prefs; }
+
+        /// Returns packer's preferences
+        native_max_rects_bin::prefs const& prefs() const { return _prefs; }
+
+        virtual float occupancy() const override;
+        virtual std::array<int,2> bin_dims() const override;
+        virtual bool insert_square(int width, int height, atlas_item& item) override;
+        virtual size_t insert_batch(std::vector<batch_item>& items) override;
+        virtual void clean_bin() override;
+
+    private:
+        native_max_rects_bin::prefs _prefs;   ///< Bin packer preferences
+
+        struct Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+};
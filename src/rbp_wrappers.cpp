@@ -1,5 +1,8 @@
 #include "rbp_wrappers.hpp"
 #include "helpers.hpp"
+#include <algorithm>
+#include <map>
+#include <utility>
 
 using namespace ::atlas2d;
 
@@ -23,6 +26,54 @@ namespace  {
 
         return true;
     }
+    
+    /**
+     Inserts the batch by the rbp packer's bunch insert.
+     The packer reports placed rects in its own order, so they are matched
+     to the items by size. Items of the same size are interchangeable.
+     */
+    template<typename InsertFn>
+    size_t insert_rbp_batch(std::vector<bin_packer::batch_item>& items, InsertFn insert) {
+        using size_key = std::pair<int,int>;
+        auto key_of = [](int width, int height) {
+            return size_key((std::min)(width, height), (std::max)(width, height));
+        };
+        
+        std::vector<rbp::RectSize> sizes(items.size());
+        std::map<size_key, std::vector<size_t>> items_by_size;
+        for(size_t i = items.size(); i-- > 0; ) {
+            auto& item = items[i];
+            item.placed = false;
+            sizes[i].width = item.width;
+            sizes[i].height = item.height;
+            items_by_size[key_of(item.width, item.height)].push_back(i);
+        }
+        
+        // the packer removes placed sizes and leaves the ones which don't fit
+        std::vector<rbp::Rect> placed;
+        insert(sizes, placed);
+        
+        size_t placed_count = 0;
+        for(auto const& rect : placed) {
+            if(rect.width == 0 || rect.height == 0)
+                continue;
+            
+            auto pos = items_by_size.find(key_of(rect.width, rect.height));
+            if(pos == items_by_size.end() || pos->second.empty())
+                continue;
+            
+            auto& item = items[pos->second.back()];
+            pos->second.pop_back();
+            
+            item.x = rect.x;
+            item.y = rect.y;
+            item.rotated = item.width != item.height && rect.width != item.width;
+            item.placed = true;
+            ++placed_count;
+        }
+        
+        return placed_count;
+    }
 }
 
 
@@ -31,6 +82,15 @@ bool max_rects_bin::packer::insert_square(int width, int height, atlas_item& ite
     return update_atlas_item(width, height, rect, item);
 }
 
+size_t max_rects_bin::packer::insert_batch(std::vector<batch_item>& items) {
+    if(!prefs().global_order)
+        return bin_packer::insert_batch(items);
+    
+    return insert_rbp_batch(items, [this](std::vector<rbp::RectSize>& sizes, std::vector<rbp::Rect>& placed) {
+        rbp_packer().Insert(sizes, placed, prefs().insert_heuristic);
+    });
+}
+
 void max_rects_bin::packer::clean_bin() {
     rbp_packer().Init(prefs().bin_width,
                       prefs().bin_height);
@@ -42,6 +102,15 @@ bool skyline_bin::packer::insert_square(int width, int height, atlas_item& item)
     return update_atlas_item(width, height, rect, item);
 }
 
+size_t skyline_bin::packer::insert_batch(std::vector<batch_item>& items) {
+    if(!prefs().global_order)
+        return bin_packer::insert_batch(items);
+    
+    return insert_rbp_batch(items, [this](std::vector<rbp::RectSize>& sizes, std::vector<rbp::Rect>& placed) {
+        rbp_packer().Insert(sizes, placed, prefs().insert_heuristic);
+    });
+}
+
 void skyline_bin::packer::clean_bin() {
     rbp_packer().Init(prefs().bin_width,
                       prefs().bin_height,
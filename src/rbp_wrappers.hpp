@@ -61,14 +61,21 @@ struct max_rects_bin {
         /// Insert heuristic of the MaxRectsBinPack packer
         rbp_insert_heuristic insert_heuristic = rbp_insert_heuristic::RectBottomLeftRule;
         
+        /// The batch insert uses the global order of the MaxRectsBinPack packer
+        bool global_order = false;
+        
         /// Sets a specific insert heuristic
         prefs& set_insert_heuristic(rbp_insert_heuristic arg) { insert_heuristic = arg; return self(); }
+        
+        /// Enables the global order of the batch insert
+        prefs& enable_global_order(bool arg=true) { global_order = arg; return self(); }
     };
     
     /// Wrapper of the MaxRectsBinPack packer
     class packer: public details::rbp_wrapper<prefs> {
     public:
         bool insert_square(int width, int height, atlas_item& item) override;
+        size_t insert_batch(std::vector<batch_item>& items) override;
         void clean_bin() override;
     };
 };
@@ -87,17 +94,24 @@ struct skyline_bin {
         /// The WasteMap feature
         bool use_waste_map = true;
         
+        /// The batch insert uses the global order of the SkylineBinPack packer
+        bool global_order = false;
+        
         /// Sets a specific insert heuristic
         prefs& set_insert_heuristic(rbp_insert_heuristic arg) { insert_heuristic = arg; return self(); }
         
         /// Enables the waste map feature
         prefs& enable_waste_map(bool arg=true) { use_waste_map = arg; return self(); }
+        
+        /// Enables the global order of the batch insert
+        prefs& enable_global_order(bool arg=true) { global_order = arg; return self(); }
     };
 
     /// Wrapper of the SkylineBinPack packer
     class packer: public details::rbp_wrapper<prefs> {
     public:
         bool insert_square(int width, int height, atlas_item& item) override;
+        size_t insert_batch(std::vector<batch_item>& items) override;
         void clean_bin() override;
 
     };
@@ -0,0 +1,272 @@
+#include "sprite_cache.hpp"
+#include "mapped_file.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+#include <boost/filesystem.hpp>
+#include <map>
+#include <fstream>
+#include <mutex>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "sprite_cache"
+
+using namespace ::std;
+using namespace ::rapidjson;
+
+namespace fs = boost::filesystem;
+
+// undef colliding windows definings
+#ifdef GetObject
+#undef GetObject
+#endif
+
+namespace {
+    
+    // Cache file fields
+    const char* kVersion = "version";
+    const char* kOptions = "options";
+    const char* kEntries = "entries";
+    const char* kMtime = "mtime";
+    const char* kFileSize = "file_size";
+    const char* kHash = "hash";
+    const char* kSize = "size";
+    const char* kPixelFormat = "pixel_format";
+    const char* kTrim = "trim";
+    const char* kPixelsHash = "pixels_hash";
+    
+    using EntryMap = map<string, sprite_cache_entry>;
+    
+    // Calculates FNV-1a hash of the file content
+    bool hashFile(string const& filename, uint64_t& hash) {
+        mapped_file file;
+        if(!file.open(filename))
+            return false;
+        
+        hash = 14695981039346656037ull;
+        unsigned char const* data = file.data();
+        for(size_t i = 0, n = file.size(); i < n; ++i) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        
+        return true;
+    }
+    
+    // Reads modification time and size of the file
+    bool statFile(string const& filename, sprite_cache_entry& entry) {
+        boost::system::error_code ec;
+        entry.mtime = fs::last_write_time(filename, ec);
+        if(ec)
+            return false;
+        
+        entry.file_size = fs::file_size(filename, ec);
+        return !ec;
+    }
+    
+} // anonymous
+
+struct sprite_cache::Pimpl: sprite_cache_props {
+    EntryMap previous;      ///< Entries loaded from the cache file
+    EntryMap current;       ///< Entries of the current run
+    mutable mutex lock;     ///< Guards the current entries
+};
+
+sprite_cache::sprite_cache(sprite_cache_props const& props): _pimpl(new Pimpl) {
+    (sprite_cache_props&)(*_pimpl) = props;
+}
+
+sprite_cache::~sprite_cache() {
+    ;;
+}
+
+bool sprite_cache::load(std::string const& filename) {
+    _pimpl->previous.clear();
+    
+    ifstream stream(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+    if(!stream)
+        return false;
+    
+    IStreamWrapper rjStream(stream);
+    Document doc;
+    doc.ParseStream(rjStream);
+    if(!doc.IsObject())
+        return false;
+    
+    // The cache is valid only for the same tool and options
+    auto versionPos = doc.FindMember(kVersion);
+    auto optionsPos = doc.FindMember(kOptions);
+    auto entriesPos = doc.FindMember(kEntries);
+    if(versionPos == doc.MemberEnd() || !versionPos->value.IsString() ||
+       optionsPos == doc.MemberEnd() || !optionsPos->value.IsString() ||
+       entriesPos == doc.MemberEnd() || !entriesPos->value.IsObject())
+        return false;
+    
+    if(_pimpl->tool_version != versionPos->value.GetString() ||
+       _pimpl->options != optionsPos->value.GetString()) {
+        CLOG(INFO, MODULE_LOGGER) << "The cache " << filename << " is outdated";
+        return false;
+    }
+    
+    for(auto const& m : entriesPos->value.GetObject()) {
+        Value const& jEntry = m.value;
+        if(!jEntry.IsObject() ||
+           !jEntry[kMtime].IsInt64() ||
+           !jEntry[kFileSize].IsUint64() ||
+           !jEntry[kHash].IsUint64() ||
+           !jEntry[kSize].IsArray() ||
+           !jEntry[kPixelFormat].IsString())
+            continue;
+        
+        sprite_cache_entry entry;
+        entry.mtime = (std::time_t)jEntry[kMtime].GetInt64();
+        entry.file_size = jEntry[kFileSize].GetUint64();
+        entry.content_hash = jEntry[kHash].GetUint64();
+        entry.size = atlas2d::size(jEntry[kSize][0].GetInt(), jEntry[kSize][1].GetInt());
+        entry.fmt = atlas2d::pixel_format_details(jEntry[kPixelFormat].GetString()).format;
+        if(entry.fmt == atlas2d::pixel_format::unknown)
+            continue;
+        
+        auto trimPos = jEntry.FindMember(kTrim);
+        if(trimPos != jEntry.MemberEnd()) {
+            Value const& jTrim = trimPos->value;
+            if(!jTrim.IsArray() || jTrim.Size() != 4)
+                continue;
+            entry.trim = rect(jTrim[0].GetInt(), jTrim[1].GetInt(), jTrim[2].GetInt(), jTrim[3].GetInt());
+        }
+        
+        auto pixelsHashPos = jEntry.FindMember(kPixelsHash);
+        if(pixelsHashPos != jEntry.MemberEnd() && pixelsHashPos->value.IsUint64())
+            entry.pixels_hash = pixelsHashPos->value.GetUint64();
+        
+        _pimpl->previous[m.name.GetString()] = entry;
+    }
+    
+    CLOG(INFO, MODULE_LOGGER) << "Loaded " << _pimpl->previous.size() << " cached sprites";
+    return true;
+}
+
+bool sprite_cache::save(std::string const& filename) const {
+    ofstream stream(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+    if(!stream) {
+        CLOG(ERROR, MODULE_LOGGER) << "Error opening " << filename << " for write";
+        return false;
+    }
+    
+    lock_guard<mutex> guard(_pimpl->lock);
+    
+    OStreamWrapper rjStream(stream);
+    Writer<OStreamWrapper> writer(rjStream);
+    writer.StartObject();
+    writer.Key(kVersion);
+    writer.String(_pimpl->tool_version.c_str());
+    writer.Key(kOptions);
+    writer.String(_pimpl->options.c_str());
+    writer.Key(kEntries);
+    writer.StartObject();
+    for(auto const& m : _pimpl->current) {
+        auto const& entry = m.second;
+        writer.Key(m.first.c_str());
+        writer.StartObject();
+        writer.Key(kMtime);
+        writer.Int64(entry.mtime);
+        writer.Key(kFileSize);
+        writer.Uint64(entry.file_size);
+        writer.Key(kHash);
+        writer.Uint64(entry.content_hash);
+        writer.Key(kSize);
+        writer.StartArray();
+        writer.Int(entry.size.width);
+        writer.Int(entry.size.height);
+        writer.EndArray();
+        writer.Key(kPixelFormat);
+        writer.String(atlas2d::pixel_format_details(entry.fmt).formatName.c_str());
+        if(entry.trim.width > 0) {
+            writer.Key(kTrim);
+            writer.StartArray();
+            writer.Int(entry.trim.x);
+            writer.Int(entry.trim.y);
+            writer.Int(entry.trim.width);
+            writer.Int(entry.trim.height);
+            writer.EndArray();
+        }
+        if(entry.pixels_hash) {
+            writer.Key(kPixelsHash);
+            writer.Uint64(entry.pixels_hash);
+        }
+        writer.EndObject();
+    }
+    writer.EndObject();
+    writer.EndObject();
+    
+    return (bool)stream;
+}
+
+bool sprite_cache::lookup(std::string const& key, std::string const& filename, atlas_item& item) {
+    auto pos = _pimpl->previous.find(key);
+    if(pos == _pimpl->previous.end())
+        return false;
+    
+    sprite_cache_entry actual;
+    if(!statFile(filename, actual))
+        return false;
+    
+    auto const& cached = pos->second;
+    if(actual.mtime != cached.mtime || actual.file_size != cached.file_size)
+        return false;
+    
+    item.size = cached.size;
+    item.fmt = cached.fmt;
+    if(cached.trim.width > 0) {
+        item.source_size = cached.size;
+        item.trim_offset = atlas2d::offset(cached.trim.x, cached.trim.y);
+        item.size = atlas2d::size(cached.trim.width, cached.trim.height);
+    }
+    item.pixels_hash = cached.pixels_hash;
+    
+    lock_guard<mutex> guard(_pimpl->lock);
+    _pimpl->current[key] = cached;
+    return true;
+}
+
+void sprite_cache::store(std::string const& key, std::string const& filename, atlas_item const& item) {
+    sprite_cache_entry entry;
+    if(!statFile(filename, entry))
+        return;
+    
+    // Reading the whole file again is the cost of a miss, so it's paid only if hashes are compared
+    if(_pimpl->hash_content && !hashFile(filename, entry.content_hash))
+        return;
+    
+    entry.size = item.size;
+    entry.fmt = item.fmt;
+    if(item.source_size.width > 0) {
+        entry.size = item.source_size;
+        entry.trim = rect(item.trim_offset.x, item.trim_offset.y, item.size.width, item.size.height);
+    }
+    entry.pixels_hash = item.pixels_hash;
+    
+    lock_guard<mutex> guard(_pimpl->lock);
+    _pimpl->current[key] = entry;
+}
+
+bool sprite_cache::find(std::string const& key, sprite_cache_entry& entry) const {
+    lock_guard<mutex> guard(_pimpl->lock);
+    auto pos = _pimpl->current.find(key);
+    if(pos == _pimpl->current.end())
+        return false;
+    
+    entry = pos->second;
+    return true;
+}
+
+bool sprite_cache::find_previous(std::string const& key, sprite_cache_entry& entry) const {
+    auto pos = _pimpl->previous.find(key);
+    if(pos == _pimpl->previous.end())
+        return false;
+    
+    entry = pos->second;
+    return true;
+}
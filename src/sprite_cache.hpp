@@ -0,0 +1,73 @@
+#pragma once
+
+#include "forwards.hpp"
+#include "helpers.hpp"
+#include <ctime>
+#include <cstdint>
+
+/// Cached metadata of a sprite image
+struct sprite_cache_entry {
+    std::time_t mtime = 0;              ///< Last modification time of the file
+    uintmax_t file_size = 0;            ///< Size of the file
+    uint64_t content_hash = 0;          ///< Hash of the file content (0 - not calculated)
+    atlas2d::size size;                 ///< Image size
+    atlas2d::pixel_format fmt;          ///< Pixel format
+    rect trim;                          ///< Trimmed area of the image. Empty if the image isn't trimmed
+    uint64_t pixels_hash = 0;           ///< Hash of the decoded pixels (0 - unknown)
+};
+
+/// Sprite cache properties
+struct sprite_cache_props {
+    std::string tool_version;           ///< Version of the tool which created the cache
+    std::string options;                ///< Signature of the options affecting the cached data
+    bool hash_content = false;          ///< Calculate hashes of stored files content
+};
+
+/**
+ @brief Persistent cache of sprite images metadata.
+ Allows to skip reading of images which weren't changed since the previous run.
+ The whole cache is invalidated if the tool version or the options differ from the stored ones.
+ Lookups and stores are safe to call from several threads.
+ */
+class sprite_cache {
+public:
+    struct init_props: sprite_cache_props {
+        using props = init_props;
+        
+        /// Sets version of the tool
+        props& set_tool_version(std::string arg) {tool_version=std::move(arg); return *this;}
+        /// Sets signature of the options affecting the cached data
+        props& set_options(std::string arg) {options=std::move(arg); return *this;}
+        /// Enables hashing of stored files content, it's needed only to compare files with the previous run
+        props& enable_content_hash(bool arg) {hash_content=arg; return *this;}
+    };
+    
+    explicit sprite_cache(sprite_cache_props const& props);
+    ~sprite_cache();
+    
+    /// Loads the cache. Returns false if there is no valid cache in the file.
+    bool load(std::string const& filename);
+    
+    /// Saves entries looked up or stored since loading
+    bool save(std::string const& filename) const;
+    
+    /**
+     @brief Fills image metadata if the file wasn't changed since it was cached.
+     The key is an image path relative to the sprites directory, the filename is the actual path.
+     The trimmed size and offset are restored for a trimmed image, as well as the pixels hash.
+     */
+    bool lookup(std::string const& key, std::string const& filename, atlas_item& item);
+    
+    /// Caches metadata of the image file. The file content is hashed only if it's enabled
+    void store(std::string const& key, std::string const& filename, atlas_item const& item);
+    
+    /// Returns the entry of the current run
+    bool find(std::string const& key, sprite_cache_entry& entry) const;
+    
+    /// Returns the entry loaded from the cache file
+    bool find_previous(std::string const& key, sprite_cache_entry& entry) const;
+    
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
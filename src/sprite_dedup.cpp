@@ -0,0 +1,198 @@
+#include "sprite_dedup.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <unordered_map>
+#include <tuple>
+#include <cstring>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "sprite_dedup"
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    // Identity of an image
+    using ImageKey = tuple<uint64_t, int, int, int, string>;
+    
+    struct ImageKeyHash {
+        size_t operator()(ImageKey const& key) const {
+            return (size_t)get<0>(key) ^ hash<string>()(get<4>(key));
+        }
+    };
+    
+    // Size of the item pixels in bytes
+    size_t pixelsBytes(image_props const& image) {
+        return (size_t)image.size.width * image.size.height * pixel_format_details(image.fmt).bpp;
+    }
+    
+    // MurmurHash64A mixing of a 64 bit word into the hash
+    inline uint64_t mixWord(uint64_t hash, uint64_t word) {
+        const uint64_t m = 0xc6a4a7935bd1e995ull;
+        word *= m;
+        word ^= word >> 47;
+        word *= m;
+        hash ^= word;
+        return hash * m;
+    }
+    
+    // Makes the alias of the item
+    atlas_alias makeAlias(atlas_item const& item) {
+        atlas_alias alias;
+        alias.image_path = item.image_path;
+        alias.source_size = item.source_size;
+        alias.trim_offset = item.trim_offset;
+        return alias;
+    }
+    
+} // anonymous
+
+uint64_t hash_pixels(image_props const& image) {
+    if(!image.pixels)
+        return 0;
+    
+    const size_t bytes = pixelsBytes(image);
+    unsigned char const* data = image.pixels.get();
+    
+    // Every bit of a word affects the whole hash, so equal high bits don't collide
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ (bytes * 0xc6a4a7935bd1e995ull);
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = mixWord(hash, word);
+    }
+    if(i < bytes) {
+        uint64_t tail = 0;
+        memcpy(&tail, data + i, bytes - i);
+        hash = mixWord(hash, tail);
+    }
+    
+    // Final avalanche
+    hash ^= hash >> 47;
+    hash *= 0xc6a4a7935bd1e995ull;
+    hash ^= hash >> 47;
+    
+    return hash ? hash : 1;
+}
+
+void merge_duplicates(std::vector<atlas_item>& items,
+                      std::function<std::string(atlas_item const&)> const& get_group,
+                      pixels_loader const& load_pixels) {
+    unordered_map<ImageKey, vector<size_t>, ImageKeyHash> originals;
+    vector<bool> merged(items.size(), false);
+    size_t mergedCount = 0;
+    
+    // Pixels of compared items, the reloaded ones are kept till the end of merging
+    vector<raw_data_ptr> pixels(items.size());
+    auto getPixels = [&items, &pixels, &load_pixels](size_t index) -> raw_data_ptr {
+        auto const& item = items[index];
+        if(item.pixels || pixels[index] || !load_pixels)
+            return item.pixels ? item.pixels : pixels[index];
+        
+        atlas_item loaded = item;
+        if(!load_pixels(loaded) || !loaded.pixels ||
+           loaded.size.width != item.size.width || loaded.size.height != item.size.height ||
+           loaded.fmt != item.fmt) {
+            CLOG(WARNING, MODULE_LOGGER) << "Can't reload " << item.image_path << " to compare its pixels";
+            return raw_data_ptr();
+        }
+        
+        pixels[index] = loaded.pixels;
+        return pixels[index];
+    };
+    
+    for(size_t i = 0; i < items.size(); ++i) {
+        auto& item = items[i];
+        if(!item.pixels_hash)
+            continue;
+        
+        ImageKey key(item.pixels_hash, item.size.width, item.size.height, (int)item.fmt,
+                     get_group ? get_group(item) : string());
+        auto& candidates = originals[key];
+        
+        // hashes of different images may collide, so the pixels of each original are compared
+        size_t original = items.size();
+        for(auto candidate : candidates) {
+            auto candidatePixels = getPixels(candidate);
+            auto itemPixels = getPixels(i);
+            if(candidatePixels && itemPixels &&
+               memcmp(candidatePixels.get(), itemPixels.get(), pixelsBytes(item)) == 0) {
+                original = candidate;
+                break;
+            }
+        }
+        
+        if(original == items.size()) {
+            candidates.push_back(i);
+            continue;
+        }
+        
+        auto& target = items[original].aliases;
+        target.push_back(makeAlias(item));
+        target.insert(target.end(), item.aliases.begin(), item.aliases.end());
+        merged[i] = true;
+        pixels[i].reset();
+        ++mergedCount;
+    }
+    
+    if(!mergedCount)
+        return;
+    
+    size_t kept = 0;
+    for(size_t i = 0; i < items.size(); ++i) {
+        if(merged[i])
+            continue;
+        if(kept != i)
+            items[kept] = move(items[i]);
+        ++kept;
+    }
+    items.resize(kept);
+    
+    CLOG(INFO, MODULE_LOGGER) << "Merged " << mergedCount << " duplicated sprites";
+}
+
+struct sprite_dedup_node::Pimpl {
+    vector<atlas_item> items;   ///< Items of the current atlas
+    pixels_loader load_pixels;  ///< Reloads pixels of items to compare them
+};
+
+sprite_dedup_node::sprite_dedup_node(pixels_loader load_pixels): _pimpl(new Pimpl) {
+    _pimpl->load_pixels = move(load_pixels);
+}
+
+sprite_dedup_node::~sprite_dedup_node() {
+    ;;
+}
+
+bool sprite_dedup_node::begin_atlas(atlas_props const& atlas) {
+    _pimpl->items.clear();
+    return safe_fwd().begin_atlas(atlas);
+}
+
+bool sprite_dedup_node::add_atlas_item(atlas_item const& item) {
+    _pimpl->items.push_back(item);
+    return true;
+}
+
+bool sprite_dedup_node::end_atlas(bool finalize) {
+    vector<atlas_item> items;
+    items.swap(_pimpl->items);
+    merge_duplicates(items, nullptr, _pimpl->load_pixels);
+    
+    for(auto& item : items) {
+        if(!safe_fwd().add_atlas_item(item))
+            return false;
+        
+        // the child keeps what it needs
+        item = atlas_item();
+    }
+    
+    return safe_fwd().end_atlas(finalize);
+}
+
+void sprite_dedup_node::reset() {
+    _pimpl->items.clear();
+    safe_fwd().reset();
+}
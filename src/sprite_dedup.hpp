@@ -0,0 +1,45 @@
+#pragma once
+
+#include "chain_node.hpp"
+#include <vector>
+#include <cstdint>
+
+/// Version of the pixels hash algorithm. Hashes cached by other versions can't be compared
+const int pixels_hash_version = 2;
+
+/// Calculates the hash of the decoded image pixels. Returns zero only if the pixels aren't loaded
+uint64_t hash_pixels(image_props const& image);
+
+/// Loads pixels of the item the same way they were hashed (decoded and trimmed)
+using pixels_loader = std::function<bool(atlas_item& item)>;
+
+/**
+ @brief Merges items with identical images into the first of them as its aliases.
+ Images are identical if their sizes, pixel formats and pixel hashes match and their pixels are equal.
+ Pixels of items which don't keep them are reloaded by the loader to be compared,
+ such items are never merged without the loader. Items without the pixels hash are kept as is.
+ Only items of the same group are merged if the group extractor is set.
+ */
+void merge_duplicates(std::vector<atlas_item>& items,
+                      std::function<std::string(atlas_item const&)> const& get_group = nullptr,
+                      pixels_loader const& load_pixels = nullptr);
+
+/**
+ @brief The node packs identical sprites once.
+ Items of each atlas are collected till its end, then the duplicates are merged
+ and the rest items are passed to the child node.
+ */
+class sprite_dedup_node: public chain_node {
+public:
+    explicit sprite_dedup_node(pixels_loader load_pixels = nullptr);
+    virtual ~sprite_dedup_node();
+    
+    bool begin_atlas(atlas_props const& atlas) override;
+    bool add_atlas_item(atlas_item const& item) override;
+    bool end_atlas(bool finalize) override;
+    void reset() override;
+    
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
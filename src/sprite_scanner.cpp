@@ -0,0 +1,113 @@
+#include "sprite_scanner.hpp"
+#include "atlas_builder.hpp"
+#include "thread_pool.hpp"
+#include <boost/filesystem.hpp>
+#include <boost/range/adaptor/filtered.hpp>
+#include <chrono>
+#include <deque>
+#include <regex>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "sprite_scanner"
+
+using namespace ::std;
+
+namespace fs = boost::filesystem;
+namespace ba = boost::adaptors;
+
+namespace {
+    
+    // An image which is being read on the pool
+    struct PendingItem {
+        fs::path filename;      ///< Full path to the image
+        atlas_item item;        ///< The item to read image into
+        future<bool> result;    ///< Result of reading
+    };
+    
+    using PendingItemPtr = shared_ptr<PendingItem>;
+    
+} // anonymous
+
+bool scan_sprites(atlas_builder& builder, sprite_scan_props const& props) {
+    auto is_file = [](fs::directory_entry const& e){
+        return fs::is_regular_file(e.status());
+    };
+    
+    const regex matchPattern(props.filter, regex_constants::grep);
+    auto matched_pattern = [&matchPattern](fs::directory_entry const& e) {
+        return regex_match(e.path().string(), matchPattern);
+    };
+    
+    thread_pool_ptr pool = props.pool ? props.pool : make_shared<thread_pool>();
+    const size_t prefetch = props.prefetch ? props.prefetch : pool->size() * 4;
+    
+    const fs::path srcDir(props.src_dir);
+    const auto startTime = chrono::steady_clock::now();
+    size_t filesCount = 0;
+    
+    deque<PendingItemPtr> pending;
+    bool hasError = false;
+    
+    // Waits for the oldest image and passes it to the builder
+    auto flushOne = [&]() {
+        auto next = move(pending.front());
+        pending.pop_front();
+        
+        if(!next->result.get()) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error reading the " << next->filename << " file";
+            return false;
+        }
+        
+        CLOG(INFO, MODULE_LOGGER) << "Processing " << next->item.image_path;
+        if(!builder.add_atlas_item(next->item)) {
+            CLOG(ERROR, MODULE_LOGGER) << "Error during adding the sprite "
+            << next->filename
+            << " to the atlas";
+            return false;
+        }
+        
+        ++filesCount;
+        return true;
+    };
+    
+    for(auto const& dirEntry : fs::recursive_directory_iterator(srcDir)
+        | ba::filtered(is_file) | ba::filtered(matched_pattern))
+    {
+        auto imageFile = fs::relative(dirEntry.path(), srcDir);
+        
+        auto next = make_shared<PendingItem>();
+        next->item.image_path = imageFile.generic_string();
+        next->filename = srcDir / imageFile;
+        
+        // The task owns the pending item, so it stays alive even if we stop earlier
+        auto const& readImage = props.read_image;
+        next->result = pool->submit([next, readImage]() {
+            return readImage(next->filename.generic_string(), next->item);
+        });
+        pending.push_back(move(next));
+        
+        if(pending.size() >= prefetch && !flushOne()) {
+            hasError = true;
+            break;
+        }
+    }
+    
+    while(!hasError && !pending.empty()) {
+        hasError = !flushOne();
+    }
+    
+    // Don't leave unfinished reads behind
+    for(auto const& rest : pending) {
+        rest->result.wait();
+    }
+    
+    if(hasError)
+        return false;
+    
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - startTime;
+    CLOG(INFO, MODULE_LOGGER) << "Processed " << filesCount << " files in "
+    << elapsed.count() << "s ("
+    << (elapsed.count() > 0 ? filesCount / elapsed.count() : 0.0) << " files/s)";
+    
+    return true;
+}
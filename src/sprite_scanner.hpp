@@ -0,0 +1,35 @@
+#pragma once
+
+#include "forwards.hpp"
+#include "helpers.hpp"
+
+/// Sprite scanner properties
+struct sprite_scan_props {
+    using props = sprite_scan_props;
+    using image_reader = std::function<bool(std::string const&, atlas_item&)>;
+    
+    std::string src_dir;                ///< Directory to look for sprites in
+    std::string filter = ".*\\.png$";   ///< Image file filter
+    image_reader read_image;            ///< Reads an image file into an atlas item
+    thread_pool_ptr pool;               ///< Worker threads to read images on
+    unsigned prefetch = 0;              ///< Max number of images in flight (0 - four per worker)
+    
+    /// Sets source directory
+    props& set_src_dir(std::string arg) {src_dir=std::move(arg); return *this;}
+    /// Sets image file filter
+    props& set_filter(std::string arg) {filter=std::move(arg); return *this;}
+    /// Sets image reader
+    props& set_image_reader(image_reader arg) {read_image=std::move(arg); return *this;}
+    /// Sets worker threads to read images on
+    props& set_thread_pool(thread_pool_ptr arg) {pool=std::move(arg); return *this;}
+    /// Sets max number of images in flight
+    props& set_prefetch(unsigned arg) {prefetch=arg; return *this;}
+};
+
+/**
+ @brief Reads all the sprites of the source directory and adds them to the builder.
+ Images are read concurrently on the thread pool, but the builder receives items
+ strictly in the directory enumeration order, so the result doesn't depend
+ on the number of threads.
+ */
+bool scan_sprites(atlas_builder& builder, sprite_scan_props const& props);
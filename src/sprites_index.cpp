@@ -0,0 +1,354 @@
+#include "sprites_index.hpp"
+#include "mapped_file.hpp"
+#include <rapidjson/rapidjson.h>
+#include <rapidjson/document.h>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <easylogging++.h>
+
+#define MODULE_LOGGER "sprites_index"
+
+using namespace ::rapidjson;
+using namespace ::std;
+
+namespace fs = boost::filesystem;
+
+// undef colliding windows definings
+#ifdef GetObject
+#undef GetObject
+#endif
+
+namespace {
+    using string_ref = sprites_index::string_ref;
+    
+    bool isLess(sprites_index::entry const& lhs, sprites_index::entry const& rhs) {
+        return lhs.first < rhs.first;
+    }
+    
+    // Layout of the compiled index. All the fields are 32 bit little-endian values
+    const char compiledMagic[4] = {'A', '2', 'D', 'S'};
+    const uint32_t compiledVersion = 1;
+    
+    struct CompiledHeader {
+        char magic[4];              ///< File signature
+        uint32_t version;           ///< Layout version
+        uint32_t count;             ///< Number of sprites
+        uint32_t entries_offset;    ///< Offset of the sorted entries from the file start
+        uint32_t strings_offset;    ///< Offset of the string table from the file start
+        uint32_t strings_size;      ///< Size of the string table in bytes
+        uint32_t reserved[2];       ///< Reserved for future versions, filled with zeros
+    };
+    
+    struct CompiledEntry {
+        uint32_t name, name_length; ///< Sprite name in the string table
+        uint32_t path, path_length; ///< Image path in the string table
+    };
+    
+    static_assert(sizeof(CompiledHeader) == 32, "Unexpected padding of the compiled index header");
+    static_assert(sizeof(CompiledEntry) == 16, "Unexpected padding of the compiled index entry");
+    
+    // Pointer casts of the records are valid on little-endian hosts only
+    bool isLittleEndianHost() {
+        const uint32_t probe = 1;
+        unsigned char firstByte;
+        memcpy(&firstByte, &probe, 1);
+        return firstByte == 1;
+    }
+    
+    // Appends the value in little-endian byte order independently of the host
+    void putU32(string& out, uint32_t value) {
+        out.push_back((char)(value & 0xff));
+        out.push_back((char)((value >> 8) & 0xff));
+        out.push_back((char)((value >> 16) & 0xff));
+        out.push_back((char)((value >> 24) & 0xff));
+    }
+}
+
+struct sprites_index::Pimpl {
+    mapped_text text;           ///< In-situ parsed sprites map json
+    vector<char> storage;       ///< Names and paths of the assigned sprites map
+    vector<entry> entries;      ///< Sprites sorted by names
+    
+    mapped_file compiled;                           ///< Mapped compiled index
+    CompiledEntry const* compiledEntries = nullptr; ///< Sorted entries of the compiled index
+    char const* compiledStrings = nullptr;          ///< String table of the compiled index
+    size_t compiledCount = 0;                       ///< Number of entries of the compiled index
+    
+    // Indexes the sprites map parsed right in the text
+    bool parseText() {
+        Document doc;
+        doc.ParseInsitu(text.data());
+        if(doc.HasParseError() || !doc.IsObject()) {
+            // Invalid JSON stream
+            return false;
+        }
+        
+        entries.reserve(doc.MemberCount());
+        for(auto const& m : doc.GetObject()) {
+            if(!m.value.IsString())
+                return false;
+            entries.push_back(entry(string_ref(m.name.GetString(), m.name.GetStringLength()),
+                                    string_ref(m.value.GetString(), m.value.GetStringLength())));
+        }
+        
+        sortEntries();
+        return true;
+    }
+    
+    void sortEntries() {
+        stable_sort(entries.begin(), entries.end(), &isLess);
+        
+        // The last of duplicated names wins like in the sprites_map
+        size_t count = 0;
+        for(size_t i = 0; i < entries.size(); ++i) {
+            if(i + 1 < entries.size() && entries[i + 1].first == entries[i].first)
+                continue;
+            entries[count++] = entries[i];
+        }
+        entries.resize(count);
+    }
+    
+    // Validates the mapped compiled index once, so lookups don't check offsets
+    bool initCompiled() {
+        if(!isLittleEndianHost()) {
+            CLOG(ERROR, MODULE_LOGGER) << "Compiled sprites indices aren't supported on big-endian hosts";
+            return false;
+        }
+        
+        unsigned char const* bytes = compiled.data();
+        const size_t size = compiled.size();
+        if(size < sizeof(CompiledHeader))
+            return false;
+        
+        auto const& header = *(CompiledHeader const*)bytes;
+        if(memcmp(header.magic, compiledMagic, sizeof(header.magic)) != 0 ||
+           header.version != compiledVersion ||
+           header.entries_offset % 4 || header.entries_offset > size ||
+           (uint64_t)header.count * sizeof(CompiledEntry) > size - header.entries_offset ||
+           header.strings_offset > size || header.strings_size > size - header.strings_offset)
+            return false;
+        
+        auto compiledEntries = (CompiledEntry const*)(bytes + header.entries_offset);
+        for(uint32_t i = 0; i < header.count; ++i) {
+            auto const& e = compiledEntries[i];
+            if(e.name > header.strings_size || e.name_length > header.strings_size - e.name ||
+               e.path > header.strings_size || e.path_length > header.strings_size - e.path)
+                return false;
+        }
+        
+        this->compiledEntries = compiledEntries;
+        compiledStrings = (char const*)(bytes + header.strings_offset);
+        compiledCount = header.count;
+        return true;
+    }
+    
+    entry compiledEntry(size_t index) const {
+        auto const& e = compiledEntries[index];
+        return entry(string_ref(compiledStrings + e.name, e.name_length),
+                     string_ref(compiledStrings + e.path, e.path_length));
+    }
+};
+
+sprites_index::sprites_index(): _pimpl(new Pimpl) {
+    ;;
+}
+
+sprites_index::~sprites_index() {
+    ;;
+}
+
+bool sprites_index::load(std::string const& filename) {
+    _pimpl.reset(new Pimpl);
+    if(!_pimpl->text.open(filename))
+        return false;
+    
+    if(!_pimpl->parseText()) {
+        CLOG(ERROR, MODULE_LOGGER) << "Invalid sprites map " << filename;
+        _pimpl.reset(new Pimpl);
+        return false;
+    }
+    return true;
+}
+
+bool sprites_index::load(std::istream& stream) {
+    _pimpl.reset(new Pimpl);
+    if(!_pimpl->text.read(stream) || !_pimpl->parseText()) {
+        _pimpl.reset(new Pimpl);
+        return false;
+    }
+    return true;
+}
+
+bool sprites_index::load_compiled(std::string const& filename) {
+    _pimpl.reset(new Pimpl);
+    if(!_pimpl->compiled.open(filename))
+        return false;
+    
+    if(!_pimpl->initCompiled()) {
+        CLOG(ERROR, MODULE_LOGGER) << "Invalid compiled sprites index " << filename;
+        _pimpl.reset(new Pimpl);
+        return false;
+    }
+    return true;
+}
+
+void sprites_index::assign(sprites_map const& sprites) {
+    _pimpl.reset(new Pimpl);
+    
+    // Keep all the strings in a single buffer, so references stay valid
+    size_t total = 0;
+    for(auto const& sprite : sprites)
+        total += sprite.first.size() + sprite.second.size();
+    
+    auto& storage = _pimpl->storage;
+    storage.reserve(total);
+    for(auto const& sprite : sprites) {
+        storage.insert(storage.end(), sprite.first.begin(), sprite.first.end());
+        storage.insert(storage.end(), sprite.second.begin(), sprite.second.end());
+    }
+    
+    // The map is already sorted by names
+    char const* pos = storage.data();
+    _pimpl->entries.reserve(sprites.size());
+    for(auto const& sprite : sprites) {
+        string_ref name(pos, sprite.first.size());
+        pos += sprite.first.size();
+        string_ref path(pos, sprite.second.size());
+        pos += sprite.second.size();
+        _pimpl->entries.push_back(entry(name, path));
+    }
+}
+
+sprites_index::string_ref sprites_index::find(string_ref name) const {
+    if(_pimpl->compiledEntries) {
+        // Binary search right in the mapped entries
+        size_t first = 0, count = _pimpl->compiledCount;
+        while(count > 0) {
+            size_t step = count / 2;
+            if(_pimpl->compiledEntry(first + step).first < name) {
+                first += step + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        if(first == _pimpl->compiledCount)
+            return string_ref();
+        
+        auto found = _pimpl->compiledEntry(first);
+        return found.first == name ? found.second : string_ref();
+    }
+    
+    auto const& entries = _pimpl->entries;
+    auto pos = lower_bound(entries.begin(), entries.end(), entry(name, string_ref()), &isLess);
+    if(pos == entries.end() || pos->first != name)
+        return string_ref();
+    return pos->second;
+}
+
+size_t sprites_index::size() const {
+    return _pimpl->compiledEntries ? _pimpl->compiledCount : _pimpl->entries.size();
+}
+
+sprites_index::entry sprites_index::operator[](size_t index) const {
+    return _pimpl->compiledEntries ? _pimpl->compiledEntry(index) : _pimpl->entries[index];
+}
+
+bool write_sprites_index(std::ostream& stream, std::vector<std::pair<std::string, std::string>> const& sprites) {
+    // Sort sprites by names, the last of duplicated names wins
+    vector<size_t> order(sprites.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    stable_sort(order.begin(), order.end(), [&sprites](size_t lhs, size_t rhs) {
+        return string_ref(sprites[lhs].first) < string_ref(sprites[rhs].first);
+    });
+    
+    size_t count = 0;
+    for(size_t i = 0; i < order.size(); ++i) {
+        if(i + 1 < order.size() && sprites[order[i + 1]].first == sprites[order[i]].first)
+            continue;
+        order[count++] = order[i];
+    }
+    order.resize(count);
+    
+    string entries, strings;
+    for(auto i : order) {
+        auto const& sprite = sprites[i];
+        putU32(entries, (uint32_t)strings.size());
+        putU32(entries, (uint32_t)sprite.first.size());
+        strings += sprite.first;
+        putU32(entries, (uint32_t)strings.size());
+        putU32(entries, (uint32_t)sprite.second.size());
+        strings += sprite.second;
+    }
+    
+    const uint32_t entriesOffset = sizeof(CompiledHeader);
+    const uint32_t stringsOffset = entriesOffset + (uint32_t)entries.size();
+    
+    string header(compiledMagic, sizeof(compiledMagic));
+    putU32(header, compiledVersion);
+    putU32(header, (uint32_t)order.size());
+    putU32(header, entriesOffset);
+    putU32(header, stringsOffset);
+    putU32(header, (uint32_t)strings.size());
+    putU32(header, 0);
+    putU32(header, 0);
+    
+    stream.write(header.data(), header.size());
+    stream.write(entries.data(), entries.size());
+    stream.write(strings.data(), strings.size());
+    return (bool)stream.flush();
+}
+
+std::string compiled_sprites_index_filename(std::string const& sprites_file) {
+    return sprites_file + ".idx";
+}
+
+struct sprites_index_cache::Pimpl {
+    mutex lock;                                 ///< Guards the indices
+    map<string, sprites_index_ptr> indices;     ///< Loaded indices by sprites map files
+    
+    // Loads the compiled index unless the sprites map was changed after compiling.
+    // The compiled index is enough when the sprites map isn't shipped
+    sprites_index_ptr load(string const& spritesFile) {
+        auto index = make_shared<sprites_index>();
+        
+        boost::system::error_code ec;
+        auto compiledFile = compiled_sprites_index_filename(spritesFile);
+        auto compiledTime = fs::last_write_time(compiledFile, ec);
+        bool hasCompiled = !ec;
+        auto spritesTime = fs::last_write_time(spritesFile, ec);
+        bool isCompiledFresh = hasCompiled && (ec || compiledTime >= spritesTime);
+        if(isCompiledFresh && index->load_compiled(compiledFile))
+            return index;
+        
+        if(!index->load(spritesFile))
+            return nullptr;
+        return index;
+    }
+};
+
+sprites_index_cache::sprites_index_cache(): _pimpl(new Pimpl) {
+    ;;
+}
+
+sprites_index_cache::~sprites_index_cache() {
+    ;;
+}
+
+sprites_index_ptr sprites_index_cache::get(std::string const& sprites_file) {
+    // Atlases waiting for the same sprites map wait for the single load
+    lock_guard<mutex> guard(_pimpl->lock);
+    auto pos = _pimpl->indices.find(sprites_file);
+    if(pos != _pimpl->indices.end())
+        return pos->second;
+    
+    auto index = _pimpl->load(sprites_file);
+    if(index)
+        _pimpl->indices[sprites_file] = index;
+    return index;
+}
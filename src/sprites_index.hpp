@@ -0,0 +1,82 @@
+#pragma once
+
+#include "helpers.hpp"
+#include <boost/utility/string_ref.hpp>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+/**
+ @brief Immutable sprite name to image path index.
+ The sprites map json is parsed in situ, so names and paths refer to the loaded text
+ and the index is a sorted vector of them, which is searched by binary search.
+ The compiled index (see write_sprites_index) is searched right in the mapped file.
+ */
+class sprites_index {
+public:
+    using string_ref = boost::string_ref;
+    using entry = std::pair<string_ref, string_ref>;
+    
+    sprites_index();
+    ~sprites_index();
+    
+    /// Loads the sprites map json file
+    bool load(std::string const& filename);
+    
+    /// Loads the sprites map json from the stream
+    bool load(std::istream& stream);
+    
+    /// Maps the compiled index file into memory
+    bool load_compiled(std::string const& filename);
+    
+    /// Builds the index of the sprites map
+    void assign(sprites_map const& sprites);
+    
+    /// Finds the image path of the sprite. Returns an empty reference if there is no such sprite
+    string_ref find(string_ref name) const;
+    
+    /// Returns number of sprites
+    size_t size() const;
+    
+    /// Returns the sprite by its index. Sprites are sorted by their names
+    entry operator[](size_t index) const;
+
+private:
+    sprites_index(sprites_index const&) = delete;
+    sprites_index& operator=(sprites_index const&) = delete;
+    
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
+
+using sprites_index_ptr = std::shared_ptr<const sprites_index>;
+
+/**
+ @brief Writes the compiled index of sprites.
+ The index is a little-endian file with records sorted by sprite names and a string table,
+ so it's loaded without parsing.
+ */
+bool write_sprites_index(std::ostream& stream, std::vector<std::pair<std::string, std::string>> const& sprites);
+
+/// Returns the filename of the compiled index written next to the sprites map
+std::string compiled_sprites_index_filename(std::string const& sprites_file);
+
+/**
+ @brief Loads each sprites map once and shares its index between atlases.
+ The compiled index next to the sprites map is preferred unless it's older than the sprites map.
+ The cache can be used from several threads.
+ */
+class sprites_index_cache {
+public:
+    sprites_index_cache();
+    ~sprites_index_cache();
+    
+    /// Returns the index of the sprites map file, loading it on the first request. Returns null on error
+    sprites_index_ptr get(std::string const& sprites_file);
+
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
+
+using sprites_index_cache_ptr = std::shared_ptr<sprites_index_cache>;
@@ -0,0 +1,68 @@
+#include "thread_pool.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+using namespace ::std;
+
+struct thread_pool::Pimpl {
+    vector<thread> workers;             ///< Worker threads
+    deque<function<void()>> tasks;      ///< Pending tasks
+    mutex lock;                         ///< Guards the tasks queue
+    condition_variable wakeup;          ///< Signals about new tasks or stopping
+    bool stopping = false;              ///< Workers should exit when the queue is empty
+    
+    // Executes tasks until the pool is stopped
+    void run() {
+        for(;;) {
+            function<void()> task;
+            {
+                unique_lock<mutex> guard(lock);
+                wakeup.wait(guard, [this]() { return stopping || !tasks.empty(); });
+                if(tasks.empty())
+                    return;
+                
+                task = move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+thread_pool::thread_pool(unsigned threads): _pimpl(new Pimpl) {
+    if(!threads)
+        threads = (std::max)(thread::hardware_concurrency(), 1u);
+    
+    _pimpl->workers.reserve(threads);
+    for(unsigned i = 0; i < threads; ++i) {
+        _pimpl->workers.emplace_back([this]() { _pimpl->run(); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        lock_guard<mutex> guard(_pimpl->lock);
+        _pimpl->stopping = true;
+    }
+    _pimpl->wakeup.notify_all();
+    
+    for(auto& worker : _pimpl->workers) {
+        worker.join();
+    }
+}
+
+unsigned thread_pool::size() const {
+    return (unsigned)_pimpl->workers.size();
+}
+
+void thread_pool::enqueue(std::function<void()> task) {
+    {
+        lock_guard<mutex> guard(_pimpl->lock);
+        _pimpl->tasks.push_back(move(task));
+    }
+    _pimpl->wakeup.notify_one();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "forwards.hpp"
+#include <future>
+
+/**
+ * @brief Fixed-size pool of worker threads.
+ * Tasks are executed in the order they were submitted.
+ */
+class thread_pool {
+public:
+    /// Creates the pool. Zero threads means the number of hardware threads.
+    explicit thread_pool(unsigned threads = 0);
+    ~thread_pool();
+    
+    /// Returns the number of worker threads
+    unsigned size() const;
+    
+    /**
+     * @brief Schedules the function and returns the future of its result.
+     * @code
+     *  auto res = pool->submit([]() { return 42; });
+     *  assert(res.get() == 42);
+     * @endcode
+     */
+    template<typename Fn>
+    auto submit(Fn fn) -> std::future<decltype(fn())> {
+        using result_type = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<result_type()>>(std::move(fn));
+        auto result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+    
+private:
+    void enqueue(std::function<void()> task);
+
+private:
+    struct Pimpl;
+    std::unique_ptr<Pimpl> _pimpl;
+};
@@ -0,0 +1,4 @@
+#pragma once
+
+/// Version of the tool. Bump it on any change affecting the produced atlases.
+#define ATLAS2D_MAPPER_VERSION "1.1.0"
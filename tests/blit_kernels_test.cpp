@@ -0,0 +1,321 @@
+/**
+ Checks the image_blit kernels chosen for the CPU against the straightforward per-pixel code:
+ premultiplication of all channel and alpha pairs, row conversion between rgba8 and rgb8,
+ drawing images of every rgb8/rgba8 pair straight and rotated, with and without premultiplication,
+ mirroring paddings around areas of 1..40 pixels, clipped by the target and wider than the area,
+ and halving images of 1..40 pixels wide split into regions by random cuts, which are averaged within the regions.
+ 
+ Build: c++ -std=c++11 -O2 -Isrc -I<libatlas2d>/include tests/blit_kernels_test.cpp src/image_blit.cpp -latlas2d -o blit_kernels_test
+ Add -DIMAGE_BLIT_NO_AVX2 or -DIMAGE_BLIT_NO_SIMD to check SSE2 or scalar kernels.
+ */
+#include "image_blit.hpp"
+#include "helpers.hpp"
+#include <atlas2d/pixel_format.hpp>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace ::atlas2d;
+using namespace ::std;
+
+namespace {
+    
+    int failures = 0;
+    
+    // Reports the failed check
+    bool check(bool condition, char const* what, int a, int b) {
+        if(!condition) {
+            ++failures;
+            if(failures <= 20)
+                printf("FAILED %s (%d, %d)\n", what, a, b);
+        }
+        return condition;
+    }
+    
+    // Returns round(channel * alpha / 255)
+    unsigned char premultiplied(unsigned channel, unsigned alpha) {
+        return (unsigned char)((channel * alpha + 127) / 255);
+    }
+    
+    // Converts the pixel pixel by pixel as the kernels have to
+    void convertPixel(unsigned char const* src, pixel_format srcFmt, unsigned char* dst, pixel_format dstFmt,
+                      bool premultiply) {
+        const unsigned alpha = srcFmt == pixel_format::rgba8 ? src[3] : 255;
+        for(int c = 0; c < 3; ++c)
+            dst[c] = premultiply ? premultiplied(src[c], alpha) : src[c];
+        if(dstFmt == pixel_format::rgba8)
+            dst[3] = (unsigned char)alpha;
+    }
+    
+    // Fills the buffer by random bytes, every fourth pixel is transparent or opaque
+    vector<unsigned char> randomPixels(mt19937& rng, size_t count, size_t bpp) {
+        uniform_int_distribution<int> channel(0, 255);
+        vector<unsigned char> pixels(count * bpp);
+        for(auto& value : pixels)
+            value = (unsigned char)channel(rng);
+        
+        if(bpp == 4) {
+            for(size_t i = 0; i < count; i += 4)
+                pixels[i * 4 + 3] = (i / 4) % 2 ? 255 : 0;
+        }
+        return pixels;
+    }
+    
+    void testPremultiplyAllValues() {
+        vector<unsigned char> src(256 * 4), dst(256 * 4);
+        for(int alpha = 0; alpha < 256; ++alpha) {
+            for(int i = 0; i < 256; ++i) {
+                src[i * 4 + 0] = (unsigned char)i;
+                src[i * 4 + 1] = (unsigned char)(255 - i);
+                src[i * 4 + 2] = (unsigned char)(i ^ 0x5a);
+                src[i * 4 + 3] = (unsigned char)alpha;
+            }
+            convert_row(src.data(), pixel_format::rgba8, dst.data(), pixel_format::rgba8, 256, true);
+            for(int i = 0; i < 256; ++i) {
+                for(int c = 0; c < 3; ++c)
+                    check(dst[i * 4 + c] == premultiplied(src[i * 4 + c], alpha), "premultiply", src[i * 4 + c], alpha);
+                check(dst[i * 4 + 3] == alpha, "premultiply keeps alpha", i, alpha);
+            }
+        }
+    }
+    
+    void testConvertRows(mt19937& rng) {
+        const pixel_format formats[] = {pixel_format::rgba8, pixel_format::rgb8};
+        for(auto srcFmt : formats) {
+            for(auto dstFmt : formats) {
+                const size_t srcBpp = pixel_format_details(srcFmt).bpp;
+                const size_t dstBpp = pixel_format_details(dstFmt).bpp;
+                for(bool premultiply : {false, true}) {
+                    for(int count = 0; count < 70; ++count) {
+                        auto src = randomPixels(rng, count, srcBpp);
+                        vector<unsigned char> expected(count * dstBpp);
+                        for(int i = 0; i < count; ++i)
+                            convertPixel(&src[i * srcBpp], srcFmt, &expected[i * dstBpp], dstFmt, premultiply);
+                        
+                        vector<unsigned char> dst(count * dstBpp);
+                        convert_row(src.data(), srcFmt, dst.data(), dstFmt, count, premultiply);
+                        check(dst == expected, "convert_row", (int)srcBpp * 10 + (int)dstBpp, count);
+                        
+                        // expanding rgb8 to rgba8 can't be done in place
+                        if(srcBpp >= dstBpp) {
+                            convert_row(src.data(), srcFmt, src.data(), dstFmt, count, premultiply);
+                            src.resize(count * dstBpp);
+                            check(src == expected, "convert_row in place", (int)srcBpp * 10 + (int)dstBpp, count);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    void testBlits(mt19937& rng) {
+        const pixel_format formats[] = {pixel_format::rgba8, pixel_format::rgb8};
+        const int margin = 3;
+        for(auto srcFmt : formats) {
+            for(auto dstFmt : formats) {
+                const size_t srcBpp = pixel_format_details(srcFmt).bpp;
+                const size_t dstBpp = pixel_format_details(dstFmt).bpp;
+                for(int side = 0; side < 30 * 30; ++side) {
+                    const int width = side % 30 + 1;
+                    const int height = side / 30 + 1;
+                    auto pixels = randomPixels(rng, width * height, srcBpp);
+                    
+                    image_props image;
+                    image.size = size(width, height);
+                    image.fmt = srcFmt;
+                    image.pixels = raw_data_ptr(pixels.data(), [](unsigned char*) { ;; });
+                    
+                    for(int mode = 0; mode < 4; ++mode) {
+                        const bool rotated = (mode & 1) != 0;
+                        const bool premultiply = (mode & 2) != 0;
+                        const int drawnWidth = rotated ? height : width;
+                        const int drawnHeight = rotated ? width : height;
+                        
+                        pixel_buffer target;
+                        target.dims = size(drawnWidth + margin * 2, drawnHeight + margin * 2);
+                        target.stride = target.dims.width * dstBpp;
+                        target.fmt = dstFmt;
+                        target.premultiplied = premultiply;
+                        
+                        vector<unsigned char> expected(target.stride * target.dims.height, 0xcd);
+                        for(int y = 0; y < height; ++y) {
+                            for(int x = 0; x < width; ++x) {
+                                const int dstX = margin + (rotated ? height - 1 - y : x);
+                                const int dstY = margin + (rotated ? x : y);
+                                convertPixel(&pixels[(y * width + x) * srcBpp], srcFmt,
+                                             &expected[dstY * target.stride + dstX * dstBpp], dstFmt, premultiply);
+                            }
+                        }
+                        
+                        vector<unsigned char> drawn(expected.size(), 0xcd);
+                        target.data = drawn.data();
+                        const bool isOk = blit_image(image, rotated, target, offset(margin, margin));
+                        check(isOk && drawn == expected, rotated ? "rotated blit_image" : "blit_image",
+                              (int)srcBpp * 10 + (int)dstBpp, mode * 10000 + width * 100 + height);
+                    }
+                }
+            }
+        }
+    }
+    
+    // Returns the area pixel mirrored to the coordinate, paddings wider than the area repeat its farthest pixel
+    int mirroredCoord(int coord, int begin, int length) {
+        if(coord < begin)
+            return begin + (std::min)(begin - 1 - coord, length - 1);
+        if(coord >= begin + length)
+            return begin + length - 1 - (std::min)(coord - begin - length, length - 1);
+        return coord;
+    }
+    
+    void testMirrorPadding(mt19937& rng) {
+        const pixel_format formats[] = {pixel_format::rgba8, pixel_format::rgb8};
+        const int paddings[] = {1, 2, 3, 4, 5, 8, 13, 41};
+        uniform_int_distribution<int> margin(0, 45);
+        for(auto fmt : formats) {
+            const size_t bpp = pixel_format_details(fmt).bpp;
+            for(int side = 1; side <= 40; ++side) {
+                for(int padding : paddings) {
+                    // margins below the padding clip it by the target bounds
+                    const rect area((std::min)(margin(rng), padding + 2), (std::min)(margin(rng), padding + 2),
+                                    side, (side * 7) % 40 + 1);
+                    pixel_buffer target;
+                    target.dims = size(area.x + area.width + (std::min)(margin(rng), padding + 2),
+                                       area.y + area.height + (std::min)(margin(rng), padding + 2));
+                    target.stride = target.dims.width * bpp + 5;
+                    target.fmt = fmt;
+                    
+                    vector<unsigned char> pixels = randomPixels(rng, target.stride * target.dims.height / bpp + 1, bpp);
+                    vector<unsigned char> expected = pixels;
+                    for(int y = (std::max)(0, area.y - padding); y < (std::min)(target.dims.height, area.y + area.height + padding); ++y) {
+                        for(int x = (std::max)(0, area.x - padding); x < (std::min)(target.dims.width, area.x + area.width + padding); ++x) {
+                            const int srcX = mirroredCoord(x, area.x, area.width);
+                            const int srcY = mirroredCoord(y, area.y, area.height);
+                            memcpy(&expected[y * target.stride + x * bpp], &pixels[srcY * target.stride + srcX * bpp], bpp);
+                        }
+                    }
+                    
+                    target.data = pixels.data();
+                    mirror_padding(target, area, padding);
+                    check(pixels == expected, "mirror_padding", (int)bpp * 100 + padding, side);
+                }
+            }
+        }
+    }
+    
+    // Averages the pixels of the 2x2 block of the destination pixel which fall into the area
+    void averageBlock(vector<unsigned char> const& src, size_t stride, size_t bpp, rect const& area,
+                      int x, int y, unsigned char* dst) {
+        unsigned sums[4] = {0, 0, 0, 0};
+        unsigned count = 0;
+        for(int sy = 2 * y; sy < 2 * y + 2; ++sy) {
+            for(int sx = 2 * x; sx < 2 * x + 2; ++sx) {
+                if(sx < area.x || sx >= area.x + area.width || sy < area.y || sy >= area.y + area.height)
+                    continue;
+                
+                for(size_t c = 0; c < bpp; ++c)
+                    sums[c] += src[sy * stride + sx * bpp + c];
+                ++count;
+            }
+        }
+        for(size_t c = 0; c < bpp; ++c)
+            dst[c] = (unsigned char)((sums[c] + count / 2) / count);
+    }
+    
+    // Splits the side by random cuts at odd and even positions
+    vector<int> randomCuts(mt19937& rng, int side) {
+        vector<int> cuts = {0};
+        uniform_int_distribution<int> step(1, 9);
+        while(cuts.back() < side)
+            cuts.push_back((std::min)(side, cuts.back() + step(rng)));
+        return cuts;
+    }
+    
+    void testDownsample(mt19937& rng) {
+        const pixel_format formats[] = {pixel_format::rgba8, pixel_format::rgb8};
+        for(auto fmt : formats) {
+            const size_t bpp = pixel_format_details(fmt).bpp;
+            for(int side = 0; side < 40 * 12; ++side) {
+                const int width = side % 40 + 1;
+                const int height = side / 40 * 3 + 1;
+                const size_t srcStride = width * bpp + 3;
+                auto pixels = randomPixels(rng, srcStride * height / bpp + 1, bpp);
+                
+                // Regions of the random cuts, the last ones win on their shared destination pixels.
+                // A third of them is skipped, so borders next to the gaps aren't overwritten by the neighbours
+                vector<rect> regions;
+                const vector<int> cutsX = randomCuts(rng, width);
+                const vector<int> cutsY = randomCuts(rng, height);
+                for(size_t j = 1; j < cutsY.size(); ++j) {
+                    for(size_t i = 1; i < cutsX.size(); ++i) {
+                        if(rng() % 3)
+                            regions.push_back(rect(cutsX[i - 1], cutsY[j - 1], cutsX[i] - cutsX[i - 1], cutsY[j] - cutsY[j - 1]));
+                    }
+                }
+                
+                pixel_buffer src;
+                src.data = pixels.data();
+                src.dims = size(width, height);
+                src.stride = srcStride;
+                src.fmt = fmt;
+                
+                pixel_buffer dst;
+                dst.dims = size((std::max)(1, width / 2), (std::max)(1, height / 2));
+                dst.stride = dst.dims.width * bpp + 5;
+                dst.fmt = fmt;
+                
+                vector<unsigned char> expected(dst.stride * dst.dims.height, 0xcd);
+                vector<rect> expectedRegions;
+                const rect whole(0, 0, width, height);
+                for(int y = 0; y < dst.dims.height; ++y) {
+                    for(int x = 0; x < dst.dims.width; ++x)
+                        averageBlock(pixels, srcStride, bpp, whole, x, y, &expected[y * dst.stride + x * bpp]);
+                }
+                for(auto const& region : regions) {
+                    const int dstX0 = region.x / 2;
+                    const int dstY0 = region.y / 2;
+                    const int dstX1 = (std::min)((region.x + region.width + 1) / 2, dst.dims.width);
+                    const int dstY1 = (std::min)((region.y + region.height + 1) / 2, dst.dims.height);
+                    for(int y = dstY0; y < dstY1; ++y) {
+                        for(int x = dstX0; x < dstX1; ++x)
+                            averageBlock(pixels, srcStride, bpp, region, x, y, &expected[y * dst.stride + x * bpp]);
+                    }
+                    expectedRegions.push_back(dstX0 < dstX1 && dstY0 < dstY1 ?
+                                              rect(dstX0, dstY0, dstX1 - dstX0, dstY1 - dstY0) : rect(dstX0, dstY0, 0, 0));
+                }
+                
+                vector<unsigned char> downsampled(expected.size(), 0xcd);
+                dst.data = downsampled.data();
+                const bool isOk = downsample_image(src, dst, regions);
+                check(isOk && downsampled == expected, "downsample_image", (int)bpp, width * 100 + height);
+                
+                bool sameRegions = true;
+                for(size_t i = 0; i < regions.size(); ++i) {
+                    sameRegions = sameRegions && regions[i].x == expectedRegions[i].x && regions[i].y == expectedRegions[i].y &&
+                        regions[i].width == expectedRegions[i].width && regions[i].height == expectedRegions[i].height;
+                }
+                check(sameRegions, "downsample_image regions", (int)bpp, width * 100 + height);
+            }
+        }
+    }
+
+} // anonymous
+
+int main(int argc, const char * argv[]) {
+    printf("Checking %s kernels\n", blit_kernels_name());
+    
+    mt19937 rng(2024);
+    testPremultiplyAllValues();
+    testConvertRows(rng);
+    testBlits(rng);
+    testMirrorPadding(rng);
+    testDownsample(rng);
+    
+    if(failures) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    
+    printf("All checks passed\n");
+    return 0;
+}